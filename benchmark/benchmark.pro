@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+QMAKE_CXXFLAGS += -O2
+
+INCLUDEPATH += ../src
+
+SOURCES += main.cpp \
+           ../src/min_max.cpp \
+           ../src/min_max_avx2.cpp
@@ -0,0 +1,148 @@
+/*
+ * Compares the fused min/max kernels against the per sample loops
+ * previously used by Buffer::recomputeMin/MaxColorValues().
+ */
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "min_max.hpp"
+
+using namespace std;
+
+enum class BufferType {
+    UnsignedByte = 0,
+    UnsignedShort = 2,
+    Short = 3,
+    Int32 = 4,
+    Float32 = 5
+};
+
+// Two passes over the buffer, branching on the type for every sample
+void legacy_min_max(const uint8_t* buffer, BufferType type, int width,
+                    int height, int step, int channels,
+                    float* lowest, float* upper) {
+    for(int i = 0; i < 4; ++i) {
+        lowest[i] = numeric_limits<float>::max();
+        upper[i] = numeric_limits<float>::lowest();
+    }
+
+    auto sample = [&](int i) {
+        if(type == BufferType::Float32)
+            return reinterpret_cast<const float*>(buffer)[i];
+        else if(type == BufferType::UnsignedByte)
+            return static_cast<float>(buffer[i]);
+        else if(type == BufferType::Short)
+            return static_cast<float>(reinterpret_cast<const short*>(buffer)[i]);
+        else if(type == BufferType::UnsignedShort)
+            return static_cast<float>(reinterpret_cast<const unsigned short*>(buffer)[i]);
+        else
+            return static_cast<float>(reinterpret_cast<const int*>(buffer)[i]);
+    };
+
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x) {
+            int i = y*step + x;
+            for(int c = 0; c < channels; ++c)
+                lowest[c] = std::min(lowest[c], sample(channels*i + c));
+        }
+    }
+
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x) {
+            int i = y*step + x;
+            for(int c = 0; c < channels; ++c)
+                upper[c] = std::max(upper[c], sample(channels*i + c));
+        }
+    }
+}
+
+double milliseconds(const function<void()>& fn, int repetitions) {
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < repetitions; ++i) {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(end - start).count() / repetitions;
+}
+
+template<typename T>
+vector<T> random_buffer(size_t size, mt19937& rng) {
+    uniform_real_distribution<double> dist(numeric_limits<T>::lowest() / 2.0,
+                                           numeric_limits<T>::max() / 2.0);
+    vector<T> data(size);
+    for(auto& value: data) {
+        value = static_cast<T>(dist(rng));
+    }
+    // NaNs must not affect the results
+    if(numeric_limits<T>::has_quiet_NaN) {
+        data[size / 3] = numeric_limits<T>::quiet_NaN();
+    }
+    return data;
+}
+
+template<typename T>
+bool run(const char* name, BufferType type, int channels, mt19937& rng) {
+    // Odd dimensions and a padded step exercise the row tails
+    const int width = 3001;
+    const int height = 2003;
+    const int step = width + 7;
+    const int repetitions = 5;
+
+    vector<T> data = random_buffer<T>(static_cast<size_t>(step) * height * channels, rng);
+    const uint8_t* buffer = reinterpret_cast<const uint8_t*>(data.data());
+    const size_t row_stride = static_cast<size_t>(step) * channels;
+
+    float legacy_low[4], legacy_up[4];
+    float scalar_low[4], scalar_up[4];
+    float fused_low[4], fused_up[4];
+
+    MinMaxKernel scalar = scalar_min_max_kernel<T>(channels);
+    MinMaxKernel fused = select_min_max_kernel<T>(channels);
+
+    double legacy_ms = milliseconds([&]() {
+        legacy_min_max(buffer, type, width, height, step, channels,
+                       legacy_low, legacy_up);
+    }, repetitions);
+    double scalar_ms = milliseconds([&]() {
+        scalar(data.data(), row_stride, width, height, scalar_low, scalar_up);
+    }, repetitions);
+    double fused_ms = milliseconds([&]() {
+        fused(data.data(), row_stride, width, height, fused_low, fused_up);
+    }, repetitions);
+
+    bool matches = true;
+    for(int c = 0; c < channels; ++c) {
+        matches = matches &&
+                  legacy_low[c] == scalar_low[c] && legacy_up[c] == scalar_up[c] &&
+                  legacy_low[c] == fused_low[c] && legacy_up[c] == fused_up[c];
+    }
+
+    printf("%-8s %d ch  legacy %8.2f ms  scalar %8.2f ms  %s %8.2f ms  "
+           "speedup %5.1fx  %s\n",
+           name, channels, legacy_ms, scalar_ms, min_max_instruction_set(),
+           fused_ms, legacy_ms / fused_ms, matches ? "ok" : "MISMATCH");
+
+    return matches;
+}
+
+int main() {
+    mt19937 rng(42);
+    bool ok = true;
+
+    for(int channels = 1; channels <= 4; ++channels) {
+        ok = run<uint8_t>("uint8", BufferType::UnsignedByte, channels, rng) && ok;
+        ok = run<uint16_t>("uint16", BufferType::UnsignedShort, channels, rng) && ok;
+        ok = run<int16_t>("int16", BufferType::Short, channels, rng) && ok;
+        ok = run<int32_t>("int32", BufferType::Int32, channels, rng) && ok;
+        ok = run<float>("float32", BufferType::Float32, channels, rng) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -13,6 +13,8 @@ SOURCES += src/camera.cpp\
            src/shaders/buff_vert_shader.cpp \
            src/shaders/text_frag_shader.cpp \
            src/shaders/text_vert_shader.cpp \
+           src/shaders/label_frag_shader.cpp \
+           src/shaders/label_vert_shader.cpp \
            src/shader.cpp \
            src/mainwindow.cpp \
            src/glcanvas.cpp \
@@ -25,7 +27,29 @@ SOURCES += src/camera.cpp\
            src/shaders/background_frag_shader.cpp \
            src/shaders/background_vert_shader.cpp \
            src/symbol_search_input.cpp \
-           src/symbol_completer.cpp
+           src/symbol_completer.cpp \
+           src/texture_format.cpp \
+           src/texture_pool.cpp \
+           src/texture_uploader.cpp \
+           src/tile_hash.cpp \
+           src/tile_cache.cpp \
+           src/min_max.cpp \
+           src/min_max_avx2.cpp \
+           src/thread_pool.cpp \
+           src/stats_engine.cpp \
+           src/pyramid.cpp \
+           src/tile_analysis.cpp \
+           src/ingest_pipeline.cpp \
+           src/inferior_memory.cpp \
+           src/region_fetcher.cpp \
+           src/soft_dirty.cpp \
+           src/memory_manager.cpp \
+           src/lz_codec.cpp \
+           src/buffer_history.cpp \
+           src/trace_journal.cpp \
+           src/journal_reader.cpp \
+           src/journal_player.cpp \
+           src/tile_store.cpp
 
 required_resources.path = $$OUT_PWD
 required_resources.files = resources/serif.ttf \
@@ -64,7 +88,29 @@ HEADERS  += src/buffer.hpp \
     src/managed_pointer.h \
     src/background.hpp \
     src/symbol_completer.h \
-    src/symbol_search_input.h
+    src/symbol_search_input.h \
+    src/texture_format.hpp \
+    src/texture_pool.hpp \
+    src/texture_uploader.hpp \
+    src/tile_hash.hpp \
+    src/tile_cache.hpp \
+    src/min_max.hpp \
+    src/min_max_kernels.hpp \
+    src/thread_pool.hpp \
+    src/stats_engine.hpp \
+    src/pyramid.hpp \
+    src/tile_analysis.hpp \
+    src/ingest_pipeline.hpp \
+    src/inferior_memory.hpp \
+    src/region_fetcher.hpp \
+    src/soft_dirty.hpp \
+    src/memory_manager.hpp \
+    src/lz_codec.hpp \
+    src/buffer_history.hpp \
+    src/trace_journal.hpp \
+    src/journal_reader.hpp \
+    src/journal_player.hpp \
+    src/tile_store.hpp
 
 FORMS    += ui/mainwindow.ui
 
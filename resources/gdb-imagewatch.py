@@ -30,38 +30,188 @@ lib.update_plot.argtypes = [ctypes.py_object, # Buffer ptr
                             ctypes.c_int, # Step size (in pixels)
                             ctypes.py_object] # Pixel format
                                                          # set
+lib.plot_inferior_buffer.argtypes = [ctypes.c_int, # Inferior PID
+                                     ctypes.c_ulonglong, # Buffer address
+                                     ctypes.py_object, # Variable name
+                                     ctypes.c_int, # Buffer width
+                                     ctypes.c_int, # Buffer height
+                                     ctypes.c_int, # Number of channels
+                                     ctypes.c_int, # Type (0=float32, 1=uint8)
+                                     ctypes.c_int, # Step size (in pixels)
+                                     ctypes.py_object] # Pixel format
+lib.plot_inferior_buffer.restype = ctypes.c_bool # False if the memory couldn't
+                                                 # be read
 FETCH_BUFFER_CBK_TYPE = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_char_p)
 lib.initialize_window.argtypes = [
                               FETCH_BUFFER_CBK_TYPE # Python function to be called
                               ]                # when the user requests a symbol
                                                # name from the viewer interface
+lib.finish_inferior_reads.argtypes = [ctypes.c_int] # Inferior PID, 0 if not
+                                                   # native
+lib.open_trace_journal.argtypes = [ctypes.c_char_p] # Journal path
+lib.open_trace_journal.restype = ctypes.c_bool # False if it couldn't be created
+lib.close_trace_journal.restype = ctypes.c_longlong # Frames written, -1 if the
+                                                    # journal is incomplete
+lib.replay_journal.argtypes = [ctypes.c_char_p] # Journal path
+lib.trace_inferior_buffer.argtypes = [ctypes.c_ulonglong, # Breakpoint hit count
+                                      ctypes.c_int, # Inferior PID
+                                      ctypes.c_ulonglong, # Buffer address
+                                      ctypes.py_object, # Variable name
+                                      ctypes.c_int, # Buffer width
+                                      ctypes.c_int, # Buffer height
+                                      ctypes.c_int, # Number of channels
+                                      ctypes.c_int, # Type (0=float32, 1=uint8)
+                                      ctypes.c_int, # Step size (in pixels)
+                                      ctypes.py_object] # Pixel format
+lib.trace_inferior_buffer.restype = ctypes.c_bool # False if the memory
+                                                  # couldn't be read
+lib.trace_binary.argtypes = [ctypes.c_ulonglong, # Breakpoint hit count
+                             ctypes.py_object, # Buffer ptr
+                             ctypes.py_object, # Variable name
+                             ctypes.c_int, # Buffer width
+                             ctypes.c_int, # Buffer height
+                             ctypes.c_int, # Number of channels
+                             ctypes.c_int, # Type (0=float32, 1=uint8)
+                             ctypes.c_int, # Step size (in pixels)
+                             ctypes.py_object] # Pixel format
 lib.update_plot.rettype = ctypes.c_bool # Buffer ptr
 lib.update_available_variables.argtypes = [
                               ctypes.py_object # List of available variables in
                               ]                # the current context
+lib.update_available_variables.restype = ctypes.py_object # List of variables
+                                                          # to be plotted
 
 import gdbiwtype
 import qtcreatorintegration
 
+##
+# Only reads the header of the buffer and its first element, which is cheap;
+# the pixels are read by read_buffer()
 def get_buffer_metadata(variable):
     picked_obj = gdb.parse_and_eval(variable)
 
     buffer, width, height, channels, type, step, pixel_layout = gdbiwtype.get_buffer_info(picked_obj)
 
-    bytes = get_buffer_size(width, height, channels, type, step)
+    # Check if buffer is valid. If it isn't, this function will throw an
+    # exception, so that uninitialized buffers aren't offered for plotting
+    gdb.execute('x '+str(int(buffer)), to_string=True)
+
+    return [buffer, width, height, channels, type, step, pixel_layout]
 
-    # Check if buffer is valid. If it isn't, this function will throw an exception
-    gdb.execute('x '+str(int(buffer)))
+def read_buffer(metadata):
+    buffer, width, height, channels, type, step, pixel_layout = metadata
+
+    bytes = get_buffer_size(width, height, channels, type, step)
 
     inferior = gdb.selected_inferior()
     mem = inferior.read_memory(buffer, bytes)
 
     return [mem, width, height, channels, type, step, pixel_layout]
 
-def request_buffer_update(variable):
-    mem, width, height, channels, type, step, pixel_layout = get_buffer_metadata(variable)
+##
+# PID of the inferior if the library can read its memory directly, or 0 if it
+# must go through GDB (remote targets, core files, or GDB versions that don't
+# tell the kind of the connection)
+def get_native_pid():
+    inferior = gdb.selected_inferior()
+    connection = getattr(inferior, 'connection', None)
+    if connection is None or connection.type != 'native':
+        return 0
+    return inferior.pid
+
+def plot_buffer(variable, metadata):
+    buffer, width, height, channels, type, step, pixel_layout = metadata
+
+    pid = get_native_pid()
+    if pid != 0 and lib.plot_inferior_buffer(pid, int(buffer), variable, width, height, channels, type, step, pixel_layout):
+        lib.finish_inferior_reads(pid)
+        return
+
+    mem, width, height, channels, type, step, pixel_layout = read_buffer(metadata)
+    lib.plot_binary(mem, variable, width, height, channels, type, step, pixel_layout)
+    pass
+
+##
+# Plots several buffers, reading the memory they share only once. Matrices
+# copied by value, and ROIs of a bigger one, point into the same memory.
+# The biggest buffers are plotted first, so that the library can take the
+# ones within them from what it already read; overlapping buffers that must
+# be read through GDB are read as one range, which each of them gets a view
+# into. A buffer that can't be read doesn't keep the others from being
+# plotted.
+def plot_buffers(buffers):
+    pid = get_native_pid()
+    ranges = []
+    for variable, metadata in buffers:
+        try:
+            buffer, width, height, channels, type, step, pixel_layout = metadata
+            start = int(buffer)
+            end = start + get_buffer_size(width, height, channels, type, step)
+            ranges.append([start, end, variable, metadata])
+        except Exception as err:
+            print('Warning: Could not read buffer "' + variable + '"')
+            pass
+        pass
+    ranges.sort(key=lambda r: r[0] - r[1])
+
+    unread = []
+    for start, end, variable, metadata in ranges:
+        buffer, width, height, channels, type, step, pixel_layout = metadata
+        try:
+            plotted = pid != 0 and lib.plot_inferior_buffer(pid, start, variable, width, height, channels, type, step, pixel_layout)
+        except Exception as err:
+            plotted = False
+            pass
+        if not plotted:
+            unread.append([start, end, variable, metadata])
+            pass
+        pass
+
+    # Overlapping ranges are merged
+    unread.sort(key=lambda r: r[0])
+    groups = []
+    for r in unread:
+        if len(groups) > 0 and r[0] < groups[-1][1]:
+            groups[-1][1] = max(groups[-1][1], r[1])
+            groups[-1][2].append(r)
+        else:
+            groups.append([r[0], r[1], [r]])
+            pass
+        pass
+
+    for start, end, members in groups:
+        try:
+            mem = memoryview(gdb.selected_inferior().read_memory(start, end - start))
+        except Exception as err:
+            mem = None
+            pass
 
-    lib.update_plot(mem, variable, width, height, channels, type, step, pixel_layout)
+        for member_start, member_end, variable, metadata in members:
+            buffer, width, height, channels, type, step, pixel_layout = metadata
+            try:
+                if mem is not None:
+                    member_mem = mem[member_start - start:member_end - start]
+                else:
+                    # A single unreadable member fails the whole range, so
+                    # each of them is read on its own
+                    member_mem = gdb.selected_inferior().read_memory(member_start, member_end - member_start)
+                    pass
+                lib.plot_binary(member_mem, variable, width, height, channels, type, step, pixel_layout)
+            except Exception as err:
+                print('Warning: Could not read buffer "' + variable + '"')
+                pass
+            pass
+        pass
+
+    # Starts tracking the pages written until the next stop, so it also runs
+    # when no buffer is displayed
+    if pid != 0:
+        lib.finish_inferior_reads(pid)
+        pass
+    pass
+
+def request_buffer_update(variable):
+    plot_buffer(variable, get_buffer_metadata(variable))
     pass
 
 class MainThreadPlotVariableRunner():
@@ -97,6 +247,18 @@ def initialize_window():
         pass
     pass
 
+##
+# Journal viewer, which doesn't need GDB
+if len(sys.argv)==3 and sys.argv[1] == '--replay':
+    initialize_window()
+    lib.replay_journal(sys.argv[2].encode('utf-8'))
+
+    while lib.is_running():
+        time.sleep(0.5)
+
+    exit()
+    pass
+
 ##
 # Test application
 if len(sys.argv)==2 and sys.argv[1] == '--test':
@@ -171,9 +333,145 @@ class PlotterCommand(gdb.Command):
         args = gdb.string_to_argv(arg)
         var_name = str(args[0])
 
-        mem, width, height, channels, type, step, pixel_layout = get_buffer_metadata(var_name)
+        plot_buffer(var_name, get_buffer_metadata(var_name))
+        pass
+
+    pass
+
+##
+# Appends a buffer to the trace journal
+def trace_buffer(hit, variable, metadata):
+    buffer, width, height, channels, type, step, pixel_layout = metadata
+
+    pid = get_native_pid()
+    if pid != 0 and lib.trace_inferior_buffer(hit, pid, int(buffer), variable, width, height, channels, type, step, pixel_layout):
+        return
 
-        lib.plot_binary(mem, var_name, width, height, channels, type, step, pixel_layout)
+    bytes = get_buffer_size(width, height, channels, type, step)
+    mem = gdb.selected_inferior().read_memory(buffer, bytes)
+    lib.trace_binary(hit, mem, variable, width, height, channels, type, step, pixel_layout)
+    pass
+
+##
+# Breakpoint that journals buffers each time it is hit, and lets the inferior
+# carry on instead of stopping it
+class TraceBreakpoint(gdb.Breakpoint):
+    def __init__(self, location, variables):
+        super(TraceBreakpoint, self).__init__(location)
+        self.variables = variables
+        self.failed_variables = set()
+        pass
+
+    def stop(self):
+        global trace_hits
+        trace_hits += 1
+        for variable in self.variables:
+            try:
+                trace_buffer(trace_hits, variable, get_buffer_metadata(variable))
+            except Exception as err:
+                # Only warn once, as the breakpoint may be hit many times
+                if not variable in self.failed_variables:
+                    print('Warning: Could not trace buffer "' + variable + '"')
+                    self.failed_variables.add(variable)
+                pass
+            pass
+
+        return False
+
+    pass
+
+trace_breakpoints = []
+trace_journal_path = None
+# Hits of all the trace breakpoints of the journal, since the buffers captured
+# on the same hit form a frame. GDB only counts the hits that stop the
+# inferior, and per breakpoint.
+trace_hits = 0
+
+def stop_tracing():
+    global trace_breakpoints, trace_journal_path
+
+    for breakpoint in trace_breakpoints:
+        if breakpoint.is_valid():
+            breakpoint.delete()
+        pass
+    trace_breakpoints = []
+
+    if trace_journal_path is not None:
+        frames = lib.close_trace_journal()
+        if frames < 0:
+            print('Warning: Could not write the whole trace journal "' + trace_journal_path + '"')
+        else:
+            print('Trace journal "' + trace_journal_path + '": ' + str(frames) + ' frames')
+        trace_journal_path = None
+    pass
+
+class ReplayCommand(gdb.Command):
+    """Show the frames of a journal written by plot-trace.
+Usage: plot-replay FILE"""
+
+    def __init__(self):
+        super(ReplayCommand, self).__init__("plot-replay",
+                                            gdb.COMMAND_DATA,
+                                            gdb.COMPLETE_FILENAME)
+        pass
+
+    def invoke(self, arg, from_tty):
+        args = gdb.string_to_argv(arg)
+        if len(args) != 1:
+            raise gdb.GdbError('Usage: plot-replay FILE')
+
+        if not lib.is_running():
+            initialize_window()
+            while not lib.is_running():
+                time.sleep(0.1)
+                pass
+
+        lib.replay_journal(args[0].encode('utf-8'))
+        pass
+
+    pass
+
+class TraceCommand(gdb.Command):
+    """Journal buffers to a file each time a location is reached, without stopping.
+Usage: plot-trace [-o FILE] LOCATION VARIABLE...
+       plot-trace stop
+
+The journal is written to gdb-imagewatch.giwj unless another FILE is given.
+Several locations may be traced into the same journal. The journal is
+finished by "plot-trace stop", or when the inferior exits."""
+
+    def __init__(self):
+        super(TraceCommand, self).__init__("plot-trace",
+                                           gdb.COMMAND_BREAKPOINTS,
+                                           gdb.COMPLETE_LOCATION)
+        pass
+
+    def invoke(self, arg, from_tty):
+        global trace_journal_path, trace_hits
+        args = gdb.string_to_argv(arg)
+
+        if args == ['stop']:
+            stop_tracing()
+            return
+
+        path = 'gdb-imagewatch.giwj'
+        if len(args) >= 2 and args[0] == '-o':
+            path = args[1]
+            args = args[2:]
+            if trace_journal_path is not None and path != trace_journal_path:
+                raise gdb.GdbError('Already tracing into "' + trace_journal_path + '"; run "plot-trace stop" first')
+            pass
+        if len(args) < 2:
+            raise gdb.GdbError('Usage: plot-trace [-o FILE] LOCATION VARIABLE...')
+
+        if trace_journal_path is None:
+            if not lib.open_trace_journal(path.encode('utf-8')):
+                raise gdb.GdbError('Could not create trace journal "' + path + '"')
+            trace_journal_path = path
+            trace_hits = 0
+            pass
+
+        trace_breakpoints.append(TraceBreakpoint(args[0], args[1:]))
         pass
 
     pass
@@ -218,7 +516,11 @@ def push_visible_symbols():
         pass
 
     if lib.is_running():
-        lib.update_available_variables(observable_symbols)
+        # Only the buffers being displayed are read from the inferior
+        requested_symbols = lib.update_available_variables(list(observable_symbols.keys()))
+
+        plot_buffers([(name, observable_symbols[name]) for name in requested_symbols
+                      if name in observable_symbols])
 
     pass
 
@@ -233,9 +535,26 @@ def stop_event_handler(event):
     push_visible_symbols()
     pass
 
+# The memory of the inferior doesn't hold the contents of the stop anymore
+# once it resumes. The pages it writes to are tracked from the end of the
+# stop on, not from here: by the time this runs, it is already running.
+def cont_event_handler(event):
+    if lib.is_running():
+        lib.invalidate_inferior_memory()
+    pass
+
+# The index of the trace journal is written once the inferior is gone
+def exit_event_handler(event):
+    stop_tracing()
+    pass
+
 ##
 # Setup GDB interface
 PlotterCommand()
+TraceCommand()
+ReplayCommand()
 if not qtcreatorintegration.registerSymbolFetchHook(stop_event_handler):
     gdb.events.stop.connect(stop_event_handler)
+gdb.events.cont.connect(cont_event_handler)
+gdb.events.exited.connect(exit_event_handler)
 
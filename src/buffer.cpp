@@ -1,22 +1,54 @@
+#include <algorithm>
 #include <GL/glew.h>
 
 #include "buffer.hpp"
 #include "stage.hpp"
+#include "glcanvas.hpp"
+#include "texture_format.hpp"
+#include "tile_analysis.hpp"
 
 using namespace std;
 
 const float Buffer::no_ac_params[8] = {1.0, 1.0, 1.0, 1.0, 0, 0, 0, 0};
 
 Buffer::~Buffer() {
-    int num_textures = num_textures_x*num_textures_y;
-    glDeleteTextures(num_textures, buff_tex.data());
+    if(stats_job_ != nullptr) {
+        stats_job_->cancel();
+    }
+    release_gl_textures();
     glDeleteBuffers(1, &vbo);
 }
 
-bool Buffer::buffer_update() {
-    int num_textures = num_textures_x*num_textures_y;
-    glDeleteTextures(num_textures, buff_tex.data());
+void Buffer::release_gl_textures() {
+    // Pending uploads reference both our textures and our buffer memory
+    if(gl_canvas != nullptr) {
+        gl_canvas->texture_uploader().cancel(this);
+
+        if(virtual_texturing_) {
+            // Textures go back to the pool, so that an update with the same
+            // geometry can reuse them
+            for(GLuint texture: buff_tex) {
+                gl_canvas->texture_pool().release(texture);
+            }
+            for(GLuint texture: tile_pending_tex_) {
+                gl_canvas->texture_pool().release(texture);
+            }
+            gl_canvas->tile_cache().remove_owner(this);
+        } else {
+            // Shared textures only go back to the pool once no buffer
+            // shows them anymore
+            gl_canvas->tile_store().unbind_owner(this);
+        }
+    }
+    pending_tiles_ = 0;
 
+    buff_tex.clear();
+    buff_tex_ready.clear();
+    tile_base_level_.clear();
+    tile_pending_tex_.clear();
+}
+
+bool Buffer::buffer_update() {
     create_shader_program();
     setup_gl_buffer();
     return true;
@@ -59,77 +91,152 @@ void Buffer::getPixelInfo(stringstream& message, int x, int y) {
 }
 
 void Buffer::recomputeMinColorValues() {
-    int buffer_width_i = static_cast<int>(buffer_width_f);
-    int buffer_height_i = static_cast<int>(buffer_height_f);
-
     float *lowest = min_buffer_values();
-    for(int i = 0; i < 4; ++i)
-        lowest[i] = std::numeric_limits<float>::max();
-
-    for(int y = 0; y < buffer_height_i; ++y) {
-        for(int x = 0; x < buffer_width_i; ++x) {
-            int i = y*step + x;
-            for(int c = 0; c < channels; ++c) {
-                if(type == BufferType::Float32 ||
-                   type == BufferType::Float64)
-                    lowest[c] = std::min(lowest[c],
-                                         reinterpret_cast<float*>(buffer)[channels*i + c]);
-                else if(type == BufferType::UnsignedByte)
-                    lowest[c] = std::min(lowest[c],
-                                         static_cast<float>(buffer[channels*i + c]));
-                else if(type == BufferType::Short)
-                    lowest[c] = std::min(lowest[c],
-                                         static_cast<float>(reinterpret_cast<short*>(buffer)[channels*i + c]));
-                else if(type == BufferType::UnsignedShort)
-                    lowest[c] = std::min(lowest[c],
-                                         static_cast<float>(reinterpret_cast<unsigned short*>(buffer)[channels*i + c]));
-                else if(type == BufferType::Int32)
-                    lowest[c] = std::min(lowest[c],
-                                         static_cast<float>(reinterpret_cast<int*>(buffer)[channels*i + c]));
-            }
+    for(int c = 0; c < 4; ++c)
+        lowest[c] = 0.0;
+
+    // Until the statistics arrive, the full range of the type is displayed.
+    // Signed types are stored in normalized formats that reach as low as
+    // their maximum is high.
+    float minIntensity = 0.f;
+    if(type == BufferType::Short || type == BufferType::Int32) {
+        minIntensity = -TextureFormat::select(type, channels).max_intensity;
+    }
+    for(int c = 0; c < channels; ++c) {
+        if(!stats_valid_) {
+            lowest[c] = minIntensity;
+        } else if(low_percentile_ > 0.f) {
+            lowest[c] = stats_.percentile(c, low_percentile_ / 100.0);
+        } else {
+            lowest[c] = stats_.min[c];
         }
     }
-
-    // For single channel buffers: fill with 0
-    for(int c = channels; c < 4; ++c)
-        lowest[c] = 0.0;
 }
 
 void Buffer::recomputeMaxColorValues() {
-    int buffer_width_i = static_cast<int>(buffer_width_f);
-    int buffer_height_i = static_cast<int>(buffer_height_f);
-
     float *upper = max_buffer_values();
-    for(int i = 0; i < 4; ++i)
-        upper[i] = std::numeric_limits<float>::lowest();
-
-    for(int y = 0; y < buffer_height_i; ++y) {
-        for(int x = 0; x < buffer_width_i; ++x) {
-            int i = y*step + x;
-            for(int c = 0; c < channels; ++c) {
-                if(type == BufferType::Float32 ||
-                   type == BufferType::Float64)
-                    upper[c] = std::max(upper[c],
-                                        reinterpret_cast<float*>(buffer)[channels*i + c]);
-                else if(type == BufferType::UnsignedByte)
-                    upper[c] = std::max(upper[c],
-                                        static_cast<float>(buffer[channels*i + c]));
-                else if(type == BufferType::Short)
-                    upper[c] = std::max(upper[c],
-                                        static_cast<float>(reinterpret_cast<short*>(buffer)[channels*i + c]));
-                else if(type == BufferType::UnsignedShort)
-                    upper[c] = std::max(upper[c],
-                                        static_cast<float>(reinterpret_cast<unsigned short*>(buffer)[channels*i + c]));
-                else if(type == BufferType::Int32)
-                    upper[c] = std::max(upper[c],
-                                        static_cast<float>(reinterpret_cast<int*>(buffer)[channels*i + c]));
-            }
+    for(int c = 0; c < 4; ++c)
+        upper[c] = 0.0;
+
+    float maxIntensity = TextureFormat::select(type, channels).max_intensity;
+    for(int c = 0; c < channels; ++c) {
+        if(!stats_valid_) {
+            upper[c] = maxIntensity;
+        } else if(high_percentile_ < 100.f) {
+            upper[c] = stats_.percentile(c, high_percentile_ / 100.0);
+        } else {
+            upper[c] = stats_.max[c];
         }
     }
+}
+
+void Buffer::set_contrast_percentiles(float low, float high) {
+    if(low == low_percentile_ && high == high_percentile_) {
+        return;
+    }
+    low_percentile_ = low;
+    high_percentile_ = high;
 
-    // For single channel buffers: fill with 0
-    for(int c = channels; c < 4; ++c)
-        upper[c] = 0.0;
+    // The histograms are kept with the statistics, so the buffer doesn't
+    // need to be scanned again
+    resetContrastBrightnessParameters();
+}
+
+void Buffer::start_stats_computation() {
+    if(stats_job_ != nullptr) {
+        stats_job_->cancel();
+        stats_job_.reset();
+    }
+
+    // Tiles whose contents didn't change since their statistics were
+    // gathered aren't scanned again
+    StatsJob::TileStatsList previous;
+    vector<bool> reusable;
+    if(tile_stats_analysis_ != nullptr &&
+       tile_stats_analysis_->same_layout(*tile_analysis_)) {
+        previous = tile_stats_;
+        reusable.resize(tile_stats_.size());
+        for(size_t tile_id = 0; tile_id < reusable.size(); ++tile_id) {
+            reusable[tile_id] = tile_stats_analysis_->hashes[tile_id] ==
+                                tile_analysis_->hashes[tile_id];
+        }
+
+        // The statistics still describe the buffer if no tile changed
+        if(stats_valid_ &&
+           std::find(reusable.begin(), reusable.end(), false) == reusable.end()) {
+            tile_stats_analysis_ = tile_analysis_;
+            return;
+        }
+    }
+    stats_valid_ = false;
+    stats_job_analysis_ = tile_analysis_;
+
+    ThreadPool& pool = gl_canvas->thread_pool();
+    const size_t row_stride = static_cast<size_t>(step) * channels;
+    const int buffer_width_i = static_cast<int>(buffer_width_f);
+    const int buffer_height_i = static_cast<int>(buffer_height_f);
+
+    switch(type) {
+    case BufferType::UnsignedByte:
+        stats_job_ = StatsJob::start(pool, buffer, row_stride,
+                                     buffer_width_i, buffer_height_i, channels,
+                                     max_texture_size, previous, reusable);
+        break;
+    case BufferType::UnsignedShort:
+        stats_job_ = StatsJob::start(pool, reinterpret_cast<uint16_t*>(buffer),
+                                     row_stride, buffer_width_i,
+                                     buffer_height_i, channels,
+                                     max_texture_size, previous, reusable);
+        break;
+    case BufferType::Short:
+        stats_job_ = StatsJob::start(pool, reinterpret_cast<int16_t*>(buffer),
+                                     row_stride, buffer_width_i,
+                                     buffer_height_i, channels,
+                                     max_texture_size, previous, reusable);
+        break;
+    case BufferType::Int32:
+        stats_job_ = StatsJob::start(pool, reinterpret_cast<int32_t*>(buffer),
+                                     row_stride, buffer_width_i,
+                                     buffer_height_i, channels,
+                                     max_texture_size, previous, reusable);
+        break;
+    case BufferType::Float32:
+    case BufferType::Float64:
+        stats_job_ = StatsJob::start(pool, reinterpret_cast<float*>(buffer),
+                                     row_stride, buffer_width_i,
+                                     buffer_height_i, channels,
+                                     max_texture_size, previous, reusable);
+        break;
+    }
+}
+
+bool Buffer::poll_stats() {
+    if(stats_job_ == nullptr || !stats_job_->is_done()) {
+        return false;
+    }
+
+    stats_ = stats_job_->stats();
+    tile_stats_ = stats_job_->tile_stats();
+    tile_stats_analysis_ = stats_job_analysis_;
+    stats_job_.reset();
+    stats_job_analysis_.reset();
+    stats_valid_ = true;
+
+    resetContrastBrightnessParameters();
+
+    return true;
+}
+
+bool Buffer::stats_pending() const {
+    return stats_job_ != nullptr;
+}
+
+bool Buffer::has_stats() const {
+    return stats_valid_;
+}
+
+const BufferStats& Buffer::stats() const {
+    return stats_;
 }
 
 void Buffer::resetContrastBrightnessParameters() {
@@ -146,20 +253,11 @@ void Buffer::computeContrastBrightnessParameters() {
     float* auto_buffer_contrast = auto_buffer_contrast_brightness_;
     float* auto_buffer_brightness = auto_buffer_contrast_brightness_+4;
 
-    for(int c = 0; c < channels; ++c) {
-        float maxIntensity = 1.0f;
-        if(type == BufferType::UnsignedByte)
-            maxIntensity = 255.0f;
-        else if(type == BufferType::Short)// All non-real values have max color 255
-            maxIntensity = std::numeric_limits<short>::max();
-        else if(type == BufferType::UnsignedShort)
-            maxIntensity = std::numeric_limits<unsigned short>::max();
-        else if(type == BufferType::Int32)
-            maxIntensity = std::numeric_limits<int>::max();
-        else if(type == BufferType::Float32 ||
-                type == BufferType::Float64)
-            maxIntensity = 1.0f;
+    // Textures are sampled in normalized form, so the contrast parameters
+    // must take the normalization factor of the texture format into account
+    float maxIntensity = TextureFormat::select(type, channels).max_intensity;
 
+    for(int c = 0; c < channels; ++c) {
         float upp_minus_low = upper[c]-lowest[c];
 
         if(upp_minus_low == 0)
@@ -180,6 +278,22 @@ int Buffer::sub_texture_id_at_coord(int x, int y) {
     return buff_tex[ty*num_textures_x + tx];
 }
 
+bool Buffer::is_tile_ready_at_coord(int x, int y) {
+    int tx = x/max_texture_size;
+    int ty = y/max_texture_size;
+    int tex_id = ty*num_textures_x + tx;
+    // Value labels require the full resolution level
+    return buff_tex_ready[tex_id] && tile_base_level_[tex_id] == 0;
+}
+
+bool Buffer::has_pending_uploads() const {
+    return pending_tiles_ > 0;
+}
+
+int Buffer::tiles_generation() const {
+    return tiles_generation_;
+}
+
 void Buffer::set_pixel_layout(const string& pixel_layout) {
     ///
     // Make sure the provided pixel_layout is valid
@@ -262,7 +376,8 @@ void Buffer::create_shader_program() {
                      channelType,
                      pixel_layout_, { "mvp",
                                       "sampler", "brightness_contrast",
-                                      "buffer_dimension", "enable_borders"});
+                                      "buffer_dimension", "enable_borders",
+                                      "placeholder", "mip_level"});
 }
 
 bool Buffer::initialize() {
@@ -301,9 +416,40 @@ void Buffer::draw(const mat4& projection, const mat4& viewInv) {
         buff_prog.uniform4fv("brightness_contrast", 2, no_ac_params);
     }
 
+    // When zoomed out, each screen pixel covers 1/zoom buffer pixels. The
+    // matching pyramid level is sampled explicitly, so the reduction used
+    // to build it decides which values remain visible.
+    GameObject* cam_obj = game_object->stage->getGameObject("camera");
+    Camera* camera = cam_obj->getComponent<Camera>("camera_component");
+    int mip_level = static_cast<int>(std::floor(
+                        std::max(0.0f, std::log2(1.0f / camera->get_zoom()))));
+
+    // Buffer region seen by the camera, in buffer pixel coordinates
+    float visible_min_x = std::numeric_limits<float>::max();
+    float visible_min_y = std::numeric_limits<float>::max();
+    float visible_max_x = std::numeric_limits<float>::lowest();
+    float visible_max_y = std::numeric_limits<float>::lowest();
+    mat4 mvp_inv = mvp.inv();
+    const float ndc_corners[4][2] = {{-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+    for(const auto& corner: ndc_corners) {
+        vec4 corner_pos = mvp_inv * vec4(corner[0], corner[1], 0, 1);
+        float x = corner_pos.x() + buffer_width_f/2.f;
+        float y = corner_pos.y() + buffer_height_f/2.f;
+        visible_min_x = std::min(visible_min_x, x);
+        visible_min_y = std::min(visible_min_y, y);
+        visible_max_x = std::max(visible_max_x, x);
+        visible_max_y = std::max(visible_max_y, y);
+    }
+
     int buffer_width_i = static_cast<int>(buffer_width_f);
     int buffer_height_i = static_cast<int>(buffer_height_f);
 
+    visible_x0_ = std::max(0, static_cast<int>(std::floor(visible_min_x)));
+    visible_y0_ = std::max(0, static_cast<int>(std::floor(visible_min_y)));
+    visible_x1_ = std::min(buffer_width_i, static_cast<int>(std::ceil(visible_max_x)));
+    visible_y1_ = std::min(buffer_height_i, static_cast<int>(std::ceil(visible_max_y)));
+    visible_level_ = mip_level;
+
     int remaining_h = buffer_height_i;
 
     float py = -buffer_height_i/2;
@@ -331,7 +477,37 @@ void Buffer::draw(const mat4& projection, const mat4& viewInv) {
             int buff_w = std::min(remaining_w, max_texture_size);
             remaining_w -= buff_w;
 
-            glBindTexture(GL_TEXTURE_2D, buff_tex[ty*num_textures_x+tx]);
+            int tex_id = ty*num_textures_x+tx;
+
+            // Skip tiles outside of the camera frustum
+            int tile_x = tx*max_texture_size;
+            int tile_y = ty*max_texture_size;
+            if(tile_x > visible_max_x || tile_x + buff_w < visible_min_x ||
+               tile_y > visible_max_y || tile_y + buff_h < visible_min_y) {
+                px += buff_w;
+                continue;
+            }
+
+            if(virtual_texturing_) {
+                // Page in the tile at the level required by the current
+                // zoom, unless a finer version of it is already resident
+                int wanted_level = std::min(mip_level,
+                                            pyramid_levels(buff_w, buff_h) - 1);
+                if(tile_base_level_[tex_id] < 0 ||
+                   tile_base_level_[tex_id] > wanted_level) {
+                    request_tile(tex_id, wanted_level);
+                }
+                gl_canvas->tile_cache().touch(this, tex_id);
+            }
+
+            // Tiles still being streamed are drawn as placeholders
+            bool tile_ready = tile_base_level_[tex_id] >= 0 &&
+                              buff_tex_ready[tex_id];
+            glBindTexture(GL_TEXTURE_2D, tile_ready ? buff_tex[tex_id] : 0);
+            buff_prog.uniform1i("placeholder", tile_ready ? 0 : 1);
+            // Resident textures of virtual tiles may start at a coarser level
+            buff_prog.uniform1f("mip_level",
+                                std::max(0, mip_level - tile_base_level_[tex_id]));
 
             mat4 tile_model;
 
@@ -369,6 +545,157 @@ const float *Buffer::auto_buffer_contrast_brightness() const {
     return auto_buffer_contrast_brightness_;
 }
 
+void Buffer::tile_geometry(int tile_id, int& x, int& y, int& w, int& h) {
+    int buffer_width_i = static_cast<int>(buffer_width_f);
+    int buffer_height_i = static_cast<int>(buffer_height_f);
+
+    x = (tile_id % num_textures_x) * max_texture_size;
+    y = (tile_id / num_textures_x) * max_texture_size;
+    w = std::min(buffer_width_i - x, max_texture_size);
+    h = std::min(buffer_height_i - y, max_texture_size);
+}
+
+void Buffer::set_pyramid_reduction(PyramidReduction reduction) {
+    if(reduction == pyramid_reduction_) {
+        return;
+    }
+    pyramid_reduction_ = reduction;
+
+    // Only the pyramids depend on the reduction, so the statistics and the
+    // contrast set by the user are kept. Every tile is bound again with its
+    // new pyramid.
+    gl_canvas->texture_uploader().cancel(this);
+    pending_tiles_ = 0;
+    ++tiles_generation_;
+
+    ThreadPool& pool = gl_canvas->thread_pool();
+    tile_analysis_ = TileAnalysis::analyze(buffer,
+                                           static_cast<int>(buffer_width_f),
+                                           static_cast<int>(buffer_height_f),
+                                           channels, type, step,
+                                           max_texture_size,
+                                           pyramid_reduction_,
+                                           nullptr,
+                                           &pool,
+                                           pool.size() + 1,
+                                           ContentVersion(),
+                                           &gl_canvas->tile_store());
+    bind_tiles(vector<bool>(buff_tex.size(), true));
+}
+
+PyramidReduction Buffer::pyramid_reduction() const {
+    return pyramid_reduction_;
+}
+
+shared_ptr<const TileAnalysis> Buffer::tile_analysis() const {
+    return tile_analysis_;
+}
+
+void Buffer::set_prepared_tile_analysis(shared_ptr<const TileAnalysis> analysis) {
+    prepared_tile_analysis_ = analysis;
+}
+
+void Buffer::request_tile(int tile_id, int level) {
+    if(tile_pending_tex_[tile_id] != 0) {
+        // The tile is already being paged in
+        return;
+    }
+
+    int tile_x, tile_y, tile_w, tile_h;
+    tile_geometry(tile_id, tile_x, tile_y, tile_w, tile_h);
+
+    TextureFormat tex_format = TextureFormat::select(type, channels);
+    const int row_stride = step * tex_format.bytes_per_texel;
+    const int num_levels = pyramid_levels(tile_w, tile_h) - level;
+    const int level_w = std::max(1, tile_w >> level);
+    const int level_h = std::max(1, tile_h >> level);
+
+    GLuint texture = gl_canvas->texture_pool().acquire(tex_format,
+                                                       level_w, level_h,
+                                                       num_levels);
+    tile_pending_tex_[tile_id] = texture;
+    ++pending_tiles_;
+
+    // Texture level i holds pyramid level (level + i)
+    const TilePyramid& pyramid = *tile_analysis_->pyramids[tile_id];
+    for(int tex_level = num_levels - 1; tex_level >= 0; --tex_level) {
+        int pyramid_level = level + tex_level;
+        function<void()> on_complete;
+
+        if(tex_level == 0) {
+            size_t tile_bytes = static_cast<size_t>(level_w) * level_h *
+                                tex_format.bytes_per_texel;
+            on_complete = [this, tile_id, level, tile_bytes]() {
+                // Replace the previous, coarser version of the tile
+                if(buff_tex[tile_id] != 0) {
+                    gl_canvas->texture_pool().release(buff_tex[tile_id]);
+                }
+                buff_tex[tile_id] = tile_pending_tex_[tile_id];
+                tile_pending_tex_[tile_id] = 0;
+                tile_base_level_[tile_id] = level;
+                buff_tex_ready[tile_id] = true;
+                --pending_tiles_;
+                ++tiles_generation_;
+
+                gl_canvas->tile_cache().insert(this, tile_id,
+                                               tile_bytes + tile_bytes/3,
+                                               [this, tile_id]() {
+                                                   evict_tile(tile_id);
+                                               });
+            };
+        }
+
+        if(pyramid_level == 0) {
+            const uint8_t* tile_src = buffer +
+                    static_cast<size_t>(tile_y) * row_stride +
+                    static_cast<size_t>(tile_x) * tex_format.bytes_per_texel;
+            gl_canvas->texture_uploader().enqueue(this, texture, tex_format,
+                                                  tile_src, row_stride,
+                                                  tile_w, tile_h, tex_level,
+                                                  on_complete);
+        } else {
+            const int idx = pyramid_level - 1;
+            gl_canvas->texture_uploader().enqueue(this, texture, tex_format,
+                                                  pyramid.levels[idx].data(),
+                                                  pyramid.widths[idx] *
+                                                  tex_format.bytes_per_texel,
+                                                  pyramid.widths[idx],
+                                                  pyramid.heights[idx],
+                                                  tex_level, on_complete);
+        }
+    }
+}
+
+void Buffer::evict_tile(int tile_id) {
+    gl_canvas->texture_pool().release(buff_tex[tile_id]);
+    buff_tex[tile_id] = 0;
+    buff_tex_ready[tile_id] = false;
+    tile_base_level_[tile_id] = -1;
+    ++tiles_generation_;
+}
+
+bool Buffer::is_virtual() const {
+    return virtual_texturing_;
+}
+
+size_t Buffer::gpu_bytes() const {
+    if(virtual_texturing_ || buff_tex.empty()) {
+        return 0;
+    }
+
+    size_t base_bytes = static_cast<size_t>(tiles_width_) * tiles_height_ *
+                        TextureFormat::select(type, channels).bytes_per_texel;
+    return base_bytes + base_bytes / 3;
+}
+
+void Buffer::visible_region(int& x0, int& y0, int& x1, int& y1, int& level) const {
+    x0 = visible_x0_;
+    y0 = visible_y0_;
+    x1 = visible_x1_;
+    y1 = visible_y1_;
+    level = visible_level_;
+}
+
 void Buffer::setup_gl_buffer() {
     int buffer_width_i = static_cast<int>(buffer_width_f);
     int buffer_height_i = static_cast<int>(buffer_height_f);
@@ -379,77 +706,143 @@ void Buffer::setup_gl_buffer() {
                           0.0f};
     game_object->position = {0.f, 0.f, 0.f, 1.f};
 
-    // Initialize contrast parameters
-    resetContrastBrightnessParameters();
-
     // Buffer texture
     num_textures_x = ceil(((float)buffer_width_i)/((float)max_texture_size));
     num_textures_y = ceil(((float)buffer_height_i)/((float)max_texture_size));
     int num_textures = num_textures_x*num_textures_y;
 
-    buff_tex.resize(num_textures);
-    glGenTextures(num_textures, buff_tex.data());
-
-    GLuint tex_type = GL_UNSIGNED_BYTE;
-    GLuint tex_format = GL_RED;
-
-    if(type == BufferType::Float32 ||
-       type == BufferType::Float64) {
-        tex_type = GL_FLOAT;
-    } else if (type == BufferType::UnsignedByte) {
-        tex_type = GL_UNSIGNED_BYTE;
-    } else if (type == BufferType::Short) {
-        tex_type = GL_SHORT;
-    } else if (type == BufferType::UnsignedShort) {
-        tex_type = GL_UNSIGNED_SHORT;
-    } else if (type == BufferType::Int32) {
-        tex_type = GL_INT;
+    TextureFormat tex_format = TextureFormat::select(type, channels);
+
+    TextureUploader& uploader = gl_canvas->texture_uploader();
+
+    // Uploads that are still pending reference the previous buffer memory
+    uploader.cancel(this);
+    shared_ptr<const TileAnalysis> previous_analysis = tile_analysis_;
+    pending_tiles_ = 0;
+    ++tiles_generation_;
+
+    // Buffers that would take a large share of the GPU memory budget are
+    // displayed with virtual texturing: only tiles seen by the camera are
+    // paged in, at the pyramid level required by the zoom
+    size_t texture_bytes = static_cast<size_t>(buffer_width_i) *
+                           buffer_height_i * tex_format.bytes_per_texel;
+    bool use_virtual_texturing = texture_bytes + texture_bytes/3 >
+                                 gl_canvas->tile_cache().budget()/2;
+
+    // If the tile layout didn't change, the current textures are kept and
+    // only the tiles whose contents changed are uploaded again
+    bool same_layout = !buff_tex.empty() &&
+                       static_cast<int>(buff_tex.size()) == num_textures &&
+                       tiles_width_ == buffer_width_i &&
+                       tiles_height_ == buffer_height_i &&
+                       tiles_internal_format_ == tex_format.internal_format &&
+                       virtual_texturing_ == use_virtual_texturing;
+
+    if(!same_layout) {
+        release_gl_textures();
+        buff_tex.assign(num_textures, 0);
+        buff_tex_ready.assign(num_textures, false);
+        tile_pending_tex_.assign(num_textures, 0);
+        virtual_texturing_ = use_virtual_texturing;
+
+        // Textures of regular tiles are bound below
+        tile_base_level_.assign(num_textures, virtual_texturing_ ? -1 : 0);
+
+        tiles_width_ = buffer_width_i;
+        tiles_height_ = buffer_height_i;
+        tiles_internal_format_ = tex_format.internal_format;
     }
 
-    if(channels == 1) {
-        tex_format = GL_RED;
-    } else if(channels == 2) {
-        tex_format = GL_RG;
-    } else if(channels == 3) {
-        tex_format = GL_RGB;
-    } else if(channels == 4) {
-        tex_format = GL_RGBA;
+    // Tiles analyzed in the background are used if they describe the new
+    // contents. Tiles that didn't change keep their pyramid either way.
+    shared_ptr<const TileAnalysis> analysis = prepared_tile_analysis_;
+    prepared_tile_analysis_.reset();
+    if(analysis == nullptr ||
+       !analysis->describes(buffer_width_i, buffer_height_i, channels, type,
+                            max_texture_size, pyramid_reduction_)) {
+        ThreadPool& pool = gl_canvas->thread_pool();
+        analysis = TileAnalysis::analyze(buffer, buffer_width_i,
+                                         buffer_height_i, channels, type,
+                                         step, max_texture_size,
+                                         pyramid_reduction_,
+                                         previous_analysis,
+                                         &pool,
+                                         pool.size() + 1,
+                                         ContentVersion(),
+                                         &gl_canvas->tile_store());
     }
 
-    int remaining_h = buffer_height_i;
-    glPixelStoref(GL_UNPACK_ALIGNMENT, 1);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, step);
-
-    for(int ty = 0; ty < num_textures_y; ++ty) {
-        int buff_h = std::min(remaining_h, max_texture_size);
-        remaining_h -= buff_h;
-
-        int remaining_w = buffer_width_i;
-        for(int tx = 0; tx < num_textures_x; ++tx) {
-            int buff_w = std::min(remaining_w, max_texture_size);
-            remaining_w -= buff_w;
-
-            int tex_id = ty*num_textures_x + tx;
-            glBindTexture(GL_TEXTURE_2D, buff_tex[tex_id]);
+    vector<bool> dirty_tiles(num_textures, true);
+    if(same_layout && previous_analysis != nullptr &&
+       previous_analysis->same_tiles(*analysis)) {
+        for(int tex_id = 0; tex_id < num_textures; ++tex_id) {
+            dirty_tiles[tex_id] = analysis->hashes[tex_id] !=
+                                  previous_analysis->hashes[tex_id];
+        }
+    }
+    tile_analysis_ = analysis;
 
-            glPixelStorei(GL_UNPACK_SKIP_ROWS, ty*max_texture_size);
-            glPixelStorei(GL_UNPACK_SKIP_PIXELS, tx*max_texture_size);
-            glTexStorage2D( GL_TEXTURE_2D, 1, GL_RGBA32F, buff_w, buff_h);
+    // Statistics are computed in the background, from the tiles that
+    // changed. Until they are available, contrast parameters are initialized
+    // from the range of the buffer type.
+    start_stats_computation();
+    resetContrastBrightnessParameters();
 
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-                            buff_w, buff_h, tex_format, tex_type,
-                            reinterpret_cast<GLvoid*>(buffer));
+    bind_tiles(dirty_tiles);
+}
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+void Buffer::bind_tiles(const vector<bool>& dirty_tiles) {
+    const int num_textures = static_cast<int>(buff_tex.size());
+    TextureFormat tex_format = TextureFormat::select(type, channels);
+    TexturePool& pool = gl_canvas->texture_pool();
+    const int row_stride = step * tex_format.bytes_per_texel;
+
+    if(virtual_texturing_) {
+        for(int tex_id = 0; tex_id < num_textures; ++tex_id) {
+            // Requests interrupted by the cancellation of the uploads are
+            // dropped
+            if(tile_pending_tex_[tex_id] != 0) {
+                pool.release(tile_pending_tex_[tex_id]);
+                tile_pending_tex_[tex_id] = 0;
+            }
+            // Modified tiles are paged in again when they become visible
+            if(dirty_tiles[tex_id] && tile_base_level_[tex_id] >= 0) {
+                gl_canvas->tile_cache().remove(this, tex_id);
+                evict_tile(tex_id);
+            }
         }
+        return;
     }
 
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    // Every tile is bound, even if it didn't change, since uploads still
+    // in progress must read from the new buffer memory
+    TileStore& store = gl_canvas->tile_store();
+    for(int tex_id = 0; tex_id < num_textures; ++tex_id) {
+        int tile_x, tile_y, buff_w, buff_h;
+        tile_geometry(tex_id, tile_x, tile_y, buff_w, buff_h);
+
+        // Contents that any buffer already has on the GPU are not uploaded
+        // again. Others are streamed by the uploader across frames; until
+        // then, tiles that were already uploaded keep showing their
+        // previous contents.
+        const uint8_t* tile_src = buffer +
+                static_cast<size_t>(tile_y) * row_stride +
+                static_cast<size_t>(tile_x) * tex_format.bytes_per_texel;
+        GLuint texture = store.bind(this, tex_id,
+                                    tile_analysis_->tile_key(tex_id),
+                                    tile_src, row_stride,
+                                    tile_analysis_->pyramids[tex_id],
+                                    [this, tex_id](GLuint texture) {
+                                        buff_tex[tex_id] = texture;
+                                        buff_tex_ready[tex_id] = true;
+                                        --pending_tiles_;
+                                        ++tiles_generation_;
+                                    });
+        if(texture != 0) {
+            buff_tex[tex_id] = texture;
+            buff_tex_ready[tex_id] = true;
+        } else {
+            ++pending_tiles_;
+        }
+    }
 }
@@ -4,13 +4,19 @@
 #include <sstream>
 #include "shader.hpp"
 #include "component.hpp"
+#include "pyramid.hpp"
+#include "stats_engine.hpp"
 
 using namespace std;
+struct TileAnalysis;
+
 class Buffer : public Component {
 public:
-    int max_texture_size = 2048;
+    static const int default_max_texture_size = 2048;
+    int max_texture_size = default_max_texture_size;
 
     std::vector<GLuint> buff_tex;
+    std::vector<bool> buff_tex_ready;
     static const float no_ac_params[8];
 
     enum class BufferType {
@@ -43,6 +49,28 @@ public:
 
     int sub_texture_id_at_coord(int x, int y);
 
+    bool is_tile_ready_at_coord(int x, int y);
+
+    bool has_pending_uploads() const;
+
+    // Changes whenever the buffer contents or the set of ready tiles change
+    int tiles_generation() const;
+
+    // Collects the statistics computed in the background. Returns true if
+    // they just became available, in which case the contrast parameters are
+    // reset from them.
+    bool poll_stats();
+
+    bool stats_pending() const;
+
+    bool has_stats() const;
+
+    const BufferStats& stats() const;
+
+    // Auto contrast maps these percentiles of each channel, in the [0, 100]
+    // range, to the extremes of the display range
+    void set_contrast_percentiles(float low, float high);
+
     void set_pixel_layout(const std::string& pixel_layout);
 
     const char* get_pixel_layout() const;
@@ -69,9 +97,40 @@ public:
     void set_max_buffer_values();
 
     void getPixelInfo(stringstream& output, int x, int y);
+
+    void set_pyramid_reduction(PyramidReduction reduction);
+
+    PyramidReduction pyramid_reduction() const;
+
+    // Analysis of the current contents, which lets the next one reuse the
+    // tiles that didn't change
+    std::shared_ptr<const TileAnalysis> tile_analysis() const;
+
+    // Hands over an analysis of the next contents, prepared in the
+    // background. It is used by the next update if it matches the buffer;
+    // otherwise the tiles are analyzed on the spot.
+    void set_prepared_tile_analysis(std::shared_ptr<const TileAnalysis> analysis);
+
+    bool is_virtual() const;
+
+    // Memory taken by the tile textures, including their mip levels. Virtual
+    // textures are accounted for by the TileCache, so they don't count.
+    size_t gpu_bytes() const;
+
+    // Region seen by the camera when the buffer was last drawn, clamped to
+    // the buffer, and the pyramid level matching the zoom
+    void visible_region(int& x0, int& y0, int& x1, int& y1, int& level) const;
 private:
     void create_shader_program();
     void setup_gl_buffer();
+    // Binds the tiles of tile_analysis_ to their textures, or pages out the
+    // virtual tiles that changed so that they are requested again
+    void bind_tiles(const std::vector<bool>& dirty_tiles);
+    void release_gl_textures();
+    void tile_geometry(int tile_id, int& x, int& y, int& w, int& h);
+    void start_stats_computation();
+    void request_tile(int tile_id, int level);
+    void evict_tile(int tile_id);
 
     float min_buffer_values_[4];
     float max_buffer_values_[4];
@@ -80,5 +139,42 @@ private:
 
     ShaderProgram buff_prog;
     GLuint vbo;
+    int pending_tiles_ = 0;
+    int tiles_generation_ = 0;
+
+    // Layout of the current tile textures
+    int tiles_width_ = 0;
+    int tiles_height_ = 0;
+    GLenum tiles_internal_format_ = 0;
+
+    std::shared_ptr<StatsJob> stats_job_;
+    std::shared_ptr<const TileAnalysis> stats_job_analysis_;
+    BufferStats stats_;
+    bool stats_valid_ = false;
+    // Statistics of each tile, and the analysis of the contents they
+    // describe, so that the tiles that didn't change aren't scanned again
+    StatsJob::TileStatsList tile_stats_;
+    std::shared_ptr<const TileAnalysis> tile_stats_analysis_;
+    float low_percentile_ = 0.f;
+    float high_percentile_ = 100.f;
+
+    // Hashes and reduced resolution levels of each tile, the latter being
+    // uploaded as mip levels
+    std::shared_ptr<const TileAnalysis> tile_analysis_;
+    std::shared_ptr<const TileAnalysis> prepared_tile_analysis_;
+    PyramidReduction pyramid_reduction_ = PyramidReduction::Average;
+
+    // Virtual texturing state. Each tile texture holds the pyramid levels
+    // starting at tile_base_level_ (-1 if the tile is not resident), and
+    // tile_pending_tex_ holds textures still being paged in.
+    bool virtual_texturing_ = false;
+    std::vector<int> tile_base_level_;
+    std::vector<GLuint> tile_pending_tex_;
+
+    int visible_x0_ = 0;
+    int visible_y0_ = 0;
+    int visible_x1_ = 0;
+    int visible_y1_ = 0;
+    int visible_level_ = 0;
 };
 
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cstring>
+
+#include "buffer_history.hpp"
+#include "lz_codec.hpp"
+#include "texture_format.hpp"
+
+using namespace std;
+
+namespace {
+
+// dst ^= src
+void xor_bytes(uint8_t* dst, const uint8_t* src, size_t size) {
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for(; i < size; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+} // namespace
+
+BufferHistory::BufferHistory(Delivery deliver, function<void()> on_recorded)
+    : deliver_(deliver), on_recorded_(on_recorded) {
+    worker_ = thread(&BufferHistory::history_loop, this);
+}
+
+BufferHistory::~BufferHistory() {
+    {
+        unique_lock<mutex> lock(mtx_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void BufferHistory::set_budget(size_t bytes) {
+    unique_lock<mutex> lock(mtx_);
+    budget_ = bytes;
+}
+
+size_t BufferHistory::stored_bytes() {
+    unique_lock<mutex> lock(mtx_);
+    return stored_bytes_;
+}
+
+void BufferHistory::record(const BufferRequestMessage& request) {
+    {
+        unique_lock<mutex> lock(mtx_);
+        pending_records_.push_back(request);
+    }
+    cv_.notify_all();
+}
+
+vector<uint64_t> BufferHistory::version_ids(const string& var_name) {
+    unique_lock<mutex> lock(mtx_);
+    vector<uint64_t> ids;
+    auto track = tracks_.find(var_name);
+    if(track != tracks_.end()) {
+        for(const Version& version: track->second.versions) {
+            ids.push_back(version.sequence);
+        }
+    }
+    return ids;
+}
+
+void BufferHistory::request_version(const string& var_name,
+                                    uint64_t version_id) {
+    {
+        unique_lock<mutex> lock(mtx_);
+        decode_pending_ = true;
+        decode_var_ = var_name;
+        decode_version_id_ = version_id;
+    }
+    cv_.notify_all();
+}
+
+void BufferHistory::forget(const string& var_name) {
+    {
+        unique_lock<mutex> lock(mtx_);
+        pending_forgets_.push_back(var_name);
+    }
+    cv_.notify_all();
+}
+
+void BufferHistory::release_contents(const string& var_name) {
+    {
+        unique_lock<mutex> lock(mtx_);
+        pending_releases_.push_back(var_name);
+    }
+    cv_.notify_all();
+}
+
+void BufferHistory::history_loop() {
+    unique_lock<mutex> lock(mtx_);
+
+    while(true) {
+        cv_.wait(lock, [this]() {
+            return stopping_ || !pending_forgets_.empty() ||
+                   !pending_releases_.empty() ||
+                   !pending_records_.empty() || decode_pending_;
+        });
+        if(stopping_) {
+            return;
+        }
+
+        if(!pending_forgets_.empty()) {
+            // Releasing a Python buffer takes the GIL, which must not
+            // happen with the lock held
+            vector<Track> forgotten;
+            for(const string& var_name: pending_forgets_) {
+                auto track = tracks_.find(var_name);
+                if(track == tracks_.end()) {
+                    continue;
+                }
+                for(const Version& version: track->second.versions) {
+                    stored_bytes_ -= version.data.size();
+                }
+                forgotten.push_back(std::move(track->second));
+                tracks_.erase(track);
+            }
+            pending_forgets_.clear();
+
+            lock.unlock();
+            forgotten.clear();
+            lock.lock();
+        } else if(!pending_releases_.empty()) {
+            vector<BufferRequestMessage> released;
+            for(const string& var_name: pending_releases_) {
+                auto track = tracks_.find(var_name);
+                if(track != tracks_.end()) {
+                    released.push_back(std::move(track->second.latest));
+                    track->second.latest = BufferRequestMessage();
+                }
+            }
+            pending_releases_.clear();
+
+            lock.unlock();
+            released.clear();
+            lock.lock();
+        } else if(!pending_records_.empty()) {
+            BufferRequestMessage request = std::move(pending_records_.front());
+            pending_records_.pop_front();
+
+            lock.unlock();
+            store(request);
+            on_recorded_();
+            lock.lock();
+        } else {
+            string var_name = decode_var_;
+            uint64_t version_id = decode_version_id_;
+            decode_pending_ = false;
+
+            lock.unlock();
+            decode(var_name, version_id);
+            lock.lock();
+        }
+    }
+}
+
+void BufferHistory::store(const BufferRequestMessage& request) {
+    Track* track;
+    {
+        unique_lock<mutex> lock(mtx_);
+        track = &tracks_[request.var_name_str];
+    }
+
+    const size_t bytes_per_texel = TextureFormat::select(request.type,
+                                                         request.channels).bytes_per_texel;
+    const size_t row_bytes = static_cast<size_t>(request.width_i) * bytes_per_texel;
+    const size_t src_row_bytes = static_cast<size_t>(request.step) * bytes_per_texel;
+    const size_t size = row_bytes * request.height_i;
+
+    // A version depends on the one before it, which must have the same
+    // layout, and on no more than keyframe_interval - 1 others
+    bool keyframe = track->versions.empty() ||
+                    track->latest.buffer_owner == nullptr;
+    if(!keyframe) {
+        const Version& previous = track->versions.back();
+        keyframe = previous.width != request.width_i ||
+                   previous.height != request.height_i ||
+                   previous.channels != request.channels ||
+                   previous.type != request.type;
+
+        int since_keyframe = 0;
+        for(auto version = track->versions.rbegin();
+            !version->keyframe; ++version) {
+            ++since_keyframe;
+        }
+        keyframe = keyframe || since_keyframe + 1 >= keyframe_interval;
+    }
+
+    const BufferRequestMessage& latest = track->latest;
+    const size_t latest_row_bytes = static_cast<size_t>(latest.step) * bytes_per_texel;
+    scratch_.resize(size);
+    for(int y = 0; y < request.height_i; ++y) {
+        uint8_t* dst = scratch_.data() + y * row_bytes;
+        memcpy(dst, request.buffer + y * src_row_bytes, row_bytes);
+        if(!keyframe) {
+            xor_bytes(dst, latest.buffer + y * latest_row_bytes, row_bytes);
+        }
+    }
+    lz_compress(scratch_.data(), size, compressed_);
+
+    Version version;
+    version.width = request.width_i;
+    version.height = request.height_i;
+    version.channels = request.channels;
+    version.type = request.type;
+    version.pixel_layout = request.pixel_layout;
+    version.keyframe = keyframe;
+    version.data.assign(compressed_.begin(), compressed_.end());
+
+    BufferRequestMessage stale_latest;
+    {
+        unique_lock<mutex> lock(mtx_);
+        version.sequence = next_sequence_++;
+        stored_bytes_ += version.data.size();
+        track->versions.push_back(std::move(version));
+        stale_latest = std::move(track->latest);
+        track->latest = request;
+        drop_over_budget();
+    }
+}
+
+void BufferHistory::decode(const string& var_name, uint64_t version_id) {
+    auto found = tracks_.find(var_name);
+    if(found == tracks_.end()) {
+        return;
+    }
+    Track& track = found->second;
+
+    // Versions are kept in the order they were recorded
+    auto version = lower_bound(track.versions.begin(), track.versions.end(),
+                               version_id,
+                               [](const Version& version, uint64_t id) {
+                                   return version.sequence < id;
+                               });
+    if(version == track.versions.end() || version->sequence != version_id) {
+        return;
+    }
+    const int index = static_cast<int>(version - track.versions.begin());
+
+    const Version& target = track.versions[index];
+    const size_t bytes_per_texel = TextureFormat::select(target.type,
+                                                         target.channels).bytes_per_texel;
+    const size_t size = static_cast<size_t>(target.width) *
+                        target.height * bytes_per_texel;
+
+    int keyframe = index;
+    while(!track.versions[keyframe].keyframe) {
+        --keyframe;
+    }
+
+    bool ok = true;
+    auto apply_delta = [&](int i) {
+        const vector<uint8_t>& data = track.versions[i].data;
+        scratch_.resize(size);
+        ok = ok && lz_decompress(data.data(), data.size(), scratch_.data(), size);
+        if(ok) {
+            xor_bytes(track.decoded.data(), scratch_.data(), size);
+        }
+    };
+
+    // Deltas go both ways, so the last decoded version is a starting point
+    // as long as no keyframe lies in between
+    const int from = track.decoded_index;
+    bool backward = from > index;
+    for(int i = index + 1; backward && i <= from; ++i) {
+        backward = !track.versions[i].keyframe;
+    }
+
+    if(from >= keyframe && from <= index) {
+        for(int i = from + 1; i <= index; ++i) {
+            apply_delta(i);
+        }
+    } else if(backward) {
+        for(int i = from; i > index; --i) {
+            apply_delta(i);
+        }
+    } else {
+        const vector<uint8_t>& data = track.versions[keyframe].data;
+        track.decoded.resize(size);
+        ok = lz_decompress(data.data(), data.size(), track.decoded.data(), size);
+        for(int i = keyframe + 1; i <= index; ++i) {
+            apply_delta(i);
+        }
+    }
+
+    if(!ok) {
+        track.decoded_index = -1;
+        return;
+    }
+    track.decoded_index = index;
+
+    // The decoded version keeps changing as the user scrubs through the
+    // history, so a copy of it is displayed
+    shared_ptr<uint8_t> pixels(new uint8_t[size], [](uint8_t* pixels) {
+        delete[] pixels;
+    });
+    memcpy(pixels.get(), track.decoded.data(), size);
+
+    BufferRequestMessage request;
+    request.var_name_str = var_name;
+    request.buffer_owner = pixels;
+    request.buffer = pixels.get();
+    request.width_i = target.width;
+    request.height_i = target.height;
+    request.channels = target.channels;
+    request.type = target.type;
+    request.step = target.width;
+    request.pixel_layout = target.pixel_layout;
+    request.from_history = true;
+    deliver_(request);
+}
+
+void BufferHistory::drop_over_budget() {
+    while(stored_bytes_ > budget_) {
+        Track* oldest = nullptr;
+        for(auto& track: tracks_) {
+            if(!track.second.versions.empty() &&
+               (oldest == nullptr ||
+                track.second.versions.front().sequence <
+                oldest->versions.front().sequence)) {
+                oldest = &track.second;
+            }
+        }
+        if(oldest == nullptr) {
+            break;
+        }
+
+        int dropped = 0;
+        do {
+            stored_bytes_ -= oldest->versions.front().data.size();
+            oldest->versions.pop_front();
+            ++dropped;
+        } while(!oldest->versions.empty() && !oldest->versions.front().keyframe);
+
+        oldest->decoded_index = std::max(-1, oldest->decoded_index - dropped);
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ingest_pipeline.hpp"
+
+/*
+ * Earlier contents of the plotted buffers, so that they can be looked at
+ * again without running the inferior anew. Each variable has a list of
+ * versions. A version is stored as the XOR of its pixels with those of the
+ * version before it, compressed with lz_compress, so the pixels that didn't
+ * change take almost no space; every keyframe_interval-th version, and each
+ * one whose layout changed, is stored whole instead, which bounds the work
+ * needed to decode any of them. When the versions of all the variables
+ * exceed the memory budget, the oldest ones are dropped, a keyframe and the
+ * versions that depend on it at a time.
+ *
+ * Versions are compressed and decoded by a thread of their own, in the
+ * order they were requested.
+ */
+class BufferHistory {
+public:
+    typedef std::function<void(const BufferRequestMessage&)> Delivery;
+
+    static constexpr size_t default_budget = 256 * 1024 * 1024;
+    static const int keyframe_interval = 8;
+
+    // Decoded versions are given to deliver, and on_recorded is called
+    // whenever a version was stored; both are called from the history
+    // thread
+    BufferHistory(Delivery deliver, std::function<void()> on_recorded);
+
+    ~BufferHistory();
+
+    // Applies from the next version recorded
+    void set_budget(size_t bytes);
+
+    size_t stored_bytes();
+
+    // Queues the contents of a prepared buffer as the newest version of its
+    // variable. The pixels are referenced, not copied, so they must not
+    // change afterwards.
+    void record(const BufferRequestMessage& request);
+
+    // Ids of the versions kept for a variable, oldest first. Old versions
+    // may be dropped at any time, so versions are addressed by id rather
+    // than by position.
+    std::vector<uint64_t> version_ids(const std::string& var_name);
+
+    // Queues the decoding of a version. Only the last version requested is
+    // decoded if the thread is busy, and nothing is if it was dropped in the
+    // meantime.
+    void request_version(const std::string& var_name, uint64_t version_id);
+
+    void forget(const std::string& var_name);
+
+    // Lets go of the newest contents of a variable, which are otherwise kept
+    // to compute the next delta from. Its next version is then stored
+    // whole.
+    void release_contents(const std::string& var_name);
+
+private:
+    struct Version {
+        int width;
+        int height;
+        int channels;
+        Buffer::BufferType type;
+        std::string pixel_layout;
+        bool keyframe;
+        // Order in which the versions of all variables were recorded, which
+        // also identifies them
+        uint64_t sequence;
+        std::vector<uint8_t> data;
+    };
+
+    struct Track {
+        std::deque<Version> versions;
+        // Contents of the newest version, to compute the next delta from
+        BufferRequestMessage latest;
+        // Last version decoded, which is where the next decoding starts
+        // from if it is close enough
+        int decoded_index = -1;
+        std::vector<uint8_t> decoded;
+    };
+
+    Delivery deliver_;
+    std::function<void()> on_recorded_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<BufferRequestMessage> pending_records_;
+    std::vector<std::string> pending_forgets_;
+    std::vector<std::string> pending_releases_;
+    bool decode_pending_ = false;
+    std::string decode_var_;
+    uint64_t decode_version_id_ = 0;
+    bool stopping_ = false;
+
+    // Only changed by the history thread, with mtx_ held, so that other
+    // threads may read it with mtx_ held
+    std::map<std::string, Track> tracks_;
+    size_t budget_ = default_budget;
+    size_t stored_bytes_ = 0;
+    uint64_t next_sequence_ = 0;
+
+    std::vector<uint8_t> scratch_;
+    std::vector<uint8_t> compressed_;
+
+    std::thread worker_;
+
+    void history_loop();
+
+    void store(const BufferRequestMessage& request);
+
+    void decode(const std::string& var_name, uint64_t version_id);
+
+    // Called with mtx_ held
+    void drop_over_budget();
+};
@@ -1,10 +1,14 @@
 #include <GL/glew.h>
 
 #include "buffer_values.hpp"
+#include "glcanvas.hpp"
 #include "stage.hpp"
+#include "texture_format.hpp"
 
 using namespace std;
 
+const char BufferValues::label_glyphs[] = "0123456789.-+enaif";
+
 template <typename T> int sgn(T val) {
     return (T(0) < val) - (val < T(0));
 }
@@ -12,6 +16,7 @@ template <typename T> int sgn(T val) {
 BufferValues::~BufferValues() {
     glDeleteTextures(1, &text_tex);
     glDeleteBuffers(1, &text_vbo);
+    glDeleteBuffers(1, &label_vbo);
 }
 
 bool BufferValues::initialize() {
@@ -34,8 +39,10 @@ bool BufferValues::initialize() {
                          "mvp",
                          "buff_sampler",
                          "text_sampler",
-                         "pix_coord",
                          "brightness_contrast"
+                     }, {
+                         "inputPosition",
+                         "pixCoord"
                      });
 
     glGenTextures(1, &text_tex);
@@ -45,6 +52,28 @@ bool BufferValues::initialize() {
     glGenBuffers(1, &text_vbo);
     generate_glyphs_texture();
 
+    label_prog.create(shader::label_vert_shader,
+                      shader::label_frag_shader,
+                      ShaderProgram::FormatR,
+                      "rgba", {
+                          "mvp",
+                          "buff_sampler",
+                          "text_sampler",
+                          "brightness_contrast",
+                          "tile_size",
+                          "text_rotation",
+                          "text_scale",
+                          "channel_offsets",
+                          "channels",
+                          "label_format",
+                          "value_scale",
+                          "glyph_uv",
+                          "glyph_box",
+                          "glyph_advance"
+                      });
+    glGenBuffers(1, &label_vbo);
+    generate_label_glyph_tables();
+
     return true;
 }
 
@@ -53,7 +82,7 @@ int BufferValues::render_index() const {
 }
 
 void BufferValues::generate_glyphs_texture() {
-    const char text[]="0123456789., -enaninf";
+    const char text[]="0123456789., -+enaninf";
     const unsigned char *p;
     const int border_size = 2;
 
@@ -146,6 +175,44 @@ inline void pix2str(const Buffer::BufferType& type,
     }
 }
 
+// Vertical offset of the label of each channel within its pixel
+array<float, 4> BufferValues::channel_label_offsets(int channels) {
+    // Offset for vertical channel position to account for padding
+    array<float, 4> recenterFactors;
+    if(channels == 1) {
+        recenterFactors = {0.f, 0.f,
+                           0.f, 0.f};
+    } else if(channels == 2) {
+        float rfUp = padding / 3.0 / channels;
+        recenterFactors = {rfUp,
+                           -rfUp,
+                           0.f, 0.f};
+    } else if(channels == 3) {
+        float rfUp = padding / 2.0 / channels;
+        recenterFactors = {rfUp, 0.f,
+                           -rfUp, 0.f};
+    } else {
+        float rfUp = 3.f * padding / 5.f / channels;
+        float rfDown = padding / 5.f / channels;
+        recenterFactors = {rfUp, rfDown,
+                           -rfDown, -rfUp};
+    }
+
+    array<float, 4> offsets = {0.f, 0.f, 0.f, 0.f};
+    for(int c = 0; c < channels; ++c) {
+        offsets[c] = (0.5f * (channels - 1) - c) / channels
+                     - recenterFactors[c];
+    }
+    return offsets;
+}
+
+bool BufferValues::LabelBatchKey::operator==(const LabelBatchKey& other) const {
+    return lower_x == other.lower_x && upper_x == other.upper_x &&
+           lower_y == other.lower_y && upper_y == other.upper_y &&
+           angle == other.angle &&
+           tiles_generation == other.tiles_generation;
+}
+
 void BufferValues::draw(const mat4& projection, const mat4& viewInv) {
     GameObject* cam_obj = game_object->stage->getGameObject("camera");
     Camera* camera = cam_obj->getComponent<Camera>("camera_component");
@@ -157,10 +224,6 @@ void BufferValues::draw(const mat4& projection, const mat4& viewInv) {
         Buffer* buffer_component = game_object->getComponent<Buffer>("buffer_component");
         float buffer_width_f = buffer_component->buffer_width_f;
         float buffer_height_f = buffer_component->buffer_height_f;
-        int step = buffer_component->step;
-        int channels = buffer_component->channels;
-        Buffer::BufferType type = buffer_component->type;
-        uint8_t* buffer = buffer_component->buffer;
 
         vec4 tl_ndc(-1,1,0,1);
         vec4 br_ndc(1,-1,0,1);
@@ -181,94 +244,174 @@ void BufferValues::draw(const mat4& projection, const mat4& viewInv) {
         int lower_y = clamp(truncf(tl.y())-1.0f, -buffer_height_f/2.0f, buffer_height_f/2.0f-1.0f);
         int upper_y = clamp(ceilf(br.y())+1.f, -(buffer_height_f+1)/2.0f+1.f, (buffer_height_f+1)/2.0f);
 
-        int pos_center_x = -buffer_width_f/2;
-        int pos_center_y = -buffer_height_f/2;
-
-        char pix_label[30];
-
-        int pos;
-        float y_off;
-
-        // Offset for vertical channel position to account for padding
-        array<float, 4> recenterFactors;
-        if(channels == 1) {
-            recenterFactors = {0.f, 0.f,
-                               0.f, 0.f};
-        } else if(channels == 2) {
-            float rfUp = padding / 3.0 / channels;
-            recenterFactors = {rfUp,
-                               -rfUp,
-                               0.f, 0.f};
-        } else if(channels == 3) {
-            float rfUp = padding / 2.0 / channels;
-            recenterFactors = {rfUp, 0.f,
-                               -rfUp, 0.f};
-        } else if(channels == 4) {
-            float rfUp = 3.f * padding / 5.f / channels;
-            float rfDown = padding / 5.f / channels;
-            recenterFactors = {rfUp, rfDown,
-                               -rfDown, -rfUp};
+        if(gl_canvas->gpu_value_labels()) {
+            draw_gpu_labels(projection, viewInv, camRot,
+                            lower_x, upper_x, lower_y, upper_y);
+            return;
         }
 
-        for(int y = lower_y-pos_center_y; y < upper_y-pos_center_y; ++y) {
-            for(int x = lower_x-pos_center_x; x < upper_x-pos_center_x; ++x) {
-                pos = (y*step + x)*channels;
+        // The labels only have to be laid out again when the visible pixels
+        // or their values change; panning within a pixel reuses them
+        LabelBatchKey key;
+        key.lower_x = lower_x;
+        key.upper_x = upper_x;
+        key.lower_y = lower_y;
+        key.upper_y = upper_y;
+        key.angle = game_object->angle;
+        key.tiles_generation = buffer_component->tiles_generation();
+
+        if(!(key == label_batch_key_)) {
+            build_label_batches(camRot, key);
+            label_batch_key_ = key;
+        }
 
-                for(int c = 0; c < channels; ++c) {
-                    y_off = (0.5f * (channels - 1) - c) / channels
-                            - recenterFactors[c];
+        draw_label_batches(projection, viewInv);
+    }
+}
 
-                    pix2str(type, pix_label, buffer, pos, c);
-                    draw_text(projection, viewInv, camRot,
-                              pix_label,
-                              x + pos_center_x, y + pos_center_y,
-                              y_off, channels);
+void BufferValues::build_label_batches(const mat4& camRot,
+                                       const LabelBatchKey& key) {
+    Buffer* buffer_component = game_object->getComponent<Buffer>("buffer_component");
+    float buffer_width_f = buffer_component->buffer_width_f;
+    float buffer_height_f = buffer_component->buffer_height_f;
+    int step = buffer_component->step;
+    int channels = buffer_component->channels;
+    Buffer::BufferType type = buffer_component->type;
+    uint8_t* buffer = buffer_component->buffer;
+
+    int pos_center_x = -buffer_width_f/2;
+    int pos_center_y = -buffer_height_f/2;
+
+    array<float, 4> channel_offsets = channel_label_offsets(channels);
+
+    const int window_w = max(0, key.upper_x - key.lower_x);
+    const int window_h = max(0, key.upper_y - key.lower_y);
+    vector<LabelCell> cells(window_w * window_h);
+
+    // Cells of the previous window are still valid if neither the buffer
+    // contents nor the orientation changed
+    const LabelBatchKey& prev = label_batch_key_;
+    if(key.tiles_generation == prev.tiles_generation &&
+       key.angle == prev.angle) {
+        const int prev_w = max(0, prev.upper_x - prev.lower_x);
+        for(int y = max(key.lower_y, prev.lower_y);
+            y < min(key.upper_y, prev.upper_y); ++y) {
+            for(int x = max(key.lower_x, prev.lower_x);
+                x < min(key.upper_x, prev.upper_x); ++x) {
+                cells[(y - key.lower_y)*window_w + x - key.lower_x] =
+                        std::move(label_cells_[(y - prev.lower_y)*prev_w +
+                                               x - prev.lower_x]);
+            }
+        }
+    }
+
+    // Format the pixels that came into view. The text scale must account
+    // for all the labels before any of them is laid out, so that they all
+    // share the same size.
+    const float previous_scale = text_pixel_scale;
+    float paddingScale = 1.f/(1.f-2.f*padding);
+    for(int y = key.lower_y; y < key.upper_y; ++y) {
+        for(int x = key.lower_x; x < key.upper_x; ++x) {
+            LabelCell& cell = cells[(y - key.lower_y)*window_w + x - key.lower_x];
+            if(cell.formatted) {
+                continue;
+            }
+            cell.formatted = true;
+
+            int buff_x = x - pos_center_x;
+            int buff_y = y - pos_center_y;
+            // Labels are only drawn on top of tiles that were uploaded
+            if(!buffer_component->is_tile_ready_at_coord(buff_x, buff_y)) {
+                continue;
+            }
+
+            int pos = (buff_y*step + buff_x)*channels;
+            cell.num_labels = channels;
+
+            for(int c = 0; c < channels; ++c) {
+                pix2str(type, cell.text[c], buffer, pos, c);
+
+                float boxW = 0, boxH = 0;
+                for(const unsigned char* p = reinterpret_cast<const unsigned char*>(cell.text[c]); *p; p++) {
+                    boxW += text_texture_advances[*p][0];
+                    boxH = max(boxH, (float)text_texture_sizes[*p][1]);
                 }
+                text_pixel_scale = max(text_pixel_scale,
+                                       max(boxW, boxH) * paddingScale * channels);
             }
         }
     }
-}
 
-void BufferValues::draw_text(const mat4& projection,
-                             const mat4& viewInv,
-                             const mat4& camRot,
-                             const char* text,
-                             float x,
-                             float y,
-                             float y_offset,
-                             float channels) {
-    Buffer* buffer_component = game_object->getComponent<Buffer>("buffer_component");
-    const float* auto_buffer_contrast_brightness;
-    if(game_object->stage->contrast_enabled) {
-        auto_buffer_contrast_brightness =
-                buffer_component->auto_buffer_contrast_brightness();
-    } else {
-        auto_buffer_contrast_brightness = Buffer::no_ac_params;
+    // Lay out the new cells, or all of them if the text scale grew
+    const bool relayout = text_pixel_scale != previous_scale;
+    for(int y = key.lower_y; y < key.upper_y; ++y) {
+        for(int x = key.lower_x; x < key.upper_x; ++x) {
+            LabelCell& cell = cells[(y - key.lower_y)*window_w + x - key.lower_x];
+            if(cell.num_labels == 0 ||
+               (!cell.vertices.empty() && !relayout)) {
+                continue;
+            }
+
+            int buff_x = x - pos_center_x;
+            int buff_y = y - pos_center_y;
+            cell.vertices.clear();
+            for(int c = 0; c < cell.num_labels; ++c) {
+                append_text(camRot, cell.text[c], x, y, channel_offsets[c],
+                            buffer_component->tile_coord_x(buff_x),
+                            buffer_component->tile_coord_y(buff_y),
+                            cell.vertices);
+            }
+        }
     }
 
-    text_prog.use();
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    // Quads are grouped per tile, then concatenated into a single array
+    map<int, vector<const LabelCell*>> tile_cells;
+    for(int y = key.lower_y; y < key.upper_y; ++y) {
+        for(int x = key.lower_x; x < key.upper_x; ++x) {
+            const LabelCell& cell = cells[(y - key.lower_y)*window_w + x - key.lower_x];
+            if(cell.vertices.empty()) {
+                continue;
+            }
+            int tile_id = ((y - pos_center_y)/buffer_component->max_texture_size) *
+                          buffer_component->num_textures_x +
+                          (x - pos_center_x)/buffer_component->max_texture_size;
+            tile_cells[tile_id].push_back(&cell);
+        }
+    }
 
-    glActiveTexture(GL_TEXTURE0);
-    GLuint buff_tex = buffer_component->sub_texture_id_at_coord(x + buffer_component->buffer_width_f/2.f,
-                                                                y + buffer_component->buffer_height_f/2.f);
-    glBindTexture(GL_TEXTURE_2D, buff_tex);
-    text_prog.uniform1i("buff_sampler", 0);
+    const int vertex_size = 6;
+    label_vertices_.clear();
+    label_batches_.clear();
+    for(const auto& tile: tile_cells) {
+        LabelBatch batch;
+        batch.buff_tex = buffer_component->buff_tex[tile.first];
+        batch.first_vertex = label_vertices_.size() / vertex_size;
+        for(const LabelCell* cell: tile.second) {
+            label_vertices_.insert(label_vertices_.end(),
+                                   cell->vertices.begin(),
+                                   cell->vertices.end());
+        }
+        batch.num_vertices = label_vertices_.size() / vertex_size -
+                             batch.first_vertex;
+        label_batches_.push_back(batch);
+    }
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, text_tex);
-    text_prog.uniform1i("text_sampler", 1);
+    label_cells_ = std::move(cells);
 
-    text_prog.uniformMatrix4fv("mvp", 1, GL_FALSE,
-            (projection*viewInv).data());
-    text_prog.uniform2f("pix_coord",
-            buffer_component->tile_coord_x(x + buffer_component->buffer_width_f/2.f),
-            buffer_component->tile_coord_y(y + buffer_component->buffer_height_f/2.f));
+    glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
+    glBufferData(GL_ARRAY_BUFFER, label_vertices_.size() * sizeof(GLfloat),
+                 label_vertices_.data(), GL_DYNAMIC_DRAW);
+}
 
-    text_prog.uniform4fv("brightness_contrast", 2,
-            auto_buffer_contrast_brightness);
+void BufferValues::append_text(const mat4& camRot,
+                               const char* text,
+                               float x,
+                               float y,
+                               float y_offset,
+                               float pix_coord_x,
+                               float pix_coord_y,
+                               vector<GLfloat>& vertices) {
+    Buffer* buffer_component = game_object->getComponent<Buffer>("buffer_component");
 
     // Compute text box size
     float boxW = 0, boxH = 0;
@@ -277,9 +420,6 @@ void BufferValues::draw_text(const mat4& projection,
         boxH = max(boxH, (float)text_texture_sizes[*p][1]);
     }
 
-    float paddingScale = 1.f/(1.f-2.f*padding);
-    text_pixel_scale = max(text_pixel_scale,
-                           max(boxW, boxH) * paddingScale * channels);
     float sx = 1.0/text_pixel_scale;
     float sy = 1.0/text_pixel_scale;
 
@@ -313,18 +453,16 @@ void BufferValues::draw_text(const mat4& projection,
         float tex_upper_x = tex_lower_x + ((float)tex_wid-1.0f)/text_texture_width;
         float tex_upper_y = tex_lower_y + ((float)tex_hei-1.0f)/text_texture_height;
 
-        /*
-         * box format: <pixel coord x, pixel coord y, texture coord x, texture coord y>
-         */
-        GLfloat box[4][4] = {
-            {x2,     y2    , tex_lower_x, tex_lower_y},
-            {x2 + w, y2    , tex_upper_x, tex_lower_y},
-            {x2,     y2 + h, tex_lower_x, tex_upper_y},
-            {x2 + w, y2 + h, tex_upper_x, tex_upper_y},
+        // Two triangles per glyph
+        const GLfloat quad[6][6] = {
+            {x2,     y2    , tex_lower_x, tex_lower_y, pix_coord_x, pix_coord_y},
+            {x2 + w, y2    , tex_upper_x, tex_lower_y, pix_coord_x, pix_coord_y},
+            {x2,     y2 + h, tex_lower_x, tex_upper_y, pix_coord_x, pix_coord_y},
+            {x2 + w, y2    , tex_upper_x, tex_lower_y, pix_coord_x, pix_coord_y},
+            {x2 + w, y2 + h, tex_upper_x, tex_upper_y, pix_coord_x, pix_coord_y},
+            {x2,     y2 + h, tex_lower_x, tex_upper_y, pix_coord_x, pix_coord_y},
         };
-
-        glBufferData(GL_ARRAY_BUFFER, sizeof box, box, GL_DYNAMIC_DRAW);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        vertices.insert(vertices.end(), &quad[0][0], &quad[0][0] + 36);
 
         vec4 char_step_direction(text_texture_advances[*p][0] * sx, text_texture_advances[*p][1] * sy, 0.0, 1.0);
 
@@ -332,3 +470,222 @@ void BufferValues::draw_text(const mat4& projection,
         y += char_step_direction.y();
     }
 }
+
+void BufferValues::draw_label_batches(const mat4& projection,
+                                      const mat4& viewInv) {
+    if(label_batches_.empty()) {
+        return;
+    }
+
+    Buffer* buffer_component = game_object->getComponent<Buffer>("buffer_component");
+    const float* auto_buffer_contrast_brightness;
+    if(game_object->stage->contrast_enabled) {
+        auto_buffer_contrast_brightness =
+                buffer_component->auto_buffer_contrast_brightness();
+    } else {
+        auto_buffer_contrast_brightness = Buffer::no_ac_params;
+    }
+
+    const GLsizei stride = 6 * sizeof(GLfloat);
+
+    text_prog.use();
+    glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<void*>(4 * sizeof(GLfloat)));
+
+    text_prog.uniform1i("buff_sampler", 0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, text_tex);
+    text_prog.uniform1i("text_sampler", 1);
+
+    text_prog.uniformMatrix4fv("mvp", 1, GL_FALSE,
+            (projection*viewInv).data());
+
+    text_prog.uniform4fv("brightness_contrast", 2,
+            auto_buffer_contrast_brightness);
+
+    glActiveTexture(GL_TEXTURE0);
+    for(const auto& batch: label_batches_) {
+        glBindTexture(GL_TEXTURE_2D, batch.buff_tex);
+        glDrawArrays(GL_TRIANGLES, batch.first_vertex, batch.num_vertices);
+    }
+
+    // The other programs only read attribute 0
+    glDisableVertexAttribArray(1);
+}
+
+void BufferValues::generate_label_glyph_tables() {
+    for(int i = 0; i < num_label_glyphs; ++i) {
+        const unsigned char glyph = label_glyphs[i];
+        const int tex_wid = text_texture_sizes[glyph][0];
+        const int tex_hei = text_texture_sizes[glyph][1];
+
+        // Same atlas rectangle as the quads of append_text()
+        glyph_uv_[i][0] = ((float)text_texture_offsets[glyph][0])/text_texture_width;
+        glyph_uv_[i][1] = ((float)text_texture_offsets[glyph][1])/text_texture_height;
+        glyph_uv_[i][2] = glyph_uv_[i][0] + ((float)tex_wid-1.0f)/text_texture_width;
+        glyph_uv_[i][3] = glyph_uv_[i][1] + ((float)tex_hei-1.0f)/text_texture_height;
+
+        glyph_box_[i][0] = text_texture_tls[glyph][0];
+        glyph_box_[i][1] = text_texture_tls[glyph][1];
+        glyph_box_[i][2] = tex_wid;
+        glyph_box_[i][3] = tex_hei;
+
+        glyph_advance_[i] = text_texture_advances[glyph][0];
+    }
+}
+
+float BufferValues::gpu_label_text_scale(Buffer::BufferType type,
+                                         int channels) const {
+    // Longest label of each type
+    const char* widest_label;
+    if(type == Buffer::BufferType::UnsignedByte) {
+        widest_label = "888";
+    } else if(type == Buffer::BufferType::UnsignedShort) {
+        widest_label = "88888";
+    } else if(type == Buffer::BufferType::Short) {
+        widest_label = "-88888";
+    } else {
+        widest_label = "-8.888e+88";
+    }
+
+    float boxW = 0, boxH = 0;
+    for(const unsigned char* p = reinterpret_cast<const unsigned char*>(widest_label); *p; p++) {
+        boxW += text_texture_advances[*p][0];
+        boxH = max(boxH, (float)text_texture_sizes[*p][1]);
+    }
+
+    float paddingScale = 1.f/(1.f-2.f*padding);
+    return 1.f/(max(boxW, boxH) * paddingScale * channels);
+}
+
+void BufferValues::draw_gpu_labels(const mat4& projection,
+                                   const mat4& viewInv,
+                                   const mat4& camRot,
+                                   int lower_x,
+                                   int upper_x,
+                                   int lower_y,
+                                   int upper_y) {
+    Buffer* buffer_component = game_object->getComponent<Buffer>("buffer_component");
+    const int buffer_width_i = static_cast<int>(buffer_component->buffer_width_f);
+    const int buffer_height_i = static_cast<int>(buffer_component->buffer_height_f);
+    const int tile_size = buffer_component->max_texture_size;
+    const int channels = buffer_component->channels;
+    const Buffer::BufferType type = buffer_component->type;
+
+    // Visible pixels, in buffer coordinates
+    const int pos_center_x = -buffer_width_i/2;
+    const int pos_center_y = -buffer_height_i/2;
+    const int window_x0 = lower_x - pos_center_x;
+    const int window_x1 = upper_x - pos_center_x;
+    const int window_y0 = lower_y - pos_center_y;
+    const int window_y1 = upper_y - pos_center_y;
+
+    // One quad per visible tile, covering its visible pixels. Vertices hold
+    // <position x, position y, tile pixel coord x, tile pixel coord y>.
+    vector<GLfloat> vertices;
+    vector<int> tiles;
+    for(int ty = 0; ty < buffer_component->num_textures_y; ++ty) {
+        for(int tx = 0; tx < buffer_component->num_textures_x; ++tx) {
+            const int tile_x = tx * tile_size;
+            const int tile_y = ty * tile_size;
+            const int x0 = max(window_x0, tile_x);
+            const int y0 = max(window_y0, tile_y);
+            const int x1 = min(window_x1, min(tile_x + tile_size, buffer_width_i));
+            const int y1 = min(window_y1, min(tile_y + tile_size, buffer_height_i));
+
+            // Labels are only drawn on top of tiles that were uploaded
+            if(x0 >= x1 || y0 >= y1 ||
+               !buffer_component->is_tile_ready_at_coord(tile_x, tile_y)) {
+                continue;
+            }
+
+            const float px0 = x0 - buffer_component->buffer_width_f/2.f;
+            const float px1 = x1 - buffer_component->buffer_width_f/2.f;
+            const float py0 = y0 - buffer_component->buffer_height_f/2.f;
+            const float py1 = y1 - buffer_component->buffer_height_f/2.f;
+            const float u0 = x0 - tile_x, u1 = x1 - tile_x;
+            const float v0 = y0 - tile_y, v1 = y1 - tile_y;
+
+            const GLfloat quad[6][4] = {
+                {px0, py0, u0, v0},
+                {px1, py0, u1, v0},
+                {px0, py1, u0, v1},
+                {px1, py0, u1, v0},
+                {px1, py1, u1, v1},
+                {px0, py1, u0, v1},
+            };
+            vertices.insert(vertices.end(), &quad[0][0], &quad[0][0] + 24);
+            tiles.push_back(ty * buffer_component->num_textures_x + tx);
+        }
+    }
+
+    if(tiles.empty()) {
+        return;
+    }
+
+    const float* auto_buffer_contrast_brightness;
+    if(game_object->stage->contrast_enabled) {
+        auto_buffer_contrast_brightness =
+                buffer_component->auto_buffer_contrast_brightness();
+    } else {
+        auto_buffer_contrast_brightness = Buffer::no_ac_params;
+    }
+
+    int label_format;
+    float value_scale;
+    if(type == Buffer::BufferType::Float32 ||
+       type == Buffer::BufferType::Float64) {
+        label_format = 2;
+        value_scale = 1.f;
+    } else {
+        label_format = type == Buffer::BufferType::Int32 ? 1 : 0;
+        value_scale = TextureFormat::select(type, channels).max_intensity;
+    }
+
+    array<float, 4> channel_offsets = channel_label_offsets(channels);
+
+    label_prog.use();
+    glBindBuffer(GL_ARRAY_BUFFER, label_vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+                 vertices.data(), GL_STREAM_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+    label_prog.uniform1i("buff_sampler", 0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, text_tex);
+    label_prog.uniform1i("text_sampler", 1);
+
+    label_prog.uniformMatrix4fv("mvp", 1, GL_FALSE,
+            (projection*viewInv*camRot).data());
+    label_prog.uniform4fv("brightness_contrast", 2,
+            auto_buffer_contrast_brightness);
+    label_prog.uniform2f("text_rotation",
+                         cos(game_object->angle), sin(game_object->angle));
+    label_prog.uniform1f("text_scale", gpu_label_text_scale(type, channels));
+    label_prog.uniform4fv("channel_offsets", 1, channel_offsets.data());
+    label_prog.uniform1i("channels", channels);
+    label_prog.uniform1i("label_format", label_format);
+    label_prog.uniform1f("value_scale", value_scale);
+    label_prog.uniform4fv("glyph_uv", num_label_glyphs, &glyph_uv_[0][0]);
+    label_prog.uniform4fv("glyph_box", num_label_glyphs, &glyph_box_[0][0]);
+    label_prog.uniform1fv("glyph_advance", num_label_glyphs, glyph_advance_);
+
+    glActiveTexture(GL_TEXTURE0);
+    for(size_t i = 0; i < tiles.size(); ++i) {
+        const int tile_id = tiles[i];
+        const int tile_x = (tile_id % buffer_component->num_textures_x) * tile_size;
+        const int tile_y = (tile_id / buffer_component->num_textures_x) * tile_size;
+        glBindTexture(GL_TEXTURE_2D, buffer_component->buff_tex[tile_id]);
+        label_prog.uniform2f("tile_size",
+                             min(tile_size, buffer_width_i - tile_x),
+                             min(tile_size, buffer_height_i - tile_y));
+        glDrawArrays(GL_TRIANGLES, i * 6, 6);
+    }
+}
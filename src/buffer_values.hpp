@@ -2,10 +2,13 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <array>
 #include <iostream>
+#include <vector>
 
 #include "shader.hpp"
 #include "component.hpp"
+#include "buffer.hpp"
 
 class BufferValues : public Component {
 public:
@@ -34,15 +37,81 @@ private:
     int text_texture_tls[256][2];
     static float constexpr padding = 0.125f; // Must be smaller than 0.5
 
+    // Glyph tables of the label shader, in the order of label_glyphs
+    static const char label_glyphs[];
+    static const int num_label_glyphs = 18;
+    ShaderProgram label_prog;
+    GLuint label_vbo;
+    GLfloat glyph_uv_[num_label_glyphs][4];
+    GLfloat glyph_box_[num_label_glyphs][4];
+    GLfloat glyph_advance_[num_label_glyphs];
+
+    // Glyph quads of the visible labels, uploaded to text_vbo. Each vertex
+    // holds <pixel coord x, pixel coord y, texture coord x, texture coord y,
+    // labelled pixel tile coord x, labelled pixel tile coord y>, and the
+    // quads are grouped by the buffer tile they lie on, since each tile is
+    // sampled from its own texture.
+    struct LabelBatch {
+        GLuint buff_tex;
+        GLint first_vertex;
+        GLsizei num_vertices;
+    };
+    std::vector<GLfloat> label_vertices_;
+    std::vector<LabelBatch> label_batches_;
+
+    // Visible pixel window, orientation and buffer tiles the batches were
+    // built for
+    struct LabelBatchKey {
+        int lower_x = 0, upper_x = 0;
+        int lower_y = 0, upper_y = 0;
+        float angle = 0.f;
+        int tiles_generation = -1;
+
+        bool operator==(const LabelBatchKey& other) const;
+    };
+    LabelBatchKey label_batch_key_;
+
+    // Formatted labels of a visible pixel, and their glyph quads. Cells are
+    // kept while their pixel stays visible, so that scrolling only formats
+    // the rows and columns that come into view.
+    struct LabelCell {
+        bool formatted = false;
+        int num_labels = 0;
+        char text[4][30];
+        std::vector<GLfloat> vertices;
+    };
+    // Cells of the window of label_batch_key_, in row major order
+    std::vector<LabelCell> label_cells_;
+
     void generate_glyphs_texture();
 
-    void draw_text(const mat4& projection,
-                   const mat4& viewInv,
-                   const mat4 &camRot,
-                   const char* text,
-                   float x,
-                   float y,
-                   float y_offset,
-                   float channels);
+    static std::array<float, 4> channel_label_offsets(int channels);
+
+    void build_label_batches(const mat4& camRot, const LabelBatchKey& key);
+
+    void append_text(const mat4& camRot,
+                     const char* text,
+                     float x,
+                     float y,
+                     float y_offset,
+                     float pix_coord_x,
+                     float pix_coord_y,
+                     std::vector<GLfloat>& vertices);
+
+    void draw_label_batches(const mat4& projection, const mat4& viewInv);
+
+    void generate_label_glyph_tables();
+
+    // Size of a font pixel in the GPU labels, large enough for the longest
+    // label of the buffer type
+    float gpu_label_text_scale(Buffer::BufferType type, int channels) const;
+
+    void draw_gpu_labels(const mat4& projection,
+                         const mat4& viewInv,
+                         const mat4& camRot,
+                         int lower_x,
+                         int upper_x,
+                         int lower_y,
+                         int upper_y);
 };
 
@@ -2,10 +2,19 @@
 #include "mainwindow.h"
 #include "glcanvas.hpp"
 
-GLCanvas::GLCanvas(QWidget *parent) : QGLWidget(parent) {
+GLCanvas::GLCanvas(QWidget *parent)
+    : QGLWidget(parent),
+      tile_cache_(texture_pool_),
+      tile_store_(texture_pool_, texture_uploader_) {
     mouseDown_[0] = mouseDown_[1] = false;
 }
 
+GLCanvas::~GLCanvas() {
+    // The members delete their GL objects, and the context is only
+    // destroyed by QGLWidget after them
+    makeCurrent();
+}
+
 void GLCanvas::mouseMoveEvent(QMouseEvent *ev) {
     int last_mouse_x = mouseX_;
     int last_mouse_y = mouseY_;
@@ -53,6 +62,8 @@ void GLCanvas::initializeGL() {
         std::cerr << "Error while initializing GLEW:" << glewGetErrorString(err) << std::endl;
     }
 
+    texture_uploader_.initialize();
+
     /// Texture for generating icons
     int icon_width = 200;
     int icon_height = 100;
@@ -122,6 +133,11 @@ void GLCanvas::set_main_window(MainWindow *mw) {
 }
 
 void GLCanvas::paintGL() {
+    // Stream pending buffer tiles under the per frame budget
+    texture_uploader_.upload();
+    // Tiles drawn in this frame are protected from eviction
+    tile_cache_.begin_frame();
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     main_window_->draw();
     swapBuffers();
@@ -130,3 +146,31 @@ void GLCanvas::paintGL() {
 void GLCanvas::wheelEvent(QWheelEvent* ev) {
     main_window_->scroll_callback(ev->delta()/120.0f);
 }
+
+TextureUploader& GLCanvas::texture_uploader() {
+    return texture_uploader_;
+}
+
+TexturePool& GLCanvas::texture_pool() {
+    return texture_pool_;
+}
+
+TileCache& GLCanvas::tile_cache() {
+    return tile_cache_;
+}
+
+TileStore& GLCanvas::tile_store() {
+    return tile_store_;
+}
+
+ThreadPool& GLCanvas::thread_pool() {
+    return thread_pool_;
+}
+
+void GLCanvas::set_gpu_value_labels(bool enabled) {
+    gpu_value_labels_ = enabled;
+}
+
+bool GLCanvas::gpu_value_labels() const {
+    return gpu_value_labels_;
+}
@@ -8,6 +8,11 @@
 #include "camera.hpp"
 #include "buffer_values.hpp"
 #include "stage.hpp"
+#include "texture_pool.hpp"
+#include "tile_cache.hpp"
+#include "tile_store.hpp"
+#include "texture_uploader.hpp"
+#include "thread_pool.hpp"
 
 class MainWindow;
 class GLCanvas : public QGLWidget {
@@ -23,6 +28,8 @@ public:
 
     explicit GLCanvas(QWidget* parent = 0);
 
+    ~GLCanvas();
+
     void mouseMoveEvent(QMouseEvent* ev);
 
     void mousePressEvent(QMouseEvent* ev);
@@ -45,6 +52,22 @@ public:
 
     void wheelEvent(QWheelEvent* ev);
 
+    TextureUploader& texture_uploader();
+
+    TexturePool& texture_pool();
+
+    TileCache& tile_cache();
+
+    TileStore& tile_store();
+
+    ThreadPool& thread_pool();
+
+    // When enabled, pixel value labels are formatted and drawn by a
+    // fragment shader instead of being laid out on the CPU
+    void set_gpu_value_labels(bool enabled);
+
+    bool gpu_value_labels() const;
+
 private:
     int mouseX_;
     int mouseY_;
@@ -52,4 +75,12 @@ private:
     MainWindow* main_window_;
     GLuint icon_texture_;
     GLuint icon_fbo_;
+    TexturePool texture_pool_;
+    TextureUploader texture_uploader_;
+    TileCache tile_cache_;
+    // Releases its textures to the pool and cancels its uploads, so it must
+    // go away before them
+    TileStore tile_store_;
+    ThreadPool thread_pool_;
+    bool gpu_value_labels_ = false;
 };
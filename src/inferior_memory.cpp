@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <string>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "inferior_memory.hpp"
+
+using namespace std;
+
+namespace {
+
+#ifndef IOV_MAX
+const int max_iovecs = 1024;
+#else
+const int max_iovecs = IOV_MAX;
+#endif
+
+bool read_with_proc_mem(int& fd,
+                        pid_t pid,
+                        uint64_t address,
+                        size_t size,
+                        uint8_t* dst) {
+    if(fd < 0) {
+        string path = "/proc/" + to_string(pid) + "/mem";
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) {
+            return false;
+        }
+    }
+
+    size_t done = 0;
+    while(done < size) {
+        ssize_t result = pread(fd, dst + done, size - done,
+                               static_cast<off_t>(address + done));
+        if(result <= 0) {
+            if(result < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+} // namespace
+
+bool read_inferior_segments(pid_t pid,
+                            const vector<InferiorSegment>& segments,
+                            uint8_t* dst) {
+    if(pid <= 0) {
+        return false;
+    }
+
+    iovec local[max_iovecs];
+    iovec remote[max_iovecs];
+    int proc_mem_fd = -1;
+    bool use_proc_mem = false;
+    bool ok = true;
+
+    // Segment being read, and how many of its bytes are done
+    size_t segment = 0;
+    size_t segment_done = 0;
+
+    while(ok && segment < segments.size()) {
+        if(use_proc_mem) {
+            const InferiorSegment& s = segments[segment];
+            ok = read_with_proc_mem(proc_mem_fd, pid, s.address + segment_done,
+                                    s.size - segment_done, dst + segment_done);
+            dst += s.size;
+            ++segment;
+            segment_done = 0;
+            continue;
+        }
+
+        int count = 0;
+        uint8_t* batch_dst = dst;
+        for(size_t i = segment; i < segments.size() && count < max_iovecs; ++i) {
+            size_t skip = i == segment ? segment_done : 0;
+            local[count].iov_base = batch_dst + skip;
+            local[count].iov_len = segments[i].size - skip;
+            remote[count].iov_base = reinterpret_cast<void*>(
+                    static_cast<uintptr_t>(segments[i].address + skip));
+            remote[count].iov_len = segments[i].size - skip;
+            batch_dst += segments[i].size;
+            ++count;
+        }
+
+        ssize_t result = process_vm_readv(pid, local, count,
+                                          remote, count, 0);
+        if(result < 0 && errno == EINTR) {
+            continue;
+        }
+        if(result < 0 && (errno == ENOSYS || errno == EPERM)) {
+            // The system call is not available to us at all
+            use_proc_mem = true;
+            continue;
+        }
+        if(result <= 0) {
+            // The current segment faulted. It is tried again through the
+            // memory file, and the next ones with the system call.
+            const InferiorSegment& s = segments[segment];
+            ok = read_with_proc_mem(proc_mem_fd, pid, s.address + segment_done,
+                                    s.size - segment_done, dst + segment_done);
+            dst += s.size;
+            ++segment;
+            segment_done = 0;
+            continue;
+        }
+
+        // Skip over the segments read
+        size_t transferred = static_cast<size_t>(result);
+        while(transferred > 0) {
+            size_t remaining = segments[segment].size - segment_done;
+            if(transferred < remaining) {
+                segment_done += transferred;
+                break;
+            }
+            transferred -= remaining;
+            dst += segments[segment].size;
+            ++segment;
+            segment_done = 0;
+        }
+    }
+
+    if(proc_mem_fd >= 0) {
+        close(proc_mem_fd);
+    }
+    return ok;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+
+/*
+ * Reads the memory of a local process straight into the viewer's storage,
+ * without going through the debugger's Python API. Used while the debugger
+ * is stopped in a native inferior, which it traces, so the kernel allows the
+ * access. Ranges are read with batched process_vm_readv() calls, falling
+ * back to /proc/<pid>/mem where the system call is unavailable or refused.
+ * The functions return false if any byte couldn't be read.
+ */
+
+// Range of the inferior memory
+struct InferiorSegment {
+    uint64_t address;
+    size_t size;
+};
+
+// Reads all the segments with one vectored read (or as few as the iovec
+// limit allows), packing them one after the other in dst
+bool read_inferior_segments(pid_t pid,
+                            const std::vector<InferiorSegment>& segments,
+                            uint8_t* dst);
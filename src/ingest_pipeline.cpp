@@ -0,0 +1,173 @@
+#include <algorithm>
+
+#include "ingest_pipeline.hpp"
+#include "managed_pointer.h"
+
+using namespace std;
+
+IngestPipeline::IngestPipeline(ThreadPool& pool,
+                               TileStore& tile_store,
+                               function<void()> on_prepared)
+    : pool_(pool), tile_store_(tile_store), state_(make_shared<State>()) {
+    state_->on_prepared = on_prepared;
+}
+
+IngestPipeline::~IngestPipeline() {
+    // Releasing a Python buffer takes the GIL, which must not happen with
+    // the lock held
+    map<string, BufferRequestMessage> pending_requests;
+    {
+        unique_lock<mutex> lock(state_->mtx);
+        state_->cancelled = true;
+        state_->idle_cv.wait(lock,
+                             [this]() { return state_->running_tasks == 0; });
+        pending_requests.swap(state_->requests);
+        state_->request_order.clear();
+    }
+
+    // Queued preparations keep their request until the pool drops their
+    // task, which may only happen when the pool is destroyed. None of them
+    // runs anymore, so their buffers are released here.
+    for(auto& preparation: preparations_) {
+        preparation->prepared = PreparedBuffer();
+    }
+    preparations_.clear();
+}
+
+void IngestPipeline::push(const BufferRequestMessage& request) {
+    // Releasing a Python buffer takes the GIL, which must not happen with
+    // the lock held
+    shared_ptr<uint8_t> stale_buffer;
+    {
+        unique_lock<mutex> lock(state_->mtx);
+        auto pending = state_->requests.find(request.var_name_str);
+        if(pending == state_->requests.end()) {
+            state_->request_order.push_back(request.var_name_str);
+            state_->requests[request.var_name_str] = request;
+        } else {
+            stale_buffer = pending->second.buffer_owner;
+            pending->second = request;
+            ++state_->dropped_updates;
+        }
+    }
+}
+
+int IngestPipeline::dropped_updates() {
+    unique_lock<mutex> lock(state_->mtx);
+    return state_->dropped_updates;
+}
+
+deque<BufferRequestMessage> IngestPipeline::take_requests() {
+    deque<BufferRequestMessage> requests;
+    unique_lock<mutex> lock(state_->mtx);
+    for(const string& var_name: state_->request_order) {
+        requests.push_back(std::move(state_->requests[var_name]));
+    }
+    state_->request_order.clear();
+    state_->requests.clear();
+    return requests;
+}
+
+void IngestPipeline::prepare(const BufferRequestMessage& request,
+                             shared_ptr<const TileAnalysis> previous_analysis,
+                             int tile_size,
+                             PyramidReduction reduction) {
+    shared_ptr<Preparation> preparation = make_shared<Preparation>();
+    preparation->prepared.request = request;
+    preparations_.push_back(preparation);
+
+    // Buffers being prepared together share the workers; a single big one
+    // gets all of them to analyze its tiles
+    const int num_tasks = std::max(1, pool_.size() /
+                                      static_cast<int>(preparations_.size()));
+    shared_ptr<State> state = state_;
+    ThreadPool* pool = &pool_;
+    TileStore* tile_store = &tile_store_;
+
+    pool_.submit([state, preparation, previous_analysis, tile_size,
+                  reduction, pool, num_tasks, tile_store]() {
+        {
+            unique_lock<mutex> lock(state->mtx);
+            if(state->cancelled) {
+                return;
+            }
+            ++state->running_tasks;
+        }
+
+        PreparedBuffer& prepared = preparation->prepared;
+        BufferRequestMessage& request = prepared.request;
+        if(request.type == Buffer::BufferType::Float64 &&
+           !request.from_history) {
+            // The requested buffer is released as soon as it is converted
+            request.buffer_owner = makeFloatBufferFromDouble(
+                    reinterpret_cast<const double*>(request.buffer), request.width_i,
+                    request.height_i, request.channels, request.step);
+            request.buffer = request.buffer_owner.get();
+            request.step = request.width_i;
+        }
+
+        prepared.tile_analysis = TileAnalysis::analyze(request.buffer,
+                                                       request.width_i,
+                                                       request.height_i,
+                                                       request.channels,
+                                                       request.type,
+                                                       request.step,
+                                                       tile_size,
+                                                       reduction,
+                                                       previous_analysis,
+                                                       pool,
+                                                       num_tasks,
+                                                       request.version,
+                                                       tile_store);
+
+        unique_lock<mutex> lock(state->mtx);
+        preparation->done = true;
+        --state->running_tasks;
+        state->idle_cv.notify_all();
+        if(!state->cancelled) {
+            state->on_prepared();
+        }
+    });
+}
+
+bool IngestPipeline::take_prepared(PreparedBuffer& prepared) {
+    while(!preparations_.empty()) {
+        {
+            unique_lock<mutex> lock(state_->mtx);
+            if(!preparations_.front()->done) {
+                return false;
+            }
+        }
+
+        shared_ptr<Preparation> oldest = preparations_.front();
+        preparations_.pop_front();
+
+        const string& var_name = oldest->prepared.request.var_name_str;
+        bool superseded = false;
+        for(const auto& preparation: preparations_) {
+            if(preparation->prepared.request.var_name_str == var_name) {
+                superseded = true;
+                break;
+            }
+        }
+
+        if(!superseded) {
+            prepared = oldest->prepared;
+            return true;
+        }
+
+        unique_lock<mutex> lock(state_->mtx);
+        ++state_->dropped_updates;
+    }
+
+    return false;
+}
+
+bool IngestPipeline::busy() {
+    if(!preparations_.empty()) {
+        return true;
+    }
+
+    unique_lock<mutex> lock(state_->mtx);
+    return !state_->requests.empty();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "buffer.hpp"
+#include "thread_pool.hpp"
+#include "tile_analysis.hpp"
+
+struct BufferRequestMessage {
+    std::string var_name_str;
+    // Keeps the pixels alive: either a Python buffer object, or memory
+    // read from the inferior by the library itself
+    std::shared_ptr<uint8_t> buffer_owner;
+    uint8_t* buffer;
+    int width_i;
+    int height_i;
+    int channels;
+    Buffer::BufferType type;
+    int step;
+    std::string pixel_layout;
+    // Set when the pixels are known to share rows with earlier contents
+    ContentVersion version;
+    // Subsampled contents of a buffer that is still being read
+    bool provisional = false;
+    // Earlier contents of the buffer, taken from its history. Float64
+    // buffers are recorded after being converted, so they are not
+    // converted again.
+    bool from_history = false;
+    // Frame of a journal, which is not recorded in the history
+    bool replayed = false;
+};
+
+// A buffer request whose CPU side processing is done, ready to be handed
+// over to its stage by the GUI thread
+struct PreparedBuffer {
+    // Float64 buffers are replaced by a packed float copy
+    BufferRequestMessage request;
+    std::shared_ptr<const TileAnalysis> tile_analysis;
+};
+
+/*
+ * Moves the processing of buffer updates off the GUI thread. Requests are
+ * pushed by the debugger thread, and prepared on a ThreadPool: Float64
+ * buffers are converted, and their tiles are hashed and reduced. The GUI
+ * thread then only has to take the prepared buffers, in the order they were
+ * requested, and hand them to their stages.
+ *
+ * Only the latest contents of a variable matter: a request replaces the
+ * older one of the same variable if that one wasn't prepared yet, and
+ * prepared buffers superseded by a newer request are dropped.
+ */
+class IngestPipeline {
+public:
+    // on_prepared is called from a worker thread whenever a buffer is ready.
+    // Tile pyramids are shared with other buffers through tile_store.
+    IngestPipeline(ThreadPool& pool,
+                   TileStore& tile_store,
+                   std::function<void()> on_prepared);
+
+    // Waits for the preparations in progress; the others are dropped, and
+    // the buffers of all pending requests are released
+    ~IngestPipeline();
+
+    // May be called from any thread. The buffer of the request is released
+    // as soon as the request is superseded.
+    void push(const BufferRequestMessage& request);
+
+    // Number of requests dropped because a newer one of the same variable
+    // arrived before they were displayed
+    int dropped_updates();
+
+    // The remaining functions must be called from the GUI thread
+
+    // Takes the requests pushed so far, in the order their variables were
+    // first requested
+    std::deque<BufferRequestMessage> take_requests();
+
+    // Starts preparing a request taken by take_requests(). The tiles of
+    // previous_analysis are reused where the contents didn't change.
+    void prepare(const BufferRequestMessage& request,
+                 std::shared_ptr<const TileAnalysis> previous_analysis,
+                 int tile_size,
+                 PyramidReduction reduction);
+
+    // Takes the oldest prepared buffer that wasn't superseded. Returns false
+    // if there is none, or if an older request is still being prepared.
+    bool take_prepared(PreparedBuffer& prepared);
+
+    // True while requests are queued or being prepared
+    bool busy();
+
+private:
+    struct Preparation {
+        PreparedBuffer prepared;
+        bool done = false;
+    };
+
+    // Shared with the tasks, which may outlive the pipeline in the pool queue
+    struct State {
+        std::mutex mtx;
+        std::condition_variable idle_cv;
+        // Requests waiting to be prepared, keyed by variable
+        std::deque<std::string> request_order;
+        std::map<std::string, BufferRequestMessage> requests;
+        std::function<void()> on_prepared;
+        int running_tasks = 0;
+        int dropped_updates = 0;
+        bool cancelled = false;
+    };
+
+    ThreadPool& pool_;
+    TileStore& tile_store_;
+    std::shared_ptr<State> state_;
+    std::deque<std::shared_ptr<Preparation>> preparations_;
+};
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstring>
+
+#include "journal_player.hpp"
+
+using namespace std;
+
+JournalPlayer::JournalPlayer(ThreadPool& pool, Delivery deliver)
+    : pool_(pool),
+      deliver_(deliver),
+      state_(make_shared<State>()),
+      frame_period_(chrono::milliseconds(33)) {
+    worker_ = thread(&JournalPlayer::player_loop, this);
+}
+
+JournalPlayer::~JournalPlayer() {
+    {
+        unique_lock<mutex> lock(state_->mtx);
+        stopping_ = true;
+        state_->cancelled = true;
+    }
+    state_->cv.notify_all();
+    worker_.join();
+
+    // The tasks still queued return as soon as they run, but the ones in
+    // progress finish the record they are decoding
+    shared_ptr<State> state = state_;
+    unique_lock<mutex> lock(state->mtx);
+    state->cv.wait(lock, [state]() {
+        return state->pending_tasks == 0;
+    });
+}
+
+bool JournalPlayer::open(const string& path) {
+    shared_ptr<JournalReader> reader = make_shared<JournalReader>();
+    if(!reader->open(path)) {
+        return false;
+    }
+
+    // The decoded buffers of the previous journal are released without the
+    // lock held
+    vector<Lane> previous_lanes;
+    {
+        shared_ptr<State> state = state_;
+        unique_lock<mutex> lock(state->mtx);
+        ++state->generation;
+        playing_ = false;
+        state->cv.notify_all();
+
+        // Nothing may decode into the lanes while they are replaced
+        state->cv.wait(lock, [state]() {
+            if(state->pending_tasks > 0) {
+                return false;
+            }
+            for(const Lane& lane: state->lanes) {
+                if(lane.busy) {
+                    return false;
+                }
+            }
+            return true;
+        });
+
+        state->reader = reader;
+        previous_lanes.swap(state->lanes);
+        state->lanes.resize(reader->variables().size());
+        current_frame_ = -1;
+        requested_frame_ = reader->num_frames() > 0 ? 0 : -1;
+    }
+    state_->cv.notify_all();
+
+    return true;
+}
+
+int JournalPlayer::num_frames() {
+    unique_lock<mutex> lock(state_->mtx);
+    return state_->reader == nullptr ? 0 : state_->reader->num_frames();
+}
+
+int JournalPlayer::current_frame() {
+    unique_lock<mutex> lock(state_->mtx);
+    return requested_frame_ >= 0 ? requested_frame_ : current_frame_;
+}
+
+void JournalPlayer::show(int frame) {
+    {
+        unique_lock<mutex> lock(state_->mtx);
+        if(state_->reader == nullptr || frame < 0 ||
+           frame >= state_->reader->num_frames()) {
+            return;
+        }
+        requested_frame_ = frame;
+    }
+    state_->cv.notify_all();
+}
+
+void JournalPlayer::play(double frames_per_second) {
+    {
+        unique_lock<mutex> lock(state_->mtx);
+        const int frames = state_->reader == nullptr ? 0 :
+                           state_->reader->num_frames();
+        if(frames == 0 || frames_per_second <= 0.0) {
+            return;
+        }
+
+        // Playing from the end starts over
+        if(requested_frame_ < 0 && current_frame_ >= frames - 1) {
+            requested_frame_ = 0;
+        }
+        playing_ = true;
+        frame_period_ = chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(1.0 / frames_per_second));
+        next_frame_time_ = chrono::steady_clock::now() + frame_period_;
+    }
+    state_->cv.notify_all();
+}
+
+void JournalPlayer::pause() {
+    unique_lock<mutex> lock(state_->mtx);
+    playing_ = false;
+}
+
+bool JournalPlayer::playing() {
+    unique_lock<mutex> lock(state_->mtx);
+    return playing_;
+}
+
+void JournalPlayer::player_loop() {
+    unique_lock<mutex> lock(state_->mtx);
+
+    while(true) {
+        if(stopping_) {
+            return;
+        }
+
+        if(requested_frame_ >= 0) {
+            int frame = requested_frame_;
+            requested_frame_ = -1;
+            present(frame, lock);
+            if(playing_) {
+                prefetch();
+            }
+            continue;
+        }
+
+        if(!playing_) {
+            state_->cv.wait(lock);
+            continue;
+        }
+
+        const auto now = chrono::steady_clock::now();
+        if(now < next_frame_time_) {
+            state_->cv.wait_until(lock, next_frame_time_);
+            continue;
+        }
+
+        const int frames = state_->reader == nullptr ? 0 :
+                           state_->reader->num_frames();
+        if(current_frame_ + 1 >= frames) {
+            playing_ = false;
+            continue;
+        }
+
+        // A late frame doesn't make the ones after it come sooner
+        next_frame_time_ = std::max(next_frame_time_ + frame_period_,
+                                    now);
+        present(current_frame_ + 1, lock);
+        prefetch();
+    }
+}
+
+void JournalPlayer::present(int frame, unique_lock<mutex>& lock) {
+    State& state = *state_;
+    shared_ptr<const JournalReader> reader = state.reader;
+    if(reader == nullptr) {
+        return;
+    }
+    const int generation = state.generation;
+    current_frame_ = frame;
+
+    vector<BufferRequestMessage> requests;
+    for(size_t v = 0; v < state.lanes.size(); ++v) {
+        const int record = reader->record_at(static_cast<int>(v), frame);
+        if(record < 0 || record == state.lanes[v].shown_record) {
+            continue;
+        }
+
+        // A prefetch task owns the decoder of the variable; it is told to
+        // stop, unless it already decoded the record needed
+        state.cv.wait(lock, [&]() {
+            if(state.generation != generation || !state.lanes[v].busy ||
+               state.lanes[v].ready.count(record) > 0) {
+                return true;
+            }
+            state.lanes[v].preempted = true;
+            return false;
+        });
+        if(state.generation != generation) {
+            return;
+        }
+
+        Lane& lane = state.lanes[v];
+        auto ready = lane.ready.find(record);
+        if(ready != lane.ready.end()) {
+            requests.push_back(std::move(ready->second));
+        } else {
+            lane.busy = true;
+            lock.unlock();
+            BufferRequestMessage request;
+            bool ok = reader->decode(record, lane.decoder);
+            if(ok) {
+                request = make_request(*reader, static_cast<int>(v),
+                                       record, lane.decoder);
+            }
+            lock.lock();
+            lane.busy = false;
+            state.cv.notify_all();
+            if(!ok) {
+                continue;
+            }
+            requests.push_back(std::move(request));
+        }
+
+        // Playback goes forward, so the records before the one shown are
+        // not needed anymore
+        lane.shown_record = record;
+        lane.ready.erase(lane.ready.begin(), lane.ready.upper_bound(record));
+    }
+
+    lock.unlock();
+    for(const BufferRequestMessage& request: requests) {
+        deliver_(request);
+    }
+    requests.clear();
+    lock.lock();
+}
+
+void JournalPlayer::prefetch() {
+    shared_ptr<State> state = state_;
+    shared_ptr<const JournalReader> reader = state->reader;
+    if(reader == nullptr) {
+        return;
+    }
+
+    const int last_frame = std::min(current_frame_ + prefetch_frames,
+                                    reader->num_frames() - 1);
+    for(size_t v = 0; v < state->lanes.size(); ++v) {
+        Lane& lane = state->lanes[v];
+        if(lane.busy) {
+            continue;
+        }
+
+        vector<int> records;
+        for(int frame = current_frame_ + 1; frame <= last_frame; ++frame) {
+            const int record = reader->record_at(static_cast<int>(v), frame);
+            if(record >= 0 && record != lane.shown_record &&
+               lane.ready.count(record) == 0 &&
+               (records.empty() || records.back() != record)) {
+                records.push_back(record);
+            }
+        }
+        if(records.empty()) {
+            continue;
+        }
+
+        lane.busy = true;
+        lane.preempted = false;
+        ++state->pending_tasks;
+        const int generation = state->generation;
+        const int variable = static_cast<int>(v);
+
+        pool_.submit([state, reader, variable, records, generation]() {
+            unique_lock<mutex> lock(state->mtx);
+            Lane& lane = state->lanes[variable];
+
+            for(int record: records) {
+                if(state->cancelled || state->generation != generation ||
+                   lane.preempted) {
+                    break;
+                }
+
+                lock.unlock();
+                BufferRequestMessage request;
+                bool ok = reader->decode(record, lane.decoder);
+                if(ok) {
+                    request = make_request(*reader, variable, record,
+                                           lane.decoder);
+                }
+                lock.lock();
+
+                if(!ok) {
+                    break;
+                }
+                lane.ready[record] = std::move(request);
+                state->cv.notify_all();
+            }
+
+            lane.busy = false;
+            lane.preempted = false;
+            --state->pending_tasks;
+            state->cv.notify_all();
+        });
+    }
+}
+
+BufferRequestMessage JournalPlayer::make_request(const JournalReader& reader,
+                                                 int variable,
+                                                 int record,
+                                                 const JournalReader::Decoder& decoder) {
+    const JournalRecordHeader& header = reader.header(record);
+    const size_t size = decoder.pixels.size();
+
+    // The decoder keeps changing as the next records are decoded, so the
+    // buffer shown is a copy
+    shared_ptr<uint8_t> pixels(new uint8_t[size], [](uint8_t* pixels) {
+        delete[] pixels;
+    });
+    memcpy(pixels.get(), decoder.pixels.data(), size);
+
+    BufferRequestMessage request;
+    request.var_name_str = reader.variables()[variable];
+    request.buffer_owner = pixels;
+    request.buffer = pixels.get();
+    request.width_i = header.width;
+    request.height_i = header.height;
+    request.channels = header.channels;
+    request.type = static_cast<Buffer::BufferType>(header.type);
+    request.step = header.width;
+    request.pixel_layout = string(header.pixel_layout,
+                                  strnlen(header.pixel_layout,
+                                          sizeof(header.pixel_layout)));
+    request.replayed = true;
+    return request;
+}
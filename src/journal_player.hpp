@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ingest_pipeline.hpp"
+#include "journal_reader.hpp"
+#include "thread_pool.hpp"
+
+/*
+ * Shows the frames of a journal as regular buffer updates, without an
+ * inferior. Frames are shown by a thread of the player, which only decodes
+ * the buffers that changed since the frame shown before.
+ *
+ * While playing, the frames ahead of the one shown are decoded on the
+ * thread pool, up to prefetch_frames of them. The records of a variable
+ * depend on each other, so each variable is decoded by a task of its own;
+ * playback keeps up with the frame rate as long as the decoding does on
+ * average. Frames that the GUI can't keep up with are superseded in the
+ * ingest pipeline, as during a stream of stops.
+ */
+class JournalPlayer {
+public:
+    typedef std::function<void(const BufferRequestMessage&)> Delivery;
+
+    static const int prefetch_frames = 8;
+
+    // deliver is called from the player thread with the buffers of each
+    // frame shown
+    JournalPlayer(ThreadPool& pool, Delivery deliver);
+
+    ~JournalPlayer();
+
+    // Replaces the journal being played, and shows its first frame.
+    // Returns false if the file is not a journal.
+    bool open(const std::string& path);
+
+    int num_frames();
+
+    // Frame shown last, or being shown
+    int current_frame();
+
+    // Only the last frame requested is shown if the player is busy
+    void show(int frame);
+
+    // Plays from the current frame on, until the last one
+    void play(double frames_per_second);
+
+    void pause();
+
+    bool playing();
+
+private:
+    // Decoding of a variable, which belongs to the task that set busy, or
+    // to the player thread if none did
+    struct Lane {
+        JournalReader::Decoder decoder;
+        // Decoded records ahead of the one shown
+        std::map<int, BufferRequestMessage> ready;
+        // Record shown last
+        int shown_record = -1;
+        bool busy = false;
+        // Tells the task to hand the decoder back after its current record
+        bool preempted = false;
+    };
+
+    // Shared with the prefetch tasks, which may still be queued in the pool
+    // when the player goes away
+    struct State {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::shared_ptr<const JournalReader> reader;
+        std::vector<Lane> lanes;
+        // Changed whenever a journal is opened, so that the tasks working
+        // for the previous one stop
+        int generation = 0;
+        // Submitted to the pool, whether they started or not
+        int pending_tasks = 0;
+        bool cancelled = false;
+    };
+
+    ThreadPool& pool_;
+    Delivery deliver_;
+    std::shared_ptr<State> state_;
+
+    // Guarded by the mutex of the state
+    int current_frame_ = -1;
+    int requested_frame_ = -1;
+    bool playing_ = false;
+    std::chrono::steady_clock::duration frame_period_;
+    std::chrono::steady_clock::time_point next_frame_time_;
+    bool stopping_ = false;
+
+    std::thread worker_;
+
+    void player_loop();
+
+    // Called with the lock held, which is released while decoding and
+    // delivering
+    void present(int frame, std::unique_lock<std::mutex>& lock);
+
+    // Called with the lock held
+    void prefetch();
+
+    static BufferRequestMessage make_request(const JournalReader& reader,
+                                             int variable,
+                                             int record,
+                                             const JournalReader::Decoder& decoder);
+};
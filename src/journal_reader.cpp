@@ -0,0 +1,340 @@
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal_reader.hpp"
+#include "lz_codec.hpp"
+
+using namespace std;
+
+namespace {
+
+const uint32_t max_name_size = 4096;
+
+size_t element_size(Buffer::BufferType type) {
+    switch(type) {
+    case Buffer::BufferType::UnsignedShort:
+    case Buffer::BufferType::Short:
+        return 2;
+    case Buffer::BufferType::Int32:
+    case Buffer::BufferType::Float32:
+        return 4;
+    case Buffer::BufferType::Float64:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+bool valid_type(int32_t type) {
+    switch(static_cast<Buffer::BufferType>(type)) {
+    case Buffer::BufferType::UnsignedByte:
+    case Buffer::BufferType::UnsignedShort:
+    case Buffer::BufferType::Short:
+    case Buffer::BufferType::Int32:
+    case Buffer::BufferType::Float32:
+    case Buffer::BufferType::Float64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// dst ^= src
+void xor_bytes(uint8_t* dst, const uint8_t* src, size_t size) {
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for(; i < size; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+} // namespace
+
+JournalReader::JournalReader() {}
+
+JournalReader::~JournalReader() {
+    close();
+}
+
+bool JournalReader::open(const string& path) {
+    close();
+
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd_ < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    uint32_t file_header[2];
+    if(fstat(fd_, &file_stat) != 0 ||
+       static_cast<size_t>(file_stat.st_size) < sizeof(file_header)) {
+        close();
+        return false;
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if(data == MAP_FAILED) {
+        data_ = nullptr;
+        close();
+        return false;
+    }
+    data_ = static_cast<uint8_t*>(data);
+
+    memcpy(file_header, data_, sizeof(file_header));
+    if(file_header[0] != journal_magic || file_header[1] != journal_version) {
+        close();
+        return false;
+    }
+
+    // The index of a closed journal lists the records; otherwise they are
+    // walked over until one doesn't fit
+    JournalTrailer trailer;
+    bool indexed = false;
+    if(size_ >= sizeof(file_header) + sizeof(trailer)) {
+        memcpy(&trailer, data_ + size_ - sizeof(trailer), sizeof(trailer));
+        const uint64_t index_end = size_ - sizeof(trailer);
+        indexed = trailer.magic == journal_trailer_magic &&
+                  trailer.index_offset <= index_end &&
+                  trailer.num_records ==
+                      (index_end - trailer.index_offset) / sizeof(uint64_t) &&
+                  index_end - trailer.index_offset ==
+                      trailer.num_records * sizeof(uint64_t);
+    }
+
+    if(indexed) {
+        records_.reserve(trailer.num_records);
+        for(uint64_t i = 0; i < trailer.num_records; ++i) {
+            uint64_t offset;
+            memcpy(&offset, data_ + trailer.index_offset + i * sizeof(offset),
+                   sizeof(offset));
+            if(!add_record(offset)) {
+                break;
+            }
+        }
+    } else {
+        uint64_t offset = sizeof(file_header);
+        while(add_record(offset)) {
+            const JournalRecordHeader& header = records_.back().header;
+            offset += sizeof(header) + header.name_size + header.data_size;
+        }
+    }
+
+    build_frames();
+    return true;
+}
+
+void JournalReader::close() {
+    if(data_ != nullptr) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if(fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    records_.clear();
+    variables_.clear();
+    frame_records_.clear();
+    num_frames_ = 0;
+}
+
+bool JournalReader::add_record(uint64_t offset) {
+    Record record;
+    if(offset > size_ || size_ - offset < sizeof(record.header)) {
+        return false;
+    }
+    memcpy(&record.header, data_ + offset, sizeof(record.header));
+
+    const JournalRecordHeader& header = record.header;
+    const uint64_t available = size_ - offset - sizeof(header);
+    if(header.magic != journal_record_magic ||
+       header.name_size == 0 || header.name_size > max_name_size ||
+       header.name_size > available ||
+       header.data_size > available - header.name_size ||
+       header.width <= 0 || header.height <= 0 ||
+       header.channels < 1 || header.channels > 4 ||
+       !valid_type(header.type)) {
+        return false;
+    }
+
+    record.data = data_ + offset + sizeof(header) + header.name_size;
+    record.variable = -1;
+    record.previous = -1;
+    records_.push_back(record);
+    return true;
+}
+
+void JournalReader::build_frames() {
+    map<string, int> variable_indices;
+    vector<int> last_records;
+    // Frame of the last record of each variable
+    vector<int> last_frames;
+    vector<int> record_frames(records_.size());
+
+    // A frame ends when any of the traced breakpoints is hit again, since
+    // hits are counted over all of them, or when a variable shows up twice
+    int frame = -1;
+    uint64_t frame_hit = 0;
+    for(size_t i = 0; i < records_.size(); ++i) {
+        Record& record = records_[i];
+        const char* name = reinterpret_cast<const char*>(record.data) -
+                           record.header.name_size;
+        string var_name(name, record.header.name_size);
+
+        auto found = variable_indices.find(var_name);
+        if(found == variable_indices.end()) {
+            found = variable_indices.emplace(var_name, variables_.size()).first;
+            variables_.push_back(var_name);
+            last_records.push_back(-1);
+            last_frames.push_back(-1);
+        }
+        record.variable = found->second;
+        record.previous = last_records[record.variable];
+
+        if(frame < 0 || record.header.hit != frame_hit ||
+           last_frames[record.variable] == frame) {
+            ++frame;
+            frame_hit = record.header.hit;
+        }
+        last_records[record.variable] = static_cast<int>(i);
+        last_frames[record.variable] = frame;
+        record_frames[i] = frame;
+    }
+    num_frames_ = frame + 1;
+
+    // A variable keeps showing its last record in the frames that didn't
+    // capture it
+    frame_records_.assign(variables_.size(), vector<int>(num_frames_, -1));
+    for(size_t i = 0; i < records_.size(); ++i) {
+        frame_records_[records_[i].variable][record_frames[i]] =
+                static_cast<int>(i);
+    }
+    for(vector<int>& shown: frame_records_) {
+        for(int f = 1; f < num_frames_; ++f) {
+            if(shown[f] == -1) {
+                shown[f] = shown[f - 1];
+            }
+        }
+    }
+}
+
+int JournalReader::num_frames() const {
+    return num_frames_;
+}
+
+const vector<string>& JournalReader::variables() const {
+    return variables_;
+}
+
+int JournalReader::record_at(int variable, int frame) const {
+    if(variable < 0 || variable >= static_cast<int>(variables_.size()) ||
+       frame < 0 || frame >= num_frames_) {
+        return -1;
+    }
+    return frame_records_[variable][frame];
+}
+
+const JournalRecordHeader& JournalReader::header(int record) const {
+    return records_[record].header;
+}
+
+size_t JournalReader::pixels_size(int record) const {
+    const JournalRecordHeader& header = records_[record].header;
+    return static_cast<size_t>(header.width) * header.height *
+           header.channels *
+           element_size(static_cast<Buffer::BufferType>(header.type));
+}
+
+bool JournalReader::decode(int record, Decoder& decoder) const {
+    if(record < 0 || record >= static_cast<int>(records_.size())) {
+        return false;
+    }
+    if(decoder.record == record) {
+        return true;
+    }
+
+    // Records to apply from the last keyframe, newest first, unless the
+    // decoder already holds one of them
+    vector<int> chain;
+    bool from_decoder = false;
+    for(int r = record;;) {
+        if(r == decoder.record) {
+            from_decoder = true;
+            break;
+        }
+        chain.push_back(r);
+        if(records_[r].header.keyframe) {
+            break;
+        }
+        r = records_[r].previous;
+        if(r < 0) {
+            // A delta with nothing to apply it to
+            decoder.record = -1;
+            return false;
+        }
+    }
+
+    // Deltas go both ways, so a later record of the same variable is a
+    // starting point as long as no keyframe lies in between
+    vector<int> backward;
+    if(!from_decoder && decoder.record > record &&
+       records_[decoder.record].variable == records_[record].variable) {
+        int r = decoder.record;
+        while(r > record && !records_[r].header.keyframe &&
+              backward.size() < chain.size()) {
+            backward.push_back(r);
+            r = records_[r].previous;
+        }
+        if(r != record) {
+            backward.clear();
+        }
+    }
+
+    bool ok = true;
+    if(!backward.empty()) {
+        for(int r: backward) {
+            ok = ok && apply(r, decoder);
+        }
+    } else {
+        for(auto r = chain.rbegin(); r != chain.rend(); ++r) {
+            ok = ok && apply(*r, decoder);
+        }
+    }
+
+    decoder.record = ok ? record : -1;
+    return ok;
+}
+
+bool JournalReader::apply(int record, Decoder& decoder) const {
+    const Record& source = records_[record];
+    const size_t size = pixels_size(record);
+
+    if(source.header.keyframe) {
+        decoder.pixels.resize(size);
+        return lz_decompress(source.data, source.header.data_size,
+                             decoder.pixels.data(), size);
+    }
+
+    if(decoder.pixels.size() != size) {
+        return false;
+    }
+    decoder.scratch.resize(size);
+    if(!lz_decompress(source.data, source.header.data_size,
+                      decoder.scratch.data(), size)) {
+        return false;
+    }
+    xor_bytes(decoder.pixels.data(), decoder.scratch.data(), size);
+    return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "trace_journal.hpp"
+
+/*
+ * Read access to a journal written by TraceJournal. The file is mapped into
+ * memory, so opening it only reads its index and the record headers; pixels
+ * are only decompressed when a buffer is decoded.
+ *
+ * Records are grouped into frames, one per breakpoint hit. The record that
+ * holds a variable in any frame is looked up in a table, and decoding it
+ * only takes the records since the last keyframe of the variable, whose
+ * number TraceJournal bounds. A journal that wasn't closed has no index, so
+ * its records are walked over when it is opened, up to the first incomplete
+ * one.
+ *
+ * The reader doesn't change once open, so several threads may decode from
+ * it at once, each with a Decoder of its own.
+ */
+class JournalReader {
+public:
+    // Contents of the record of a variable decoded last. Decoding a record
+    // close to it, in either direction, starts from there.
+    struct Decoder {
+        int record = -1;
+        // Packed with a step of width
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> scratch;
+    };
+
+    JournalReader();
+
+    ~JournalReader();
+
+    // Returns false if the file is not a journal
+    bool open(const std::string& path);
+
+    int num_frames() const;
+
+    const std::vector<std::string>& variables() const;
+
+    // Record of a variable shown in a frame: the one captured in that frame,
+    // or the last one before it. Returns -1 if the variable wasn't captured
+    // yet.
+    int record_at(int variable, int frame) const;
+
+    const JournalRecordHeader& header(int record) const;
+
+    // Size of the pixels of a record once decoded
+    size_t pixels_size(int record) const;
+
+    // Returns false if the record is corrupt
+    bool decode(int record, Decoder& decoder) const;
+
+private:
+    struct Record {
+        // Copied out of the file, where it may not be aligned
+        JournalRecordHeader header;
+        const uint8_t* data;
+        int variable;
+        // Previous record of the same variable, -1 if none
+        int previous;
+    };
+
+    int fd_ = -1;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+
+    std::vector<Record> records_;
+    std::vector<std::string> variables_;
+    // Record shown for each frame, indexed by [variable][frame]
+    std::vector<std::vector<int>> frame_records_;
+    int num_frames_ = 0;
+
+    void close();
+
+    // Returns false if the record at offset doesn't fit in the file or
+    // doesn't describe a buffer
+    bool add_record(uint64_t offset);
+
+    // Groups the records into frames once they are all known
+    void build_frames();
+
+    // Decompresses a record over the pixels of the decoder: a keyframe
+    // replaces them, and a delta is XOR-ed into them, which goes from the
+    // previous record to this one or back
+    bool apply(int record, Decoder& decoder) const;
+};
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cstring>
+
+#include "lz_codec.hpp"
+
+using namespace std;
+
+namespace {
+
+const size_t min_match = 4;
+const size_t max_offset = 65535;
+const int hash_bits = 16;
+
+// Matches are not searched within the last bytes, so the last sequence
+// always has some literals and the match search never reads past the end
+const size_t end_literals = 8;
+
+inline uint32_t read_u32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read_u64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash_u32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+void write_length(vector<uint8_t>& dst, size_t length) {
+    while(length >= 255) {
+        dst.push_back(255);
+        length -= 255;
+    }
+    dst.push_back(static_cast<uint8_t>(length));
+}
+
+void write_sequence(vector<uint8_t>& dst,
+                    const uint8_t* literals,
+                    size_t num_literals,
+                    size_t offset,
+                    size_t match_length) {
+    const size_t literal_nibble = std::min<size_t>(num_literals, 15);
+    const size_t match_nibble = match_length == 0 ?
+                                0 : std::min<size_t>(match_length - min_match, 15);
+    dst.push_back(static_cast<uint8_t>((literal_nibble << 4) | match_nibble));
+
+    if(literal_nibble == 15) {
+        write_length(dst, num_literals - 15);
+    }
+    dst.insert(dst.end(), literals, literals + num_literals);
+
+    if(match_length == 0) {
+        return;
+    }
+    dst.push_back(static_cast<uint8_t>(offset & 0xff));
+    dst.push_back(static_cast<uint8_t>(offset >> 8));
+    if(match_nibble == 15) {
+        write_length(dst, match_length - min_match - 15);
+    }
+}
+
+bool read_length(const uint8_t*& src, const uint8_t* src_end, size_t& length) {
+    uint8_t byte;
+    do {
+        if(src == src_end) {
+            return false;
+        }
+        byte = *src++;
+        length += byte;
+    } while(byte == 255);
+    return true;
+}
+
+} // namespace
+
+void lz_compress(const uint8_t* src, size_t size, vector<uint8_t>& dst) {
+    dst.clear();
+    dst.reserve(size / 4 + 16);
+
+    // Positions are stored plus one, so that 0 means empty
+    vector<uint32_t> table(1 << hash_bits, 0);
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    // Incompressible data is skipped over faster the longer it lasts
+    size_t misses = 0;
+
+    while(size >= end_literals && pos + end_literals <= size) {
+        const uint32_t sequence = read_u32(src + pos);
+        const uint32_t h = hash_u32(sequence);
+        const size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(pos + 1);
+
+        if(candidate == 0 || pos - (candidate - 1) > max_offset ||
+           read_u32(src + candidate - 1) != sequence) {
+            pos += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        const size_t match = candidate - 1;
+        const size_t limit = size - end_literals;
+        size_t length = min_match;
+        while(pos + length + 8 <= limit &&
+              read_u64(src + match + length) == read_u64(src + pos + length)) {
+            length += 8;
+        }
+        while(pos + length < limit && src[match + length] == src[pos + length]) {
+            ++length;
+        }
+
+        write_sequence(dst, src + anchor, pos - anchor, pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    write_sequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+bool lz_decompress(const uint8_t* src,
+                   size_t size,
+                   uint8_t* dst,
+                   size_t dst_size) {
+    const uint8_t* src_end = src + size;
+    size_t out = 0;
+
+    while(src < src_end) {
+        const uint8_t token = *src++;
+
+        size_t num_literals = token >> 4;
+        if(num_literals == 15 && !read_length(src, src_end, num_literals)) {
+            return false;
+        }
+        if(num_literals > static_cast<size_t>(src_end - src) ||
+           num_literals > dst_size - out) {
+            return false;
+        }
+        memcpy(dst + out, src, num_literals);
+        src += num_literals;
+        out += num_literals;
+
+        if(src == src_end) {
+            // Last sequence
+            break;
+        }
+
+        if(src_end - src < 2) {
+            return false;
+        }
+        const size_t offset = src[0] | (static_cast<size_t>(src[1]) << 8);
+        src += 2;
+
+        size_t match_length = (token & 15);
+        if(match_length == 15 && !read_length(src, src_end, match_length)) {
+            return false;
+        }
+        match_length += min_match;
+
+        if(offset == 0 || offset > out || match_length > dst_size - out) {
+            return false;
+        }
+
+        // The match may overlap the bytes it produces, which repeats them
+        const uint8_t* match = dst + out - offset;
+        if(offset >= match_length) {
+            memcpy(dst + out, match, match_length);
+        } else {
+            for(size_t i = 0; i < match_length; ++i) {
+                dst[out + i] = match[i];
+            }
+        }
+        out += match_length;
+    }
+
+    return out == dst_size;
+}
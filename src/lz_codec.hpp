@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Byte oriented LZ77 codec, in the spirit of LZ4: the input is encoded as
+ * sequences of literals followed by a copy of earlier output, found through
+ * a hash table of 4 byte prefixes. It trades ratio for speed, and does well
+ * on the long runs of zeros left by XOR-ing two versions of a buffer.
+ *
+ * Each sequence starts with a token whose high nibble is the number of
+ * literals and whose low nibble is the match length minus 4; a nibble of 15
+ * is extended by the following bytes, 255 meaning that yet another byte
+ * follows. The literals come next, then the 16 bit little endian offset of
+ * the match and its length extension. The last sequence only has literals.
+ */
+
+void lz_compress(const uint8_t* src, size_t size, std::vector<uint8_t>& dst);
+
+// Returns false if src is not a valid encoding of exactly dst_size bytes
+bool lz_decompress(const uint8_t* src,
+                   size_t size,
+                   uint8_t* dst,
+                   size_t dst_size);
@@ -16,6 +16,8 @@
 #include "math.hpp"
 #include "shader.hpp"
 #include "mainwindow.h"
+#include "managed_pointer.h"
+#include "trace_journal.hpp"
 
 
 using namespace std;
@@ -24,7 +26,7 @@ extern "C" {
     void initialize_window(int(*plot_callback)(const char*));
     void terminate();
     bool is_running();
-    void update_available_variables(PyObject* available_set);
+    PyObject* update_available_variables(PyObject* available_vars);
     void plot_binary(PyObject* pybuffer,
                      PyObject* var_name,
                      int buffer_width_i,
@@ -33,6 +35,39 @@ extern "C" {
                      int type,
                      int step,
                      PyObject* pixel_layout);
+    bool plot_inferior_buffer(int pid,
+                              unsigned long long address,
+                              PyObject* var_name,
+                              int buffer_width_i,
+                              int buffer_height_i,
+                              int channels,
+                              int type,
+                              int step,
+                              PyObject* pixel_layout);
+    void finish_inferior_reads(int pid);
+    void invalidate_inferior_memory();
+    bool open_trace_journal(const char* path);
+    long long close_trace_journal();
+    void replay_journal(const char* path);
+    bool trace_inferior_buffer(unsigned long long hit,
+                               int pid,
+                               unsigned long long address,
+                               PyObject* var_name,
+                               int buffer_width_i,
+                               int buffer_height_i,
+                               int channels,
+                               int type,
+                               int step,
+                               PyObject* pixel_layout);
+    void trace_binary(unsigned long long hit,
+                      PyObject* pybuffer,
+                      PyObject* var_name,
+                      int buffer_width_i,
+                      int buffer_height_i,
+                      int channels,
+                      int type,
+                      int step,
+                      PyObject* pixel_layout);
     void update_plot(PyObject* pybuffer,
                      PyObject* var_name,
                      int buffer_width_i,
@@ -45,13 +80,19 @@ extern "C" {
 
 MainWindow* wnd = nullptr;
 bool is_running_ = false;
+// Journal written by the trace breakpoints, which don't need the window
+unique_ptr<TraceJournal> trace_journal;
 
 bool is_running() {
     return is_running_;
 }
 
-void update_available_variables(PyObject* available_set) {
-    wnd->update_available_variables(available_set);
+PyObject* update_available_variables(PyObject* available_vars) {
+    // ctypes releases the GIL during the call
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+    PyObject* requested_vars = wnd->update_available_variables(available_vars);
+    PyGILState_Release(gil_state);
+    return requested_vars;
 }
 
 void update_plot(PyObject* pybuffer,
@@ -73,6 +114,29 @@ void update_plot(PyObject* pybuffer,
                 pixel_layout);
 }
 
+// Decodes the names that come from Python objects. ctypes releases the GIL
+// during the calls into the library, so it is taken here.
+void decode_names(PyObject* var_name,
+                  PyObject* pixel_layout,
+                  string& var_name_str,
+                  string& pixel_layout_str)
+{
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+
+    PyObject *var_name_bytes = PyUnicode_AsEncodedString(var_name,
+                                                         "ASCII",
+                                                         "strict");
+    PyObject *pixel_layout_bytes = PyUnicode_AsEncodedString(pixel_layout,
+                                                             "ASCII",
+                                                             "strict");
+    var_name_str = PyBytes_AS_STRING(var_name_bytes);
+    pixel_layout_str = PyBytes_AS_STRING(pixel_layout_bytes);
+    Py_DECREF(var_name_bytes);
+    Py_DECREF(pixel_layout_bytes);
+
+    PyGILState_Release(gil_state);
+}
+
 void plot_binary(PyObject* pybuffer,
                  PyObject* var_name,
                  int buffer_width_i,
@@ -82,22 +146,21 @@ void plot_binary(PyObject* pybuffer,
                  int step,
                  PyObject* pixel_layout)
 {
-    PyObject *var_name_bytes = PyUnicode_AsEncodedString(var_name,
-                                                         "ASCII",
-                                                         "strict");
-    PyObject *pixel_layout_bytes = PyUnicode_AsEncodedString(pixel_layout,
-                                                             "ASCII",
-                                                             "strict");
-
     BufferRequestMessage request;
-    request.var_name_str = PyBytes_AS_STRING(var_name_bytes);
-    request.py_buffer = pybuffer;
+    decode_names(var_name, pixel_layout,
+                 request.var_name_str, request.pixel_layout);
+
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+    Py_INCREF(pybuffer);
+    request.buffer_owner = makeSharedPyObject(pybuffer);
+    request.buffer = reinterpret_cast<uint8_t*>(PyMemoryView_GET_BUFFER(pybuffer)->buf);
+    PyGILState_Release(gil_state);
+
     request.width_i = buffer_width_i;
     request.height_i = buffer_height_i;
     request.channels = channels;
     request.type = static_cast<Buffer::BufferType>(type);
     request.step = step;
-    request.pixel_layout = PyBytes_AS_STRING(pixel_layout_bytes);
 
     while(wnd == nullptr) {
         usleep(1e6 / 30);
@@ -106,6 +169,147 @@ void plot_binary(PyObject* pybuffer,
     wnd->plot_buffer(request);
 }
 
+bool plot_inferior_buffer(int pid,
+                          unsigned long long address,
+                          PyObject* var_name,
+                          int buffer_width_i,
+                          int buffer_height_i,
+                          int channels,
+                          int type,
+                          int step,
+                          PyObject* pixel_layout)
+{
+    InferiorBuffer source;
+    source.pid = pid;
+    source.address = address;
+    source.width = buffer_width_i;
+    source.height = buffer_height_i;
+    source.channels = channels;
+    source.type = static_cast<Buffer::BufferType>(type);
+    source.step = step;
+    decode_names(var_name, pixel_layout, source.var_name, source.pixel_layout);
+
+    while(wnd == nullptr) {
+        usleep(1e6 / 30);
+    }
+
+    // The pixels go straight into storage owned by the viewer; the caller
+    // falls back to reading them through the debugger if this fails
+    return wnd->plot_inferior_buffer(source);
+}
+
+void finish_inferior_reads(int pid)
+{
+    // The pages the inferior writes to are tracked from the end of the stop
+    if(wnd != nullptr) {
+        wnd->finish_inferior_reads(pid);
+    }
+}
+
+void invalidate_inferior_memory()
+{
+    if(wnd != nullptr) {
+        wnd->invalidate_inferior_memory();
+    }
+}
+
+bool open_trace_journal(const char* path)
+{
+    // A previous journal is finished before the file is opened, in case it
+    // is the same one
+    trace_journal.reset();
+    trace_journal.reset(new TraceJournal(path));
+    if(!trace_journal->is_open()) {
+        trace_journal.reset();
+        return false;
+    }
+    return true;
+}
+
+// Returns the number of frames written, or -1 if the journal couldn't be
+// written whole
+long long close_trace_journal()
+{
+    if(trace_journal == nullptr) {
+        return 0;
+    }
+
+    // Waits for the frames still queued
+    bool ok = trace_journal->close();
+    long long frames = static_cast<long long>(trace_journal->frames_written());
+    trace_journal.reset();
+    return ok ? frames : -1;
+}
+
+bool trace_inferior_buffer(unsigned long long hit,
+                           int pid,
+                           unsigned long long address,
+                           PyObject* var_name,
+                           int buffer_width_i,
+                           int buffer_height_i,
+                           int channels,
+                           int type,
+                           int step,
+                           PyObject* pixel_layout)
+{
+    if(trace_journal == nullptr) {
+        return false;
+    }
+
+    InferiorBuffer source;
+    source.pid = pid;
+    source.address = address;
+    source.width = buffer_width_i;
+    source.height = buffer_height_i;
+    source.channels = channels;
+    source.type = static_cast<Buffer::BufferType>(type);
+    source.step = step;
+    decode_names(var_name, pixel_layout, source.var_name, source.pixel_layout);
+
+    return trace_journal->capture(hit, source);
+}
+
+void trace_binary(unsigned long long hit,
+                  PyObject* pybuffer,
+                  PyObject* var_name,
+                  int buffer_width_i,
+                  int buffer_height_i,
+                  int channels,
+                  int type,
+                  int step,
+                  PyObject* pixel_layout)
+{
+    if(trace_journal == nullptr) {
+        return;
+    }
+
+    string var_name_str;
+    string pixel_layout_str;
+    decode_names(var_name, pixel_layout, var_name_str, pixel_layout_str);
+
+    // The caller keeps the buffer alive until the pixels are copied
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(
+            PyMemoryView_GET_BUFFER(pybuffer)->buf);
+    PyGILState_Release(gil_state);
+
+    trace_journal->capture(hit, var_name_str,
+                           buffer_width_i, buffer_height_i,
+                           channels, static_cast<Buffer::BufferType>(type),
+                           step, pixel_layout_str, pixels);
+}
+
+void replay_journal(const char* path)
+{
+    while(wnd == nullptr) {
+        usleep(1e6 / 30);
+    }
+
+    // Opening the journal touches the GUI, so it happens on its thread
+    QMetaObject::invokeMethod(wnd, "open_journal", Qt::QueuedConnection,
+                              Q_ARG(QString, QString::fromUtf8(path)));
+}
+
 void signalHandler( int signum )
 {
 #ifndef NDEBUG
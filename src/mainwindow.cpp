@@ -1,16 +1,26 @@
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <iomanip>
 
 #include <QShortcut>
 #include <QAction>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
 #include <QFileDialog>
+#include <QFormLayout>
+#include <QPushButton>
 #include <QSettings>
 #include <QStandardPaths>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "buffer_exporter.hpp"
+#include "buffer_history.hpp"
 #include "managed_pointer.h"
+#include "texture_format.hpp"
+#include "tile_analysis.hpp"
 
 Q_DECLARE_METATYPE(QList<QString>)
 
@@ -18,16 +28,44 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     currently_selected_stage_(nullptr),
     completer_updated_(false),
+    render_requested_(true),
     ui_(new Ui::MainWindow),
     ac_enabled_(true),
     link_views_enabled_(false),
+    contrast_low_percentile_(0.f),
+    contrast_high_percentile_(100.f),
     plot_callback_(nullptr)
 {
     ui_->setupUi(this);
     ui_->splitter->setSizes({210, 100000000});
 
+    update_timer_.setSingleShot(true);
     connect(&update_timer_, SIGNAL(timeout()), this, SLOT(loop()));
 
+    // Buffers are prepared by the workers of the canvas, which wake the
+    // loop up as they finish
+    ingest_.reset(new IngestPipeline(ui_->bufferPreview->thread_pool(),
+                                     ui_->bufferPreview->tile_store(), [this]() {
+        QMetaObject::invokeMethod(this, "schedule_loop", Qt::QueuedConnection);
+    }));
+    region_fetcher_.reset(new RegionFetcher([this](const BufferRequestMessage& request) {
+        plot_buffer(request);
+    }));
+    history_.reset(new BufferHistory([this](const BufferRequestMessage& request) {
+        ingest_->push(request);
+        QMetaObject::invokeMethod(this, "schedule_loop", Qt::QueuedConnection);
+    }, [this]() {
+        QMetaObject::invokeMethod(this, "schedule_loop", Qt::QueuedConnection);
+    }));
+    history_at_newest_ = true;
+    history_version_ = 0;
+    journal_player_.reset(new JournalPlayer(ui_->bufferPreview->thread_pool(),
+                                            [this](const BufferRequestMessage& request) {
+        ingest_->push(request);
+        QMetaObject::invokeMethod(this, "schedule_loop", Qt::QueuedConnection);
+    }));
+    journal_frames_per_second_ = 30.0;
+
     symbol_list_focus_shortcut_ = shared_ptr<QShortcut>(new QShortcut(QKeySequence(Qt::CTRL|Qt::Key_K), this));
     connect(symbol_list_focus_shortcut_.get(), SIGNAL(activated()), ui_->symbolList, SLOT(setFocus()));
 
@@ -76,6 +114,10 @@ MainWindow::MainWindow(QWidget *parent) :
 
     connect(ui_->rotate_90_cw, SIGNAL(clicked()), this, SLOT(rotate_90_cw()));
     connect(ui_->rotate_90_ccw, SIGNAL(clicked()), this, SLOT(rotate_90_ccw()));
+    connect(ui_->historySlider, SIGNAL(valueChanged(int)), this, SLOT(history_version_selected(int)));
+    connect(ui_->journalOpen, SIGNAL(clicked()), this, SLOT(choose_journal()));
+    connect(ui_->journalPlay, SIGNAL(toggled(bool)), this, SLOT(journal_play_toggled(bool)));
+    connect(ui_->journalSlider, SIGNAL(valueChanged(int)), this, SLOT(journal_frame_selected(int)));
 
     status_bar = new QLabel();
     status_bar->setAlignment(Qt::AlignRight);
@@ -86,6 +128,86 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui_->imageList, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(show_context_menu(const QPoint&)));
 
     load_previous_session_symbols();
+
+    load_rendering_settings();
+}
+
+void MainWindow::load_rendering_settings() {
+    QSettings settings("gdbimagewatch.cfg", QSettings::NativeFormat);
+
+    // GPU memory available to buffer tiles before they start being evicted
+    const int default_budget_mb = static_cast<int>(TileCache::default_budget >> 20);
+    int budget_mb = settings.value("Rendering/gpu_memory_budget_mb",
+                                   default_budget_mb).toInt();
+    if(budget_mb <= 0) {
+        budget_mb = default_budget_mb;
+    }
+    settings.setValue("Rendering/gpu_memory_budget_mb", budget_mb);
+    settings.sync();
+
+    // The budget is split in halves: one for the tiles of virtual textures,
+    // the other for the textures of the other buffers, so that both together
+    // stay within it
+    const size_t gpu_budget = static_cast<size_t>(budget_mb) << 20;
+    ui_->bufferPreview->tile_cache().set_budget(gpu_budget / 2);
+
+    // Memory held by the plotted buffers before the least recently viewed
+    // ones are evicted
+    const int default_cpu_budget_mb =
+            static_cast<int>(MemoryManager::default_cpu_budget >> 20);
+    int cpu_budget_mb = settings.value("Memory/cpu_budget_mb",
+                                       default_cpu_budget_mb).toInt();
+    if(cpu_budget_mb <= 0) {
+        cpu_budget_mb = default_cpu_budget_mb;
+    }
+    settings.setValue("Memory/cpu_budget_mb", cpu_budget_mb);
+    settings.sync();
+
+    memory_manager_.set_budgets(static_cast<size_t>(cpu_budget_mb) << 20,
+                                gpu_budget - gpu_budget / 2);
+
+    // Memory taken by the compressed earlier versions of the buffers
+    const int default_history_budget_mb =
+            static_cast<int>(BufferHistory::default_budget >> 20);
+    int history_budget_mb = settings.value("Memory/history_budget_mb",
+                                           default_history_budget_mb).toInt();
+    if(history_budget_mb < 0) {
+        history_budget_mb = default_history_budget_mb;
+    }
+    settings.setValue("Memory/history_budget_mb", history_budget_mb);
+    settings.sync();
+
+    history_->set_budget(static_cast<size_t>(history_budget_mb) << 20);
+
+    // Rate at which the frames of a journal are played
+    journal_frames_per_second_ = settings.value("Replay/frames_per_second",
+                                                30.0).toDouble();
+    if(journal_frames_per_second_ <= 0.0) {
+        journal_frames_per_second_ = 30.0;
+    }
+    settings.setValue("Replay/frames_per_second", journal_frames_per_second_);
+    settings.sync();
+
+    // Draw pixel value labels with a fragment shader, which keeps their
+    // cost independent of the number of visible pixels
+    bool gpu_value_labels = settings.value("Rendering/gpu_value_labels",
+                                           false).toBool();
+    settings.setValue("Rendering/gpu_value_labels", gpu_value_labels);
+    settings.sync();
+    ui_->bufferPreview->set_gpu_value_labels(gpu_value_labels);
+
+    // Percentiles mapped to the display range by auto contrast
+    contrast_low_percentile_ = settings.value("AutoContrast/low_percentile",
+                                              0.0).toFloat();
+    contrast_high_percentile_ = settings.value("AutoContrast/high_percentile",
+                                               100.0).toFloat();
+}
+
+void MainWindow::apply_contrast_percentiles(Stage* stage) {
+    GameObject* buffer_obj = stage->getGameObject("buffer");
+    Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
+    buffer->set_contrast_percentiles(contrast_low_percentile_,
+                                     contrast_high_percentile_);
 }
 
 void MainWindow::load_previous_session_symbols() {
@@ -106,6 +228,9 @@ void MainWindow::update_session_settings() {
     for(const auto& held_buffer: held_buffers_) {
         currentSessionBuffers.append(held_buffer.first.c_str());
     }
+    for(const auto& evicted_buffer: evicted_buffers_) {
+        currentSessionBuffers.append(evicted_buffer.c_str());
+    }
 
     settings.setValue("PreviousSession/buffers",
                       QVariant::fromValue(currentSessionBuffers));
@@ -115,16 +240,40 @@ void MainWindow::update_session_settings() {
 
 MainWindow::~MainWindow()
 {
+    // The history and journal threads deliver to the ingest
+    // pipeline, whose preparations in progress read the held buffers
+    region_fetcher_.reset();
+    history_.reset();
+    journal_player_.reset();
+    ingest_.reset();
+
+    // Stages own GL resources, so they must go before the GL canvas does,
+    // with its context current
+    ui_->bufferPreview->makeCurrent();
+    currently_selected_stage_ = nullptr;
+    stages_.clear();
     held_buffers_.clear();
 
     delete ui_;
 }
 
 void MainWindow::show() {
-    update_timer_.start(16);
+    request_render();
     QMainWindow::show();
 }
 
+void MainWindow::request_render() {
+    render_requested_ = true;
+    schedule_loop();
+}
+
+void MainWindow::schedule_loop() {
+    // Input events arriving within a frame interval share a single frame
+    if(!update_timer_.isActive()) {
+        update_timer_.start(16);
+    }
+}
+
 void MainWindow::draw()
 {
     if(currently_selected_stage_ != nullptr) {
@@ -136,6 +285,8 @@ void MainWindow::resize_callback(int w, int h)
 {
     for(auto& stage: stages_)
         stage.second->resize_callback(w, h);
+
+    request_render();
 }
 
 void MainWindow::scroll_callback(float delta)
@@ -149,6 +300,7 @@ void MainWindow::scroll_callback(float delta)
     }
 
     update_statusbar();
+    request_render();
 }
 
 void MainWindow::get_observed_variables(PyObject *observed_set)
@@ -175,12 +327,26 @@ void disableInputs(const initializer_list<QLineEdit*>& inputs) {
     }
 }
 
+void show_computing(const initializer_list<QLineEdit*>& inputs) {
+    for(auto& input: inputs) {
+        input->setEnabled(false);
+        input->setText("computing...");
+    }
+}
+
 void MainWindow::reset_ac_min_labels()
 {
     GameObject* buffer_obj = currently_selected_stage_->getGameObject("buffer");
     Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
     float* ac_min = buffer->min_buffer_values();
 
+    if(buffer->stats_pending()) {
+        show_computing({ui_->ac_red_min, ui_->ac_green_min,
+                        ui_->ac_blue_min, ui_->ac_alpha_min});
+        return;
+    }
+
+    ui_->ac_red_min->setEnabled(true);
     ui_->ac_red_min->setText(QString::number(ac_min[0]));
 
     if(buffer->channels == 4) {
@@ -213,6 +379,13 @@ void MainWindow::reset_ac_max_labels()
     Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
     float* ac_max = buffer->max_buffer_values();
 
+    if(buffer->stats_pending()) {
+        show_computing({ui_->ac_red_max, ui_->ac_green_max,
+                        ui_->ac_blue_max, ui_->ac_alpha_max});
+        return;
+    }
+
+    ui_->ac_red_max->setEnabled(true);
     ui_->ac_red_max->setText(QString::number(ac_max[0]));
     if(buffer->channels == 4) {
         enableInputs({ui_->ac_green_max, ui_->ac_blue_max, ui_->ac_alpha_max});
@@ -246,6 +419,8 @@ void MainWindow::mouse_drag_event(int mouse_x, int mouse_y)
     } else if(currently_selected_stage_ != nullptr) {
         currently_selected_stage_->mouse_drag_event(mouse_x, mouse_y);
     }
+
+    request_render();
 }
 
 void MainWindow::mouse_move_event(int, int)
@@ -256,128 +431,478 @@ void MainWindow::mouse_move_event(int, int)
 void MainWindow::plot_buffer(const BufferRequestMessage &buff)
 {
     BufferRequestMessage new_buffer;
-    Py_INCREF(buff.py_buffer);
     new_buffer.var_name_str = buff.var_name_str;
-    new_buffer.py_buffer = buff.py_buffer;
+    new_buffer.buffer_owner = buff.buffer_owner;
+    new_buffer.buffer = buff.buffer;
     new_buffer.width_i = buff.width_i;
     new_buffer.height_i = buff.height_i;
     new_buffer.channels = buff.channels;
     new_buffer.type = buff.type;
     new_buffer.step = buff.step;
     new_buffer.pixel_layout = buff.pixel_layout;
+    new_buffer.version = buff.version;
 
     {
-        std::unique_lock<std::mutex> lock(mtx_);
-        pending_updates_.push_back(new_buffer);
+        std::unique_lock<std::mutex> lock(observed_mtx_);
+        observed_variables_.insert(new_buffer.var_name_str);
     }
 
+    ingest_->push(new_buffer);
+
+    // Called from the debugger thread
+    QMetaObject::invokeMethod(this, "schedule_loop", Qt::QueuedConnection);
+}
+
+bool MainWindow::plot_inferior_buffer(const InferiorBuffer& source)
+{
+    return region_fetcher_->fetch(source);
+}
+
+void MainWindow::finish_inferior_reads(int pid)
+{
+    region_fetcher_->finish_reads(pid);
+}
+
+void MainWindow::invalidate_inferior_memory()
+{
+    region_fetcher_->invalidate();
 }
 
 void MainWindow::loop() {
-    while(!pending_updates_.empty()) {
-        BufferRequestMessage request = pending_updates_.front();
-
-        uint8_t* srcBuffer;
-        shared_ptr<uint8_t> managedBuffer;
-        if(request.type == Buffer::BufferType::Float64) {
-            managedBuffer = makeFloatBufferFromDouble(reinterpret_cast<double*>(PyMemoryView_GET_BUFFER(request.py_buffer)->buf),
-                                                      request.width_i * request.height_i * request.channels);
-            srcBuffer = managedBuffer.get();
-        } else {
-            managedBuffer = makeSharedPyObject(request.py_buffer);
-            srcBuffer = reinterpret_cast<uint8_t*>(PyMemoryView_GET_BUFFER(request.py_buffer)->buf);
-        }
+    // New requests are prepared in the background. Their tiles are compared
+    // against the contents currently displayed, so unchanged tiles are
+    // neither reduced nor uploaded again.
+    for(const BufferRequestMessage& request: ingest_->take_requests()) {
+        shared_ptr<const TileAnalysis> previous_analysis;
+        int tile_size = Buffer::default_max_texture_size;
+        PyramidReduction reduction = PyramidReduction::Average;
 
         auto buffer_stage = stages_.find(request.var_name_str);
-        held_buffers_[request.var_name_str] = managedBuffer;
-        if(buffer_stage == stages_.end()) {
-            // New buffer request
-            shared_ptr<Stage> stage = make_shared<Stage>();
-            if(!stage->initialize(ui_->bufferPreview,
-                                  srcBuffer,
-                                  request.width_i,
-                                  request.height_i,
-                                  request.channels,
-                                  request.type,
-                                  request.step,
-                                  request.pixel_layout,
-                                  ac_enabled_)) {
-                cerr << "[error] Could not initialize opengl canvas!"<<endl;
-            }
-            stages_[request.var_name_str] = stage;
+        if(buffer_stage != stages_.end()) {
+            GameObject* buffer_obj = buffer_stage->second->getGameObject("buffer");
+            Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
+            previous_analysis = buffer->tile_analysis();
+            tile_size = buffer->max_texture_size;
+            reduction = buffer->pyramid_reduction();
+        }
 
-            QImage bufferIcon;
-            ui_->bufferPreview->render_buffer_icon(stage.get());
+        ingest_->prepare(request, previous_analysis, tile_size, reduction);
+    }
 
-            const int icon_width = 200;
-            const int icon_height = 100;
-            const int bytes_per_line = icon_width * 3;
-            bufferIcon = QImage(stage->buffer_icon_.data(), icon_width,
-                                icon_height, bytes_per_line, QImage::Format_RGB888);
+    // Prepared buffers still have to be handed to their stages, which
+    // starts their uploads and statistics. A burst of them is spread over
+    // several frames, so the window keeps responding meanwhile.
+    const auto apply_deadline = chrono::steady_clock::now() +
+                                chrono::milliseconds(8);
+    PreparedBuffer prepared;
+    while(chrono::steady_clock::now() < apply_deadline &&
+          ingest_->take_prepared(prepared)) {
+        apply_prepared_buffer(prepared);
+        request_render();
+    }
 
-            stringstream label;
-            label << request.var_name_str << "\n[" << request.width_i << "x" <<
-                     request.height_i << "]\n" <<
-                     get_type_label(request.type, request.channels);
-            QListWidgetItem* item = new QListWidgetItem(QPixmap::fromImage(bufferIcon),
-                                                        label.str().c_str());
-            item->setData(Qt::UserRole, QString(request.var_name_str.c_str()));
-            item->setFlags(Qt::ItemIsSelectable|Qt::ItemIsEnabled);
-            item->setSizeHint(QSize(205,bufferIcon.height() + 90));
-            item->setTextAlignment(Qt::AlignHCenter);
-            ui_->imageList->addItem(item);
+    // Collect the buffer statistics computed in the background
+    for(auto& stage: stages_) {
+        if(stage.second->poll_buffer_stats()) {
+            if(stage.second.get() == currently_selected_stage_) {
+                reset_ac_min_labels();
+                reset_ac_max_labels();
+                request_render();
+            }
+        }
+    }
 
-            update_session_settings();
+    // Thumbnails rendered while the textures were being streamed contain
+    // placeholders, and thumbnails rendered before the statistics were
+    // available have the wrong contrast. Render them again once both are done.
+    for(auto it = outdated_icons_.begin(); it != outdated_icons_.end();) {
+        auto stage = stages_.find(*it);
+        if(stage == stages_.end()) {
+            it = outdated_icons_.erase(it);
+        } else if(!stage->second->has_pending_uploads() &&
+                  !stage->second->buffer_stats_pending()) {
+            refresh_buffer_icon(*it);
+            it = outdated_icons_.erase(it);
         } else {
-            buffer_stage->second->buffer_update(srcBuffer,
-                                                request.width_i,
-                                                request.height_i,
-                                                request.channels,
-                                                request.type,
-                                                request.step,
-                                                request.pixel_layout);
-            // Update buffer icon
-            Stage* stage = stages_[request.var_name_str].get();
-            ui_->bufferPreview->render_buffer_icon(stage);
-
-            // Looking for corresponding item...
-            const int icon_width = 200;
-            const int icon_height = 100;
-            const int bytes_per_line = icon_width * 3;
-            QImage bufferIcon(stage->buffer_icon_.data(), icon_width,
-                                icon_height, bytes_per_line, QImage::Format_RGB888);
-            stringstream label;
-            label << request.var_name_str << "\n[" << request.width_i << "x" <<
-                     request.height_i << "]\n" <<
-                     get_type_label(request.type, request.channels);
+            ++it;
+        }
+    }
 
+    if(completer_updated_) {
+        symbol_completer_->updateSymbolList(available_vars_);
+        completer_updated_ = false;
+    }
+
+    update_history_slider();
+    update_journal_bar();
+
+    // Tiles are only streamed while frames are drawn
+    if(render_requested_ ||
+       ui_->bufferPreview->texture_uploader().has_pending_uploads()) {
+        render_requested_ = false;
+        if(currently_selected_stage_ != nullptr) {
+            currently_selected_stage_->update();
+        }
+        ui_->bufferPreview->updateGL();
+        update_fetched_region();
+    }
+
+    if(has_background_work()) {
+        schedule_loop();
+    }
+}
+
+void MainWindow::update_fetched_region() {
+    for(const auto& stage: stages_) {
+        if(stage.second.get() != currently_selected_stage_) {
+            continue;
+        }
+
+        GameObject* buffer_obj = stage.second->getGameObject("buffer");
+        Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
+        int x0, y0, x1, y1, level;
+        buffer->visible_region(x0, y0, x1, y1, level);
+        region_fetcher_->set_view(stage.first, x0, y0, x1, y1, 1 << level);
+        break;
+    }
+}
+
+void MainWindow::apply_prepared_buffer(const PreparedBuffer& prepared) {
+    const BufferRequestMessage& request = prepared.request;
+
+    uint8_t* srcBuffer = request.buffer;
+    shared_ptr<uint8_t> managedBuffer = request.buffer_owner;
+
+    auto buffer_stage = stages_.find(request.var_name_str);
+    if(buffer_stage == stages_.end()) {
+        // New buffer request
+        shared_ptr<Stage> stage = make_shared<Stage>();
+        if(!stage->initialize(ui_->bufferPreview,
+                              srcBuffer,
+                              request.width_i,
+                              request.height_i,
+                              request.channels,
+                              request.type,
+                              request.step,
+                              request.pixel_layout,
+                              ac_enabled_,
+                              prepared.tile_analysis)) {
+            cerr << "[error] Could not initialize opengl canvas!"<<endl;
+        }
+        stages_[request.var_name_str] = stage;
+        apply_contrast_percentiles(stage.get());
+
+        QImage bufferIcon;
+        ui_->bufferPreview->render_buffer_icon(stage.get());
+
+        const int icon_width = 200;
+        const int icon_height = 100;
+        const int bytes_per_line = icon_width * 3;
+        bufferIcon = QImage(stage->buffer_icon_.data(), icon_width,
+                            icon_height, bytes_per_line, QImage::Format_RGB888);
+
+        stringstream label;
+        label << request.var_name_str << "\n[" << request.width_i << "x" <<
+                 request.height_i << "]\n" <<
+                 get_type_label(request.type, request.channels);
+        // Big buffers are only read as finely as the camera needed, and
+        // subsampled elsewhere, until the next stop
+        if(request.provisional) {
+            label << " (partial)";
+        }
+        if(evicted_buffers_.erase(request.var_name_str) > 0) {
+            // An evicted buffer kept its list item, which is selected again
+            // if the user was waiting for it
             for(int i = 0; i < ui_->imageList->count(); ++i) {
                 QListWidgetItem* item = ui_->imageList->item(i);
                 if(item->data(Qt::UserRole) == request.var_name_str.c_str()) {
-                    item->setIcon(QPixmap::fromImage(bufferIcon));
                     item->setText(label.str().c_str());
+                    item->setForeground(ui_->imageList->palette().text());
+                    item->setToolTip(QString());
+                    if(item == ui_->imageList->currentItem()) {
+                        buffer_selected(item);
+                    }
                     break;
                 }
             }
+        } else {
+            QListWidgetItem* item = new QListWidgetItem(QPixmap::fromImage(bufferIcon),
+                                                        label.str().c_str());
+            item->setData(Qt::UserRole, QString(request.var_name_str.c_str()));
+            item->setFlags(Qt::ItemIsSelectable|Qt::ItemIsEnabled);
+            item->setSizeHint(QSize(205,bufferIcon.height() + 90));
+            item->setTextAlignment(Qt::AlignHCenter);
+            ui_->imageList->addItem(item);
+        }
+        outdated_icons_.insert(request.var_name_str);
 
-            // Update AC values
-            if(currently_selected_stage_ != nullptr) {
-                reset_ac_min_labels();
-                reset_ac_max_labels();
+        update_session_settings();
+    } else {
+        buffer_stage->second->buffer_update(srcBuffer,
+                                            request.width_i,
+                                            request.height_i,
+                                            request.channels,
+                                            request.type,
+                                            request.step,
+                                            request.pixel_layout,
+                                            prepared.tile_analysis);
+
+        // The icon keeps showing the previous contents until the new ones
+        // are uploaded, and is only rendered again then
+        stringstream label;
+        label << request.var_name_str << "\n[" << request.width_i << "x" <<
+                 request.height_i << "]\n" <<
+                 get_type_label(request.type, request.channels);
+        // Big buffers are only read as finely as the camera needed, and
+        // subsampled elsewhere, until the next stop
+        if(request.provisional) {
+            label << " (partial)";
+        }
+
+        for(int i = 0; i < ui_->imageList->count(); ++i) {
+            QListWidgetItem* item = ui_->imageList->item(i);
+            if(item->data(Qt::UserRole) == request.var_name_str.c_str()) {
+                item->setText(label.str().c_str());
+                break;
             }
         }
+        outdated_icons_.insert(request.var_name_str);
 
-        pending_updates_.pop_front();
+        // Update AC values
+        if(currently_selected_stage_ != nullptr) {
+            reset_ac_min_labels();
+            reset_ac_max_labels();
+        }
+    }
+    // The previous buffer is only released after its stage stopped
+    // using it, since its statistics may still be being computed
+    held_buffers_[request.var_name_str] = managedBuffer;
+
+    if(!request.provisional && !request.from_history && !request.replayed) {
+        history_->record(request);
+        if(request.var_name_str == selected_buffer_name()) {
+            history_at_newest_ = true;
+        }
     }
 
-    if(completer_updated_) {
-        symbol_completer_->updateSymbolList(available_vars_);
-        completer_updated_ = false;
+    update_memory_usage(request.var_name_str);
+}
+
+void MainWindow::update_memory_usage(const std::string& var_name) {
+    auto stage = stages_.find(var_name);
+    if(stage == stages_.end()) {
+        return;
     }
 
-    ui_->bufferPreview->updateGL();
-    if(currently_selected_stage_ != nullptr) {
-        currently_selected_stage_->update();
+    GameObject* buffer_obj = stage->second->getGameObject("buffer");
+    Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
+    size_t cpu_bytes = static_cast<size_t>(buffer->step) *
+                       static_cast<size_t>(buffer->buffer_height_f) *
+                       TextureFormat::select(buffer->type,
+                                             buffer->channels).bytes_per_texel;
+    if(buffer->tile_analysis() != nullptr) {
+        cpu_bytes += buffer->tile_analysis()->pyramid_bytes();
+    }
+    memory_manager_.update(var_name, cpu_bytes, buffer->gpu_bytes());
+
+    // The buffer on display, and the one that was just plotted, stay even
+    // if they don't fit by themselves
+    set<string> keep = {var_name};
+    for(const auto& other: stages_) {
+        if(other.second.get() == currently_selected_stage_) {
+            keep.insert(other.first);
+            break;
+        }
+    }
+    for(const string& victim: memory_manager_.evict_over_budget(keep)) {
+        evict_buffer(victim);
+    }
+}
+
+void MainWindow::evict_buffer(const std::string& var_name) {
+    // Same order as when the buffer is removed: the stage may still be
+    // computing statistics from the held buffer
+    stages_.erase(var_name);
+    held_buffers_.erase(var_name);
+    outdated_icons_.erase(var_name);
+    region_fetcher_->forget(var_name);
+    history_->release_contents(var_name);
+    memory_manager_.remove(var_name);
+
+    // Not read from the inferior on each stop anymore
+    {
+        std::unique_lock<std::mutex> lock(observed_mtx_);
+        observed_variables_.erase(var_name);
+    }
+    evicted_buffers_.insert(var_name);
+
+    for(int i = 0; i < ui_->imageList->count(); ++i) {
+        QListWidgetItem* item = ui_->imageList->item(i);
+        if(item->data(Qt::UserRole) == var_name.c_str()) {
+            item->setForeground(ui_->imageList->palette().brush(QPalette::Disabled,
+                                                                QPalette::Text));
+            item->setToolTip("Evicted to save memory; selecting it reads it again");
+            break;
+        }
+    }
+}
+
+std::string MainWindow::selected_buffer_name() {
+    QListWidgetItem* item = ui_->imageList->currentItem();
+    if(item == nullptr) {
+        return string();
+    }
+    return item->data(Qt::UserRole).toString().toStdString();
+}
+
+void MainWindow::update_history_slider() {
+    string var_name = selected_buffer_name();
+    if(var_name.empty()) {
+        history_version_ids_.clear();
+    } else {
+        history_version_ids_ = history_->version_ids(var_name);
+    }
+    int versions = static_cast<int>(history_version_ids_.size());
+
+    QSlider* slider = ui_->historySlider;
+    slider->blockSignals(true);
+    slider->setEnabled(versions > 1);
+    slider->setMaximum(std::max(0, versions - 1));
+    if(history_at_newest_) {
+        slider->setValue(slider->maximum());
+    } else {
+        // Older versions may have been dropped since it was picked
+        auto picked = lower_bound(history_version_ids_.begin(),
+                                  history_version_ids_.end(),
+                                  history_version_);
+        slider->setValue(static_cast<int>(picked -
+                                          history_version_ids_.begin()));
+    }
+    slider->blockSignals(false);
+
+    if(versions > 0) {
+        ui_->historyLabel->setText(QString("Version %1/%2").
+                                   arg(slider->value() + 1).arg(versions));
+    } else {
+        ui_->historyLabel->setText("History");
+    }
+}
+
+void MainWindow::history_version_selected(int index) {
+    string var_name = selected_buffer_name();
+    if(var_name.empty() || index < 0 ||
+       index >= static_cast<int>(history_version_ids_.size())) {
+        return;
+    }
+
+    // Only the version shown is decoded; the buffer is displayed once it
+    // is prepared like any other update
+    history_at_newest_ = index == ui_->historySlider->maximum();
+    history_version_ = history_version_ids_[index];
+    history_->request_version(var_name, history_version_);
+    update_history_slider();
+}
+
+void MainWindow::update_journal_bar() {
+    const int frames = journal_player_->num_frames();
+    const int frame = journal_player_->current_frame();
+
+    QSlider* slider = ui_->journalSlider;
+    slider->blockSignals(true);
+    slider->setEnabled(frames > 1);
+    slider->setMaximum(std::max(0, frames - 1));
+    slider->setValue(std::max(0, frame));
+    slider->blockSignals(false);
+
+    // Playback stops by itself at the last frame
+    ui_->journalPlay->blockSignals(true);
+    ui_->journalPlay->setEnabled(frames > 1);
+    ui_->journalPlay->setChecked(journal_player_->playing());
+    ui_->journalPlay->setText(journal_player_->playing() ? "Pause" : "Play");
+    ui_->journalPlay->blockSignals(false);
+
+    if(frames > 0) {
+        ui_->journalLabel->setText(QString("Frame %1/%2").
+                                   arg(std::max(0, frame) + 1).arg(frames));
+    } else {
+        ui_->journalLabel->setText("Journal");
+    }
+}
+
+void MainWindow::choose_journal() {
+    QString path = QFileDialog::getOpenFileName(this, "Open journal", QString(),
+                                                "Journals (*.giwj);;All files (*)");
+    if(!path.isEmpty()) {
+        open_journal(path);
+    }
+}
+
+void MainWindow::open_journal(const QString& path) {
+    // Its first frame is shown once it is prepared like any other update
+    if(!journal_player_->open(path.toStdString())) {
+        statusBar()->showMessage("Could not open journal " + path, 5000);
+        return;
+    }
+    update_journal_bar();
+    schedule_loop();
+}
+
+void MainWindow::journal_play_toggled(bool checked) {
+    if(checked) {
+        journal_player_->play(journal_frames_per_second_);
+    } else {
+        journal_player_->pause();
+    }
+    update_journal_bar();
+    schedule_loop();
+}
+
+void MainWindow::journal_frame_selected(int frame) {
+    // Only the frame picked is decoded
+    journal_player_->show(frame);
+    update_journal_bar();
+}
+
+bool MainWindow::has_background_work() {
+    if(ui_->bufferPreview->texture_uploader().has_pending_uploads() ||
+       !outdated_icons_.empty()) {
+        return true;
+    }
+
+    // The journal bar follows the frames being played
+    if(journal_player_->playing()) {
+        return true;
+    }
+
+    if(ingest_->busy()) {
+        return true;
+    }
+
+    for(const auto& stage: stages_) {
+        if(stage.second->buffer_stats_pending()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void MainWindow::refresh_buffer_icon(const std::string& var_name) {
+    Stage* stage = stages_[var_name].get();
+    ui_->bufferPreview->render_buffer_icon(stage);
+
+    const int icon_width = 200;
+    const int icon_height = 100;
+    const int bytes_per_line = icon_width * 3;
+    QImage bufferIcon(stage->buffer_icon_.data(), icon_width,
+                      icon_height, bytes_per_line, QImage::Format_RGB888);
+
+    for(int i = 0; i < ui_->imageList->count(); ++i) {
+        QListWidgetItem* item = ui_->imageList->item(i);
+        if(item->data(Qt::UserRole) == var_name.c_str()) {
+            item->setIcon(QPixmap::fromImage(bufferIcon));
+            break;
+        }
     }
 }
 
@@ -385,13 +910,28 @@ void MainWindow::buffer_selected(QListWidgetItem * item) {
     if(item == nullptr)
         return;
 
-    auto stage = stages_.find(item->data(Qt::UserRole).toString().toStdString());
+    string var_name = item->data(Qt::UserRole).toString().toStdString();
+    history_at_newest_ = true;
+    update_history_slider();
+
+    auto stage = stages_.find(var_name);
     if(stage != stages_.end()) {
         currently_selected_stage_ = stage->second.get();
+        memory_manager_.touch(var_name);
         reset_ac_min_labels();
         reset_ac_max_labels();
 
         update_statusbar();
+        request_render();
+    } else if(evicted_buffers_.find(var_name) != evicted_buffers_.end()) {
+        // Read again through the debugger; the buffer is displayed once
+        // it arrives
+        currently_selected_stage_ = nullptr;
+        status_bar->setText(("Reading " + var_name + "...").c_str());
+        if(plot_callback_ != nullptr) {
+            plot_callback_(var_name.c_str());
+        }
+        request_render();
     }
 }
 
@@ -422,6 +962,7 @@ void MainWindow::set_ac_min_value(int idx, float value)
        Buffer* buff = buffer_obj->getComponent<Buffer>("buffer_component");
        buff->min_buffer_values()[idx] = value;
        buff->computeContrastBrightnessParameters();
+       request_render();
    }
 }
 
@@ -432,6 +973,7 @@ void MainWindow::set_ac_max_value(int idx, float value)
        Buffer* buff = buffer_obj->getComponent<Buffer>("buffer_component");
        buff->max_buffer_values()[idx] = value;
        buff->computeContrastBrightnessParameters();
+       request_render();
    }
 }
 
@@ -464,6 +1006,33 @@ void MainWindow::update_statusbar()
         message << " val=";
         buffer->getPixelInfo(message, floor(mouse_pos.x()), floor(mouse_pos.y()));
         status_bar->setText(message.str().c_str());
+
+        stringstream gpu_stats;
+        gpu_stats << "Texture allocations avoided by reuse: " <<
+                     ui_->bufferPreview->texture_pool().avoided_allocations();
+        gpu_stats << "\nSuperseded updates dropped: " <<
+                     ingest_->dropped_updates();
+
+        TileStore& tile_store = ui_->bufferPreview->tile_store();
+        gpu_stats << "\nTile deduplication ratio: " <<
+                     std::round(tile_store.dedup_ratio() * 100.0) / 100.0 <<
+                     " (" << ((tile_store.bound_bytes() -
+                               tile_store.stored_bytes()) >> 20) <<
+                     " MB of textures shared, " <<
+                     tile_store.shared_pyramids() << " pyramids reused)";
+
+        if(buffer->has_stats()) {
+            const BufferStats& stats = buffer->stats();
+            for(int c = 0; c < stats.channels; ++c) {
+                gpu_stats << "\nChannel " << c << ": mean=" << stats.mean[c] <<
+                             " stddev=" << stats.stddev[c] <<
+                             " NaN=" << stats.nan_count[c] <<
+                             " Inf=" << stats.inf_count[c];
+            }
+        } else {
+            gpu_stats << "\nComputing buffer statistics...";
+        }
+        status_bar->setToolTip(gpu_stats.str().c_str());
     }
 }
 
@@ -518,6 +1087,7 @@ void MainWindow::ac_min_reset()
 
        // Update inputs
        reset_ac_min_labels();
+       request_render();
    }
 }
 
@@ -531,6 +1101,7 @@ void MainWindow::ac_max_reset()
 
        // Update inputs
        reset_ac_max_labels();
+       request_render();
    }
 }
 
@@ -539,6 +1110,8 @@ void MainWindow::ac_toggle()
     ac_enabled_ = !ac_enabled_;
     for(auto& stage: stages_)
         stage.second->contrast_enabled = ac_enabled_;
+
+    request_render();
 }
 
 void MainWindow::recenter_buffer()
@@ -556,6 +1129,8 @@ void MainWindow::recenter_buffer()
             cam->recenter_camera();
         }
     }
+
+    request_render();
 }
 
 void MainWindow::link_views_toggle()
@@ -577,6 +1152,8 @@ void MainWindow::rotate_90_cw()
             buff_obj->angle += 90.f * M_PI / 180.f;
         }
     }
+
+    request_render();
 }
 
 void MainWindow::rotate_90_ccw()
@@ -592,65 +1169,69 @@ void MainWindow::rotate_90_ccw()
             buff_obj->angle -= 90.f * M_PI / 180.f;
         }
     }
+
+    request_render();
 }
 
 void MainWindow::remove_selected_buffer()
 {
-    if(ui_->imageList->count() > 0 && currently_selected_stage_ != nullptr) {
+    if(ui_->imageList->count() > 0 && ui_->imageList->currentItem() != nullptr) {
         QListWidgetItem* removedItem = ui_->imageList->takeItem(ui_->imageList->currentRow());
         string bufferName = removedItem->data(Qt::UserRole).toString().toStdString();
         stages_.erase(bufferName);
         held_buffers_.erase(bufferName);
+        evicted_buffers_.erase(bufferName);
+        memory_manager_.remove(bufferName);
+        history_->forget(bufferName);
+        {
+            std::unique_lock<std::mutex> lock(observed_mtx_);
+            observed_variables_.erase(bufferName);
+        }
+        region_fetcher_->forget(bufferName);
 
         if(stages_.size() == 0)
             currently_selected_stage_ = nullptr;
 
         update_session_settings();
+        request_render();
     }
 }
 
-void MainWindow::update_available_variables(PyObject *available_set)
+PyObject* MainWindow::update_available_variables(PyObject *available_vars)
 {
-    available_vars_.clear();
-
-    PyObject* key;
-    PyObject* symbol_metadata;
-    Py_ssize_t pos = 0;
-
-    while (PyDict_Next(available_set, &pos, &key, &symbol_metadata)) {
-        int count = PyList_Size(symbol_metadata);
-
-        assert(count == 6);
-
-        PyObject *var_name_bytes = PyUnicode_AsEncodedString(key, "ASCII", "strict");
-        string var_name_str = PyBytes_AS_STRING(var_name_bytes);
-        available_vars_.push_back(var_name_str.c_str());
+    PyObject* requested_vars = PyList_New(0);
+    QStringList available_vars;
 
-        if(previous_session_buffers_.find(var_name_str) != previous_session_buffers_.end() ||
-           held_buffers_.find(var_name_str) != held_buffers_.end()) {
-            BufferRequestMessage request;
-
-            request.var_name_str = var_name_str;
-            request.py_buffer = PyList_GetItem(symbol_metadata, 0);
-            request.width_i = PyLong_AS_LONG(
-                                  PyList_GetItem(symbol_metadata, 1));
-            request.height_i = PyLong_AS_LONG(
-                                   PyList_GetItem(symbol_metadata, 2));
-            request.channels = PyLong_AS_LONG(
-                                   PyList_GetItem(symbol_metadata, 3));
-            request.type = static_cast<Buffer::BufferType>(
-                               PyLong_AS_LONG(
-                                   PyList_GetItem(symbol_metadata, 4)));
-            request.step = PyLong_AS_LONG(
-                               PyList_GetItem(symbol_metadata, 5));
-            request.pixel_layout = PyBytes_AS_STRING(
-                                       PyList_GetItem(symbol_metadata, 6));
-
-            plot_buffer(request);
+    {
+        std::unique_lock<std::mutex> lock(observed_mtx_);
+        Py_ssize_t count = PyList_Size(available_vars);
+        for(Py_ssize_t i = 0; i < count; ++i) {
+            PyObject* var_name = PyList_GetItem(available_vars, i);
+            PyObject *var_name_bytes = PyUnicode_AsEncodedString(var_name, "ASCII", "strict");
+            string var_name_str = PyBytes_AS_STRING(var_name_bytes);
+            Py_DECREF(var_name_bytes);
+            available_vars.push_back(var_name_str.c_str());
+
+            // Buffers that aren't displayed are not read from the inferior
+            if(previous_session_buffers_.find(var_name_str) != previous_session_buffers_.end() ||
+               observed_variables_.find(var_name_str) != observed_variables_.end()) {
+                PyList_Append(requested_vars, var_name);
+            }
         }
     }
 
+    // The completer is owned by the GUI thread
+    QMetaObject::invokeMethod(this, "set_available_variables", Qt::QueuedConnection,
+                              Q_ARG(QStringList, available_vars));
+
+    return requested_vars;
+}
+
+void MainWindow::set_available_variables(QStringList available_vars)
+{
+    available_vars_ = available_vars;
     completer_updated_ = true;
+    schedule_loop();
 }
 
 void MainWindow::on_symbol_selected() {
@@ -702,6 +1283,95 @@ void MainWindow::export_buffer()
     }
 }
 
+void MainWindow::set_pyramid_reduction()
+{
+    auto sender_action(static_cast<QAction*>(sender()));
+    QVariantList action_data = sender_action->data().toList();
+
+    auto stage = stages_.find(action_data[0].toString().toStdString());
+    if(stage == stages_.end()) {
+        return;
+    }
+
+    GameObject* buffer_obj = stage->second->getGameObject("buffer");
+    Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
+    buffer->set_pyramid_reduction(
+                static_cast<PyramidReduction>(action_data[1].toInt()));
+    outdated_icons_.insert(stage->first);
+    request_render();
+}
+
+void MainWindow::set_contrast_percentiles()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle("Auto contrast percentiles");
+
+    QDoubleSpinBox* low_input = new QDoubleSpinBox(&dialog);
+    QDoubleSpinBox* high_input = new QDoubleSpinBox(&dialog);
+    for(QDoubleSpinBox* input: {low_input, high_input}) {
+        input->setRange(0.0, 100.0);
+        input->setDecimals(2);
+        input->setSingleStep(0.5);
+        input->setSuffix("%");
+    }
+    low_input->setValue(contrast_low_percentile_);
+    high_input->setValue(contrast_high_percentile_);
+
+    QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Ok |
+                                                     QDialogButtonBox::Cancel,
+                                                     &dialog);
+    connect(buttons, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), &dialog, SLOT(reject()));
+
+    // Percentiles that don't leave a range to display can't be accepted
+    QLabel* range_hint = new QLabel("The lower percentile must be below the "
+                                    "upper one", &dialog);
+    QPushButton* ok_button = buttons->button(QDialogButtonBox::Ok);
+    auto validate_range = [low_input, high_input, range_hint, ok_button]() {
+        bool valid = low_input->value() < high_input->value();
+        ok_button->setEnabled(valid);
+        range_hint->setVisible(!valid);
+    };
+    for(QDoubleSpinBox* input: {low_input, high_input}) {
+        connect(input,
+                static_cast<void (QDoubleSpinBox::*)(double)>(
+                        &QDoubleSpinBox::valueChanged),
+                &dialog, validate_range);
+    }
+    validate_range();
+
+    QFormLayout* layout = new QFormLayout(&dialog);
+    layout->addRow("Lower percentile", low_input);
+    layout->addRow("Upper percentile", high_input);
+    layout->addRow(range_hint);
+    layout->addRow(buttons);
+
+    if(dialog.exec() != QDialog::Accepted ||
+       low_input->value() >= high_input->value()) {
+        return;
+    }
+
+    contrast_low_percentile_ = low_input->value();
+    contrast_high_percentile_ = high_input->value();
+
+    QSettings settings("gdbimagewatch.cfg", QSettings::NativeFormat);
+    settings.setValue("AutoContrast/low_percentile", contrast_low_percentile_);
+    settings.setValue("AutoContrast/high_percentile", contrast_high_percentile_);
+    settings.sync();
+
+    for(auto& stage: stages_) {
+        apply_contrast_percentiles(stage.second.get());
+        outdated_icons_.insert(stage.first);
+    }
+
+    if(currently_selected_stage_ != nullptr) {
+        reset_ac_min_labels();
+        reset_ac_max_labels();
+    }
+
+    request_render();
+}
+
 void MainWindow::set_plot_callback(int (*plot_cbk)(const char *)) {
     plot_callback_ = plot_cbk;
 }
@@ -718,6 +1388,33 @@ void MainWindow::show_context_menu(const QPoint& pos)
     // Add parameter to action: buffer name
     exportAction->setData(ui_->imageList->itemAt(pos)->data(Qt::UserRole));
 
+    // Reduction used to build the zoomed out levels of the buffer
+    QString buffer_name = ui_->imageList->itemAt(pos)->data(Qt::UserRole).toString();
+    auto stage = stages_.find(buffer_name.toStdString());
+    if(stage != stages_.end()) {
+        GameObject* buffer_obj = stage->second->getGameObject("buffer");
+        Buffer* buffer = buffer_obj->getComponent<Buffer>("buffer_component");
+
+        QMenu* reductionMenu = myMenu.addMenu("Zoomed out view");
+        const pair<const char*, PyramidReduction> reductions[] = {
+            {"Average", PyramidReduction::Average},
+            {"Minimum", PyramidReduction::Min},
+            {"Maximum", PyramidReduction::Max},
+            {"Maximum absolute value", PyramidReduction::MaxAbs}
+        };
+        for(const auto& reduction: reductions) {
+            QAction* action = reductionMenu->addAction(reduction.first, this,
+                                                       SLOT(set_pyramid_reduction()));
+            action->setCheckable(true);
+            action->setChecked(buffer->pyramid_reduction() == reduction.second);
+            action->setData(QVariantList({buffer_name,
+                                          static_cast<int>(reduction.second)}));
+        }
+    }
+
+    myMenu.addAction("Auto contrast percentiles...", this,
+                     SLOT(set_contrast_percentiles()));
+
     // Show context menu at handling position
     myMenu.exec(globalPos);
 }
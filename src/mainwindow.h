@@ -6,14 +6,18 @@
 #include <QMainWindow>
 #include <Python.h>
 #include <mutex>
-#include <deque>
 #include <string>
 #include <QTimer>
 #include <QListWidgetItem>
 #include <QLabel>
 #include <QShortcut>
 
+#include "buffer_history.hpp"
 #include "glcanvas.hpp"
+#include "ingest_pipeline.hpp"
+#include "journal_player.hpp"
+#include "memory_manager.hpp"
+#include "region_fetcher.hpp"
 #include "stage.hpp"
 #include "symbol_completer.h"
 
@@ -21,17 +25,6 @@ namespace Ui {
 class MainWindow;
 }
 
-struct BufferRequestMessage {
-    std::string var_name_str;
-    PyObject* py_buffer;
-    int width_i;
-    int height_i;
-    int channels;
-    Buffer::BufferType type;
-    int step;
-    std::string pixel_layout;
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -59,9 +52,35 @@ public:
 
     void set_plot_callback(int(*plot_cbk)(const char*));
 
+    // Marks the view as outdated. Requests are coalesced, and served by the
+    // next run of loop().
+    void request_render();
+
+    // Called from the debugger thread, with the GIL held, with the names of
+    // the buffers in scope. Returns a new list with the ones whose contents
+    // must be read and plotted: those being displayed, and those restored
+    // from the previous session.
+    PyObject* update_available_variables(PyObject* available_vars);
+
+    // Called from the debugger thread with a buffer in the memory of the
+    // stopped inferior. Returns false if it couldn't be read, so the
+    // debugger can read it instead.
+    bool plot_inferior_buffer(const InferiorBuffer& source);
+
+    // Called from the debugger thread once the buffers of a stop were
+    // requested, before it lets the inferior resume
+    void finish_inferior_reads(int pid);
+
+    // Called from the debugger thread when the inferior resumes
+    void invalidate_inferior_memory();
+
 public Q_SLOTS:
     void show_context_menu(const QPoint &pos);
 
+    // Runs loop() within a frame interval, unless it is already scheduled.
+    // Other threads must invoke it through a queued connection.
+    void schedule_loop();
+
     void loop();
     void buffer_selected(QListWidgetItem * item);
 
@@ -85,7 +104,7 @@ public Q_SLOTS:
 
     void remove_selected_buffer();
 
-    void update_available_variables(PyObject* available_set);
+    void set_available_variables(QStringList available_vars);
 
     void on_symbol_selected();
 
@@ -93,18 +112,59 @@ public Q_SLOTS:
 
     void export_buffer();
 
+    void set_pyramid_reduction();
+
+    void set_contrast_percentiles();
+
     void rotate_90_cw();
 
     void rotate_90_ccw();
 
+    void history_version_selected(int index);
+
+    void choose_journal();
+
+    // May be invoked from the debugger thread through a queued connection
+    void open_journal(const QString& path);
+
+    void journal_play_toggled(bool checked);
+
+    void journal_frame_selected(int frame);
+
 private:
+    // Single shot: loop() only runs while there is something to draw or
+    // background work to follow, so an idle window doesn't wake up
     QTimer update_timer_;
+    bool render_requested_;
 
     Stage* currently_selected_stage_;
     std::map<std::string, std::shared_ptr<uint8_t>> held_buffers_;
     std::set<std::string> previous_session_buffers_;
-    std::mutex mtx_;
-    std::deque<BufferRequestMessage> pending_updates_;
+    // Variables plotted so far, also read by the debugger thread
+    std::mutex observed_mtx_;
+    std::set<std::string> observed_variables_;
+    std::unique_ptr<IngestPipeline> ingest_;
+    // Streams big buffers from the inferior memory into ingest_, following
+    // the region on display
+    std::unique_ptr<RegionFetcher> region_fetcher_;
+    std::set<std::string> outdated_icons_;
+    MemoryManager memory_manager_;
+    // Buffers whose contents were dropped to stay within the memory
+    // budgets. Only their list item is kept, and they are read again when
+    // selected.
+    std::set<std::string> evicted_buffers_;
+    // Earlier versions of the plotted buffers
+    std::unique_ptr<BufferHistory> history_;
+    // Whether the history slider follows the newest version of the
+    // selected buffer, rather than a version the user picked
+    bool history_at_newest_;
+    // Version the user picked, and the versions of the selected buffer as
+    // shown by the history slider, oldest first
+    uint64_t history_version_;
+    std::vector<uint64_t> history_version_ids_;
+    // Plays journals written by trace breakpoints into ingest_
+    std::unique_ptr<JournalPlayer> journal_player_;
+    double journal_frames_per_second_;
 
     std::shared_ptr<QShortcut> symbol_list_focus_shortcut_;
     std::shared_ptr<SymbolCompleter> symbol_completer_;
@@ -114,6 +174,8 @@ private:
     Ui::MainWindow *ui_;
     bool ac_enabled_;
     bool link_views_enabled_;
+    float contrast_low_percentile_;
+    float contrast_high_percentile_;
     std::map<std::string, std::shared_ptr<Stage>> stages_;
     QLabel *status_bar;
     std::shared_ptr<QShortcut> buffer_removal_shortcut_;
@@ -126,9 +188,22 @@ private:
 
     void update_statusbar();
 
+    void refresh_buffer_icon(const std::string& var_name);
+
     std::string get_type_label(Buffer::BufferType type, int channels);
     void load_previous_session_symbols();
+    void load_rendering_settings();
+    void apply_contrast_percentiles(Stage* stage);
     void update_session_settings();
+    void apply_prepared_buffer(const PreparedBuffer& prepared);
+    // Tells the region fetcher which part of the selected buffer is seen
+    void update_fetched_region();
+    void update_memory_usage(const std::string& var_name);
+    std::string selected_buffer_name();
+    void update_history_slider();
+    void update_journal_bar();
+    void evict_buffer(const std::string& var_name);
+    bool has_background_work();
 };
 
 #endif // MAINWINDOW_H
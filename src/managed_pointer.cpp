@@ -6,20 +6,35 @@ using namespace std;
 shared_ptr<uint8_t> makeSharedPyObject(PyObject* obj) {
     return shared_ptr<uint8_t>(reinterpret_cast<uint8_t*>(obj),
                                [](uint8_t* obj) {
-        Py_DECREF(reinterpret_cast<PyObject*>(obj));
+        releasePyObject(reinterpret_cast<PyObject*>(obj));
     });
 }
 
-shared_ptr<uint8_t> makeFloatBufferFromDouble(double* buff, int length) {
-    shared_ptr<uint8_t> result(reinterpret_cast<uint8_t*>(new float[length]),
+void releasePyObject(PyObject* obj) {
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+    Py_DECREF(obj);
+    PyGILState_Release(gil_state);
+}
+
+shared_ptr<uint8_t> makeFloatBufferFromDouble(const double* buff,
+                                              int width,
+                                              int height,
+                                              int channels,
+                                              int step) {
+    const size_t row_length = static_cast<size_t>(width) * channels;
+    shared_ptr<uint8_t> result(reinterpret_cast<uint8_t*>(new float[row_length * height]),
                                [](uint8_t* buff) {
         delete[] reinterpret_cast<float*>(buff);
     });
 
-    // Cast from double to float
+    // Cast from double to float, dropping the row padding
     float* dst = reinterpret_cast<float*>(result.get());
-    for(int i = 0; i < length; ++i) {
-        dst[i] = static_cast<float>(buff[i]);
+    for(int y = 0; y < height; ++y) {
+        const double* src_row = buff + static_cast<size_t>(y) * step * channels;
+        float* dst_row = dst + y * row_length;
+        for(size_t i = 0; i < row_length; ++i) {
+            dst_row[i] = static_cast<float>(src_row[i]);
+        }
     }
 
     return result;
@@ -6,6 +6,15 @@
 
 std::shared_ptr<uint8_t> makeSharedPyObject(PyObject* obj);
 
-std::shared_ptr<uint8_t> makeFloatBufferFromDouble(double* buff, int length);
+// Drops a reference to obj. May be called from any thread, since it takes
+// the GIL itself.
+void releasePyObject(PyObject* obj);
+
+// step is given in pixels. The result is densely packed, with a step of width.
+std::shared_ptr<uint8_t> makeFloatBufferFromDouble(const double* buff,
+                                                   int width,
+                                                   int height,
+                                                   int channels,
+                                                   int step);
 
 #endif // MANAGEDPOINTER_H
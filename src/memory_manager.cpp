@@ -0,0 +1,74 @@
+#include "memory_manager.hpp"
+
+using namespace std;
+
+void MemoryManager::set_budgets(size_t cpu_bytes, size_t gpu_bytes) {
+    cpu_budget_ = cpu_bytes;
+    gpu_budget_ = gpu_bytes;
+}
+
+size_t MemoryManager::cpu_bytes() const {
+    return cpu_bytes_;
+}
+
+size_t MemoryManager::gpu_bytes() const {
+    return gpu_bytes_;
+}
+
+void MemoryManager::update(const string& name,
+                           size_t cpu_bytes,
+                           size_t gpu_bytes) {
+    auto it = index_.find(name);
+    if(it == index_.end()) {
+        entries_.push_front({name, 0, 0});
+        it = index_.insert(make_pair(name, entries_.begin())).first;
+    }
+
+    Entry& entry = *it->second;
+    cpu_bytes_ += cpu_bytes - entry.cpu_bytes;
+    gpu_bytes_ += gpu_bytes - entry.gpu_bytes;
+    entry.cpu_bytes = cpu_bytes;
+    entry.gpu_bytes = gpu_bytes;
+}
+
+void MemoryManager::touch(const string& name) {
+    auto it = index_.find(name);
+    if(it == index_.end()) {
+        return;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+}
+
+void MemoryManager::remove(const string& name) {
+    auto it = index_.find(name);
+    if(it == index_.end()) {
+        return;
+    }
+
+    cpu_bytes_ -= it->second->cpu_bytes;
+    gpu_bytes_ -= it->second->gpu_bytes;
+    entries_.erase(it->second);
+    index_.erase(it);
+}
+
+vector<string> MemoryManager::evict_over_budget(const set<string>& keep) {
+    vector<string> evicted;
+
+    auto victim = entries_.end();
+    while((cpu_bytes_ > cpu_budget_ || gpu_bytes_ > gpu_budget_) &&
+          victim != entries_.begin()) {
+        --victim;
+        if(keep.count(victim->name) > 0) {
+            continue;
+        }
+
+        string name = victim->name;
+        // Entries before the victim are not affected by its removal
+        ++victim;
+        remove(name);
+        evicted.push_back(name);
+    }
+
+    return evicted;
+}
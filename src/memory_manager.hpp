@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*
+ * Keeps the memory held by plotted buffers within a CPU and a GPU budget.
+ * The CPU side of a buffer is the copy of its contents kept by the viewer
+ * and its tile pyramids; the GPU side is its textures, unless they are
+ * virtual, in which case the TileCache keeps them in check within a budget
+ * of its own. When either
+ * budget is exceeded, the least recently viewed buffers are chosen for
+ * eviction. A buffer counts as viewed when it is plotted for the first time
+ * and whenever it is selected.
+ */
+class MemoryManager {
+public:
+    static constexpr size_t default_cpu_budget = 4096ull * 1024 * 1024;
+    static constexpr size_t default_gpu_budget = 1024 * 1024 * 1024;
+
+    void set_budgets(size_t cpu_bytes, size_t gpu_bytes);
+
+    size_t cpu_bytes() const;
+
+    size_t gpu_bytes() const;
+
+    // Registers a buffer, or updates the memory it holds. New buffers count
+    // as the most recently viewed.
+    void update(const std::string& name, size_t cpu_bytes, size_t gpu_bytes);
+
+    void touch(const std::string& name);
+
+    void remove(const std::string& name);
+
+    // Removes and returns the least recently viewed buffers until the rest
+    // fits the budgets. The buffers in keep are never evicted.
+    std::vector<std::string> evict_over_budget(const std::set<std::string>& keep);
+
+private:
+    struct Entry {
+        std::string name;
+        size_t cpu_bytes;
+        size_t gpu_bytes;
+    };
+
+    // Most recently viewed buffers are kept at the front
+    std::list<Entry> entries_;
+    std::map<std::string, std::list<Entry>::iterator> index_;
+    size_t cpu_budget_ = default_cpu_budget;
+    size_t gpu_budget_ = default_gpu_budget;
+    size_t cpu_bytes_ = 0;
+    size_t gpu_bytes_ = 0;
+};
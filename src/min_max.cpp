@@ -0,0 +1,170 @@
+#include "min_max_kernels.hpp"
+
+using namespace std;
+
+namespace {
+
+#ifdef __SSE2__
+
+// SSE2 is part of the x86-64 baseline, so these need no target attribute.
+// The SSE2 min/max instructions return the second operand when the first
+// one is a NaN, which matches accumulate_row().
+template<typename T> struct Sse2Ops;
+
+template<> struct Sse2Ops<float> {
+    typedef float Element;
+    typedef __m128 Vector;
+    static const int lanes = 4;
+    static MIN_MAX_INLINE Vector set1(float v) { return _mm_set1_ps(v); }
+    static MIN_MAX_INLINE Vector load(const float* p) { return _mm_loadu_ps(p); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm_max_ps(a, b); }
+    static MIN_MAX_INLINE void store(float* p, Vector v) { _mm_storeu_ps(p, v); }
+};
+
+template<> struct Sse2Ops<uint8_t> {
+    typedef uint8_t Element;
+    typedef __m128i Vector;
+    static const int lanes = 16;
+    static MIN_MAX_INLINE Vector set1(uint8_t v) { return _mm_set1_epi8(static_cast<char>(v)); }
+    static MIN_MAX_INLINE Vector load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm_min_epu8(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm_max_epu8(a, b); }
+    static MIN_MAX_INLINE void store(uint8_t* p, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+};
+
+template<> struct Sse2Ops<int16_t> {
+    typedef int16_t Element;
+    typedef __m128i Vector;
+    static const int lanes = 8;
+    static MIN_MAX_INLINE Vector set1(int16_t v) { return _mm_set1_epi16(v); }
+    static MIN_MAX_INLINE Vector load(const int16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm_min_epi16(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm_max_epi16(a, b); }
+    static MIN_MAX_INLINE void store(int16_t* p, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+};
+
+// SSE2 has no unsigned 16 bit min/max. Values are biased into the signed
+// range when loaded, and unbiased when stored.
+template<> struct Sse2Ops<uint16_t> {
+    typedef uint16_t Element;
+    typedef __m128i Vector;
+    static const int lanes = 8;
+    static MIN_MAX_INLINE Vector bias() { return _mm_set1_epi16(static_cast<short>(0x8000)); }
+    static MIN_MAX_INLINE Vector set1(uint16_t v) { return _mm_xor_si128(_mm_set1_epi16(static_cast<short>(v)), bias()); }
+    static MIN_MAX_INLINE Vector load(const uint16_t* p) { return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), bias()); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm_min_epi16(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm_max_epi16(a, b); }
+    static MIN_MAX_INLINE void store(uint16_t* p, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_xor_si128(v, bias())); }
+};
+
+// SSE2 has no 32 bit integer min/max either; it is built from a comparison
+template<> struct Sse2Ops<int32_t> {
+    typedef int32_t Element;
+    typedef __m128i Vector;
+    static const int lanes = 4;
+    static MIN_MAX_INLINE Vector select(Vector mask, Vector a, Vector b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+    static MIN_MAX_INLINE Vector set1(int32_t v) { return _mm_set1_epi32(v); }
+    static MIN_MAX_INLINE Vector load(const int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return select(_mm_cmplt_epi32(a, b), a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return select(_mm_cmpgt_epi32(a, b), a, b); }
+    static MIN_MAX_INLINE void store(int32_t* p, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+};
+
+#endif // __SSE2__
+
+enum class InstructionSet {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+InstructionSet detect_instruction_set() {
+#ifdef MIN_MAX_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return InstructionSet::Avx2;
+    }
+#endif
+#ifdef __SSE2__
+    return InstructionSet::Sse2;
+#else
+    return InstructionSet::Scalar;
+#endif
+}
+
+InstructionSet instruction_set() {
+    static const InstructionSet detected = detect_instruction_set();
+    return detected;
+}
+
+template<typename T, int C>
+MinMaxKernel kernel_for_instruction_set() {
+    switch(instruction_set()) {
+#ifdef MIN_MAX_X86
+    case InstructionSet::Avx2:
+        return avx2_min_max_kernel<T>(C);
+#endif
+#ifdef __SSE2__
+    case InstructionSet::Sse2:
+        return min_max_simd<Sse2Ops<T>, C>;
+#endif
+    default:
+        return min_max_scalar<T, C>;
+    }
+}
+
+} // namespace
+
+template<typename T>
+MinMaxKernel select_min_max_kernel(int channels) {
+    switch(channels) {
+    case 1:
+        return kernel_for_instruction_set<T, 1>();
+    case 2:
+        return kernel_for_instruction_set<T, 2>();
+    case 3:
+        return kernel_for_instruction_set<T, 3>();
+    default:
+        return kernel_for_instruction_set<T, 4>();
+    }
+}
+
+template<typename T>
+MinMaxKernel scalar_min_max_kernel(int channels) {
+    switch(channels) {
+    case 1:
+        return min_max_scalar<T, 1>;
+    case 2:
+        return min_max_scalar<T, 2>;
+    case 3:
+        return min_max_scalar<T, 3>;
+    default:
+        return min_max_scalar<T, 4>;
+    }
+}
+
+const char* min_max_instruction_set() {
+    switch(instruction_set()) {
+    case InstructionSet::Avx2:
+        return "AVX2";
+    case InstructionSet::Sse2:
+        return "SSE2";
+    default:
+        return "scalar";
+    }
+}
+
+template MinMaxKernel select_min_max_kernel<uint8_t>(int);
+template MinMaxKernel select_min_max_kernel<uint16_t>(int);
+template MinMaxKernel select_min_max_kernel<int16_t>(int);
+template MinMaxKernel select_min_max_kernel<int32_t>(int);
+template MinMaxKernel select_min_max_kernel<float>(int);
+
+template MinMaxKernel scalar_min_max_kernel<uint8_t>(int);
+template MinMaxKernel scalar_min_max_kernel<uint16_t>(int);
+template MinMaxKernel scalar_min_max_kernel<int16_t>(int);
+template MinMaxKernel scalar_min_max_kernel<int32_t>(int);
+template MinMaxKernel scalar_min_max_kernel<float>(int);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fused per channel minimum and maximum of a region of an interleaved
+ * buffer. Kernels are specialized for the element type and channel count,
+ * and use the widest SIMD instruction set supported by the running CPU, so
+ * that the selection only has to be made once per buffer.
+ */
+
+// src_row_stride is given in elements. lowest and upper receive one value
+// per channel.
+typedef void (*MinMaxKernel)(const void* src,
+                             size_t src_row_stride,
+                             int width,
+                             int height,
+                             float* lowest,
+                             float* upper);
+
+template<typename T>
+MinMaxKernel select_min_max_kernel(int channels);
+
+// Portable kernel, used when no SIMD instruction set is available
+template<typename T>
+MinMaxKernel scalar_min_max_kernel(int channels);
+
+// Name of the instruction set used by select_min_max_kernel()
+const char* min_max_instruction_set();
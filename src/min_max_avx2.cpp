@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <limits>
+
+#include "min_max.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+// Everything below, including the kernel templates, is compiled for AVX2.
+// These kernels are only selected after checking for AVX2 support at runtime.
+#pragma GCC target("avx2")
+#include "min_max_kernels.hpp"
+
+using namespace std;
+
+namespace {
+
+template<typename T> struct Avx2Ops;
+
+template<> struct Avx2Ops<float> {
+    typedef float Element;
+    typedef __m256 Vector;
+    static const int lanes = 8;
+    static MIN_MAX_INLINE Vector set1(float v) { return _mm256_set1_ps(v); }
+    static MIN_MAX_INLINE Vector load(const float* p) { return _mm256_loadu_ps(p); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+    static MIN_MAX_INLINE void store(float* p, Vector v) { _mm256_storeu_ps(p, v); }
+};
+
+template<> struct Avx2Ops<uint8_t> {
+    typedef uint8_t Element;
+    typedef __m256i Vector;
+    static const int lanes = 32;
+    static MIN_MAX_INLINE Vector set1(uint8_t v) { return _mm256_set1_epi8(static_cast<char>(v)); }
+    static MIN_MAX_INLINE Vector load(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm256_min_epu8(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm256_max_epu8(a, b); }
+    static MIN_MAX_INLINE void store(uint8_t* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+};
+
+template<> struct Avx2Ops<int16_t> {
+    typedef int16_t Element;
+    typedef __m256i Vector;
+    static const int lanes = 16;
+    static MIN_MAX_INLINE Vector set1(int16_t v) { return _mm256_set1_epi16(v); }
+    static MIN_MAX_INLINE Vector load(const int16_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm256_min_epi16(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm256_max_epi16(a, b); }
+    static MIN_MAX_INLINE void store(int16_t* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+};
+
+template<> struct Avx2Ops<uint16_t> {
+    typedef uint16_t Element;
+    typedef __m256i Vector;
+    static const int lanes = 16;
+    static MIN_MAX_INLINE Vector set1(uint16_t v) { return _mm256_set1_epi16(static_cast<short>(v)); }
+    static MIN_MAX_INLINE Vector load(const uint16_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm256_min_epu16(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm256_max_epu16(a, b); }
+    static MIN_MAX_INLINE void store(uint16_t* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+};
+
+template<> struct Avx2Ops<int32_t> {
+    typedef int32_t Element;
+    typedef __m256i Vector;
+    static const int lanes = 8;
+    static MIN_MAX_INLINE Vector set1(int32_t v) { return _mm256_set1_epi32(v); }
+    static MIN_MAX_INLINE Vector load(const int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static MIN_MAX_INLINE Vector min(Vector a, Vector b) { return _mm256_min_epi32(a, b); }
+    static MIN_MAX_INLINE Vector max(Vector a, Vector b) { return _mm256_max_epi32(a, b); }
+    static MIN_MAX_INLINE void store(int32_t* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+};
+
+} // namespace
+
+template<typename T>
+MinMaxKernel avx2_min_max_kernel(int channels) {
+    switch(channels) {
+    case 1:
+        return min_max_simd<Avx2Ops<T>, 1>;
+    case 2:
+        return min_max_simd<Avx2Ops<T>, 2>;
+    case 3:
+        return min_max_simd<Avx2Ops<T>, 3>;
+    default:
+        return min_max_simd<Avx2Ops<T>, 4>;
+    }
+}
+
+template MinMaxKernel avx2_min_max_kernel<uint8_t>(int);
+template MinMaxKernel avx2_min_max_kernel<uint16_t>(int);
+template MinMaxKernel avx2_min_max_kernel<int16_t>(int);
+template MinMaxKernel avx2_min_max_kernel<int32_t>(int);
+template MinMaxKernel avx2_min_max_kernel<float>(int);
+
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "min_max.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIN_MAX_X86
+#include <immintrin.h>
+
+#define MIN_MAX_INLINE inline __attribute__((always_inline))
+#endif
+
+/*
+ * Kernel templates shared by the min/max translation units. Each unit is
+ * compiled for a different instruction set, so everything here has internal
+ * linkage: an instantiation built for AVX2 must never be picked by the linker
+ * for the baseline kernels.
+ */
+namespace {
+
+template<typename T, int C>
+void init_extrema(T* lowest, T* upper) {
+    for(int c = 0; c < C; ++c) {
+        lowest[c] = std::numeric_limits<T>::max();
+        upper[c] = std::numeric_limits<T>::lowest();
+    }
+}
+
+// Accumulates the elements [begin, end) of an interleaved row. begin must
+// be the first element of a pixel. NaNs never replace the current extrema,
+// as in std::min/std::max with the accumulator as the first argument.
+template<typename T, int C>
+inline void accumulate_row(const T* row,
+                           size_t begin,
+                           size_t end,
+                           T* lowest,
+                           T* upper) {
+    int c = 0;
+    for(size_t i = begin; i < end; ++i) {
+        lowest[c] = std::min(lowest[c], row[i]);
+        upper[c] = std::max(upper[c], row[i]);
+        c = (c + 1 == C) ? 0 : c + 1;
+    }
+}
+
+template<typename T, int C>
+void store_extrema(const T* lowest, const T* upper,
+                   float* lowest_out, float* upper_out) {
+    for(int c = 0; c < C; ++c) {
+        lowest_out[c] = static_cast<float>(lowest[c]);
+        upper_out[c] = static_cast<float>(upper[c]);
+    }
+}
+
+template<typename T, int C>
+void min_max_scalar(const void* src,
+                    size_t src_row_stride,
+                    int width,
+                    int height,
+                    float* lowest_out,
+                    float* upper_out) {
+    const T* data = static_cast<const T*>(src);
+    const size_t row_elements = static_cast<size_t>(width) * C;
+
+    T lowest[C], upper[C];
+    init_extrema<T, C>(lowest, upper);
+
+    for(int y = 0; y < height; ++y) {
+        accumulate_row<T, C>(data + y * src_row_stride, 0, row_elements,
+                             lowest, upper);
+    }
+
+    store_extrema<T, C>(lowest, upper, lowest_out, upper_out);
+}
+
+#ifdef MIN_MAX_X86
+
+/*
+ * Vectorized kernel. The Ops parameter wraps the intrinsics of one
+ * instruction set for one element type.
+ *
+ * Rows are consumed in groups of NumAcc vectors. A group always starts at a
+ * pixel boundary, so lane j of accumulator a always holds channel
+ * (a*lanes + j) % C. Three channel buffers need three accumulators for that
+ * pattern to repeat; the other channel counts divide the vector width.
+ */
+template<typename Ops, int C>
+void min_max_simd(const void* src,
+                  size_t src_row_stride,
+                  int width,
+                  int height,
+                  float* lowest_out,
+                  float* upper_out) {
+    typedef typename Ops::Element T;
+    typedef typename Ops::Vector V;
+    const int NumAcc = (C == 3) ? 3 : 1;
+    const int GroupSize = NumAcc * Ops::lanes;
+
+    const T* data = static_cast<const T*>(src);
+    const size_t row_elements = static_cast<size_t>(width) * C;
+    const size_t simd_elements = row_elements - row_elements % GroupSize;
+
+    T lowest[C], upper[C];
+    init_extrema<T, C>(lowest, upper);
+
+    V vec_lowest[NumAcc], vec_upper[NumAcc];
+    for(int a = 0; a < NumAcc; ++a) {
+        vec_lowest[a] = Ops::set1(std::numeric_limits<T>::max());
+        vec_upper[a] = Ops::set1(std::numeric_limits<T>::lowest());
+    }
+
+    for(int y = 0; y < height; ++y) {
+        const T* row = data + y * src_row_stride;
+        for(size_t i = 0; i < simd_elements; i += GroupSize) {
+            for(int a = 0; a < NumAcc; ++a) {
+                V value = Ops::load(row + i + a * Ops::lanes);
+                vec_lowest[a] = Ops::min(value, vec_lowest[a]);
+                vec_upper[a] = Ops::max(value, vec_upper[a]);
+            }
+        }
+        accumulate_row<T, C>(row, simd_elements, row_elements,
+                             lowest, upper);
+    }
+
+    // Fold the vector lanes into their channels
+    T lanes[Ops::lanes];
+    for(int a = 0; a < NumAcc; ++a) {
+        Ops::store(lanes, vec_lowest[a]);
+        for(int j = 0; j < Ops::lanes; ++j) {
+            int c = (a * Ops::lanes + j) % C;
+            lowest[c] = std::min(lowest[c], lanes[j]);
+        }
+        Ops::store(lanes, vec_upper[a]);
+        for(int j = 0; j < Ops::lanes; ++j) {
+            int c = (a * Ops::lanes + j) % C;
+            upper[c] = std::max(upper[c], lanes[j]);
+        }
+    }
+
+    store_extrema<T, C>(lowest, upper, lowest_out, upper_out);
+}
+
+#endif // MIN_MAX_X86
+
+} // namespace
+
+#ifdef MIN_MAX_X86
+// Defined in min_max_avx2.cpp
+template<typename T>
+MinMaxKernel avx2_min_max_kernel(int channels);
+#endif
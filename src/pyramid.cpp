@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "pyramid.hpp"
+
+using namespace std;
+
+void TilePyramid::clear() {
+    levels.clear();
+    widths.clear();
+    heights.clear();
+}
+
+int pyramid_levels(int width, int height) {
+    int levels = 1;
+    while((max(width, height) >> levels) > 0) {
+        ++levels;
+    }
+    return levels;
+}
+
+namespace {
+
+template<typename T>
+T reduce_block(const T* src,
+               size_t src_row_stride,
+               int x0, int x1,
+               int y0, int y1,
+               int channels,
+               int c,
+               PyramidReduction reduction) {
+    T result = src[y0 * src_row_stride + x0 * channels + c];
+    double sum = 0.0;
+    double largest_abs = -1.0;
+
+    for(int y = y0; y < y1; ++y) {
+        const T* row = src + y * src_row_stride;
+        for(int x = x0; x < x1; ++x) {
+            T value = row[x * channels + c];
+
+            switch(reduction) {
+            case PyramidReduction::Average:
+                sum += static_cast<double>(value);
+                break;
+            case PyramidReduction::Min:
+                result = min(result, value);
+                break;
+            case PyramidReduction::Max:
+                result = max(result, value);
+                break;
+            case PyramidReduction::MaxAbs: {
+                double abs_value = fabs(static_cast<double>(value));
+                if(abs_value > largest_abs) {
+                    largest_abs = abs_value;
+                    result = value;
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    if(reduction == PyramidReduction::Average) {
+        double average = sum / ((x1 - x0) * (y1 - y0));
+        if(is_integral<T>::value) {
+            average = round(average);
+        }
+        result = static_cast<T>(average);
+    }
+
+    return result;
+}
+
+} // namespace
+
+template<typename T>
+void build_tile_pyramid(const T* src,
+                        size_t src_row_stride,
+                        int width,
+                        int height,
+                        int channels,
+                        PyramidReduction reduction,
+                        TilePyramid& pyramid) {
+    pyramid.clear();
+
+    const int num_levels = pyramid_levels(width, height);
+
+    for(int level = 1; level < num_levels; ++level) {
+        // Follow the GL convention for mip level dimensions
+        int dst_w = max(1, width >> level);
+        int dst_h = max(1, height >> level);
+
+        pyramid.levels.emplace_back(static_cast<size_t>(dst_w) * dst_h *
+                                    channels * sizeof(T));
+        pyramid.widths.push_back(dst_w);
+        pyramid.heights.push_back(dst_h);
+
+        T* dst = reinterpret_cast<T*>(pyramid.levels.back().data());
+
+        for(int y = 0; y < dst_h; ++y) {
+            // The last row/column of a level also covers the remaining
+            // source texels of odd dimensions, so nothing gets dropped
+            int y0 = min(2 * y, height - 1);
+            int y1 = (y == dst_h - 1) ? height : y0 + 2;
+
+            for(int x = 0; x < dst_w; ++x) {
+                int x0 = min(2 * x, width - 1);
+                int x1 = (x == dst_w - 1) ? width : x0 + 2;
+
+                for(int c = 0; c < channels; ++c) {
+                    dst[(y * dst_w + x) * channels + c] =
+                            reduce_block(src, src_row_stride,
+                                         x0, x1, y0, y1,
+                                         channels, c, reduction);
+                }
+            }
+        }
+
+        src = dst;
+        src_row_stride = static_cast<size_t>(dst_w) * channels;
+        width = dst_w;
+        height = dst_h;
+    }
+}
+
+template void build_tile_pyramid<uint8_t>(const uint8_t*, size_t, int, int, int,
+                                          PyramidReduction, TilePyramid&);
+template void build_tile_pyramid<uint16_t>(const uint16_t*, size_t, int, int, int,
+                                           PyramidReduction, TilePyramid&);
+template void build_tile_pyramid<int16_t>(const int16_t*, size_t, int, int, int,
+                                          PyramidReduction, TilePyramid&);
+template void build_tile_pyramid<int32_t>(const int32_t*, size_t, int, int, int,
+                                          PyramidReduction, TilePyramid&);
+template void build_tile_pyramid<float>(const float*, size_t, int, int, int,
+                                        PyramidReduction, TilePyramid&);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Reduced resolution levels of a buffer tile. Each level halves the
+ * dimensions of the previous one, and each texel of a level is obtained by
+ * reducing the 2x2 (or, on odd borders, up to 3x3) texel block below it.
+ * The min, max and max-abs reductions keep isolated outliers visible when the
+ * buffer is seen from far away.
+ */
+enum class PyramidReduction {
+    Average = 0,
+    Min = 1,
+    Max = 2,
+    MaxAbs = 3
+};
+
+struct TilePyramid {
+    // Level i of this container corresponds to mip level i+1
+    std::vector<std::vector<uint8_t>> levels;
+    std::vector<int> widths;
+    std::vector<int> heights;
+
+    void clear();
+};
+
+// Number of mip levels (including the base one) of a tile with the given
+// dimensions
+int pyramid_levels(int width, int height);
+
+// src_row_stride is given in elements of type T
+
+template<typename T>
+void build_tile_pyramid(const T* src,
+                        size_t src_row_stride,
+                        int width,
+                        int height,
+                        int channels,
+                        PyramidReduction reduction,
+                        TilePyramid& pyramid);
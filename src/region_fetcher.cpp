@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <cstring>
+
+#include "inferior_memory.hpp"
+#include "region_fetcher.hpp"
+#include "soft_dirty.hpp"
+
+using namespace std;
+
+namespace {
+
+// Buffers up to this size are read whole
+const size_t overview_threshold_bytes = 32 << 20;
+
+// Amount of memory read outside of the region on display, for bigger ones
+const size_t overview_bytes = 8 << 20;
+
+// Coarsest subsampling of the overview
+const int max_subsampling = 256;
+
+size_t element_size(Buffer::BufferType type) {
+    switch(type) {
+    case Buffer::BufferType::UnsignedShort:
+    case Buffer::BufferType::Short:
+        return 2;
+    case Buffer::BufferType::Int32:
+    case Buffer::BufferType::Float32:
+        return 4;
+    case Buffer::BufferType::Float64:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+shared_ptr<uint8_t> allocate_pixels(size_t size) {
+    return shared_ptr<uint8_t>(new uint8_t[size], [](uint8_t* pixels) {
+        delete[] pixels;
+    });
+}
+
+int floor_power_of_two(int value) {
+    int result = 1;
+    while(result * 2 <= value) {
+        result *= 2;
+    }
+    return result;
+}
+
+// Position of inner within outer, if it lies within its rows and columns
+bool contains(const InferiorBuffer& outer,
+              const InferiorBuffer& inner,
+              int& x,
+              int& y) {
+    if(outer.pid != inner.pid ||
+       outer.type != inner.type ||
+       outer.channels != inner.channels ||
+       outer.step != inner.step ||
+       outer.step <= 0 ||
+       inner.address < outer.address) {
+        return false;
+    }
+
+    const uint64_t pixel_bytes = element_size(outer.type) * outer.channels;
+    const uint64_t row_bytes = static_cast<uint64_t>(outer.step) * pixel_bytes;
+    const uint64_t offset = inner.address - outer.address;
+    if(offset % pixel_bytes != 0) {
+        return false;
+    }
+
+    const uint64_t row = offset / row_bytes;
+    const uint64_t column = (offset % row_bytes) / pixel_bytes;
+    if(row + inner.height > static_cast<uint64_t>(outer.height) ||
+       column + inner.width > static_cast<uint64_t>(outer.width)) {
+        return false;
+    }
+
+    x = static_cast<int>(column);
+    y = static_cast<int>(row);
+    return true;
+}
+
+bool same_memory(const InferiorBuffer& a, const InferiorBuffer& b) {
+    return a.pid == b.pid &&
+           a.address == b.address &&
+           a.width == b.width &&
+           a.height == b.height &&
+           a.channels == b.channels &&
+           a.type == b.type &&
+           a.step == b.step;
+}
+
+} // namespace
+
+RegionFetcher::RegionFetcher(Delivery deliver) : deliver_(deliver) {}
+
+bool RegionFetcher::fetch(const InferiorBuffer& source) {
+    View view;
+    bool has_view = false;
+    {
+        unique_lock<mutex> lock(mtx_);
+        begin_stop();
+        auto viewed = views_.find(source.var_name);
+        if(viewed != views_.end()) {
+            view = viewed->second;
+            has_view = true;
+        }
+    }
+
+    if(fetch_shared(source) || fetch_changes(source)) {
+        return true;
+    }
+
+    const size_t row_bytes = static_cast<size_t>(source.width) *
+                             element_size(source.type) * source.channels;
+    shared_ptr<uint8_t> pixels = allocate_pixels(row_bytes * source.height);
+
+    // Every Nth row is read, so that the buffer stays within the overview
+    // budget, except for the region on display
+    int overview = 1;
+    if(row_bytes * source.height > overview_threshold_bytes) {
+        while(overview < max_subsampling &&
+              row_bytes * ((source.height + overview - 1) / overview) >
+              overview_bytes) {
+            overview *= 2;
+        }
+    }
+
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    int subsampling = overview;
+    if(overview > 1 && has_view) {
+        x0 = std::min(std::max(view.x0, 0), source.width);
+        y0 = std::min(std::max(view.y0, 0), source.height);
+        x1 = std::min(std::max(view.x1, x0), source.width);
+        y1 = std::min(std::max(view.y1, y0), source.height);
+        subsampling = std::min(floor_power_of_two(std::max(1, view.subsampling)),
+                               overview);
+    }
+
+    if(!read_pixels(source, pixels.get(), overview,
+                    x0, y0, x1, y1, subsampling)) {
+        return false;
+    }
+
+    BufferRequestMessage request;
+    request.var_name_str = source.var_name;
+    request.buffer_owner = pixels;
+    request.buffer = pixels.get();
+    request.width_i = source.width;
+    request.height_i = source.height;
+    request.channels = source.channels;
+    request.type = source.type;
+    request.step = source.width;
+    request.pixel_layout = source.pixel_layout;
+    request.provisional = overview > 1 &&
+                          (subsampling > 1 ||
+                           x0 > 0 || y0 > 0 ||
+                           x1 < source.width || y1 < source.height);
+
+    {
+        unique_lock<mutex> lock(mtx_);
+        partial_snapshots_.erase(source.var_name);
+        if(request.provisional) {
+            // Partial contents are read again at the next stop, but the ROIs
+            // within the region read at full resolution may still be taken
+            // from them during this one
+            snapshots_.erase(source.var_name);
+            if(subsampling == 1 && x0 < x1 && y0 < y1) {
+                PartialSnapshot& partial = partial_snapshots_[source.var_name];
+                partial.source = source;
+                partial.generation = generation_;
+                partial.pixels = pixels;
+                partial.x0 = x0;
+                partial.y0 = y0;
+                partial.x1 = x1;
+                partial.y1 = y1;
+            }
+        } else {
+            request.version.id = keep_snapshot(source, pixels);
+        }
+    }
+
+    deliver_(request);
+    return true;
+}
+
+void RegionFetcher::finish_reads(pid_t pid) {
+    unique_lock<mutex> lock(mtx_);
+    begin_stop();
+
+    // Writes made while the inferior runs are only missed if the bits are
+    // cleared after it resumed, so they are cleared now. The snapshots read
+    // during this stop match its memory until then.
+    if(pid > 0 && soft_dirty_supported() && clear_soft_dirty(pid)) {
+        tracked_generation_ = generation_;
+        tracked_pid_ = pid;
+    } else {
+        tracked_generation_ = -1;
+    }
+}
+
+void RegionFetcher::invalidate() {
+    unique_lock<mutex> lock(mtx_);
+    resumed_ = true;
+}
+
+void RegionFetcher::begin_stop() {
+    if(resumed_) {
+        ++generation_;
+        resumed_ = false;
+        partial_snapshots_.clear();
+    }
+}
+
+void RegionFetcher::forget(const string& var_name) {
+    unique_lock<mutex> lock(mtx_);
+    snapshots_.erase(var_name);
+    partial_snapshots_.erase(var_name);
+}
+
+void RegionFetcher::set_view(const string& var_name,
+                             int x0, int y0, int x1, int y1,
+                             int subsampling) {
+    unique_lock<mutex> lock(mtx_);
+    View& view = views_[var_name];
+    view.x0 = x0;
+    view.y0 = y0;
+    view.x1 = x1;
+    view.y1 = y1;
+    view.subsampling = subsampling;
+}
+
+bool RegionFetcher::fetch_shared(const InferiorBuffer& source) {
+    if(source.width <= 0 || source.height <= 0) {
+        return false;
+    }
+
+    const size_t pixel_bytes = element_size(source.type) * source.channels;
+    BufferRequestMessage request;
+    {
+        unique_lock<mutex> lock(mtx_);
+
+        // Memory doesn't change while the inferior is stopped, so any
+        // contents read during this stop will do
+        const Snapshot* parent = nullptr;
+        int x = 0, y = 0;
+        for(const auto& kept: snapshots_) {
+            if(kept.first != source.var_name &&
+               kept.second.generation == generation_ &&
+               contains(kept.second.source, source, x, y)) {
+                parent = &kept.second;
+                break;
+            }
+        }
+
+        // Partial contents have no version of their own, so the view is
+        // kept as if it was read
+        const PartialSnapshot* partial = nullptr;
+        if(parent == nullptr) {
+            for(const auto& kept: partial_snapshots_) {
+                if(kept.first != source.var_name &&
+                   kept.second.generation == generation_ &&
+                   contains(kept.second.source, source, x, y) &&
+                   x >= kept.second.x0 && y >= kept.second.y0 &&
+                   x + source.width <= kept.second.x1 &&
+                   y + source.height <= kept.second.y1) {
+                    partial = &kept.second;
+                    break;
+                }
+            }
+            if(partial == nullptr) {
+                return false;
+            }
+        }
+
+        const shared_ptr<uint8_t>& parent_pixels =
+                parent != nullptr ? parent->pixels : partial->pixels;
+        const int parent_step = parent != nullptr ? parent->pixels_step
+                                                  : partial->source.width;
+        uint8_t* first_pixel = parent_pixels.get() +
+                (static_cast<size_t>(y) * parent_step + x) * pixel_bytes;
+        shared_ptr<uint8_t> pixels(parent_pixels, first_pixel);
+
+        Snapshot snapshot;
+        snapshot.source = source;
+        snapshot.generation = generation_;
+        snapshot.pixels = pixels;
+        snapshot.pixels_step = parent_step;
+        snapshot.parent_content_id = parent != nullptr ? parent->content_id
+                                                       : 0;
+
+        // The rows that changed are known if the view was taken from the
+        // same buffer during the previous stop
+        auto previous = snapshots_.find(source.var_name);
+        if(parent != nullptr && previous != snapshots_.end() &&
+           same_memory(previous->second.source, source) &&
+           previous->second.parent_content_id != 0) {
+            const Snapshot& before = previous->second;
+            if(before.parent_content_id == parent->content_id) {
+                snapshot.content_id = before.content_id;
+                snapshot.base_id = before.content_id;
+                snapshot.changed_rows =
+                        make_shared<vector<bool>>(source.height, false);
+            } else if(before.parent_content_id == parent->base_id &&
+                      parent->changed_rows != nullptr) {
+                snapshot.content_id = next_content_id_++;
+                snapshot.base_id = before.content_id;
+                snapshot.changed_rows = make_shared<vector<bool>>(
+                        parent->changed_rows->begin() + y,
+                        parent->changed_rows->begin() + y + source.height);
+            }
+        }
+        if(snapshot.content_id == 0) {
+            snapshot.content_id = next_content_id_++;
+        }
+
+        request.var_name_str = source.var_name;
+        request.buffer_owner = pixels;
+        request.buffer = pixels.get();
+        request.width_i = source.width;
+        request.height_i = source.height;
+        request.channels = source.channels;
+        request.type = source.type;
+        request.step = snapshot.pixels_step;
+        request.pixel_layout = source.pixel_layout;
+        request.version.id = snapshot.content_id;
+        request.version.base_id = snapshot.base_id;
+        request.version.changed_rows = snapshot.changed_rows;
+
+        snapshots_[source.var_name] = snapshot;
+    }
+
+    deliver_(request);
+    return true;
+}
+
+bool RegionFetcher::fetch_changes(const InferiorBuffer& source) {
+    if(source.width <= 0 || source.height <= 0) {
+        return false;
+    }
+
+    Snapshot snapshot;
+    bool unchanged = false;
+    {
+        unique_lock<mutex> lock(mtx_);
+        auto kept = snapshots_.find(source.var_name);
+        if(kept == snapshots_.end() ||
+           !same_memory(kept->second.source, source)) {
+            return false;
+        }
+        snapshot = kept->second;
+
+        if(snapshot.generation == generation_) {
+            // The inferior didn't run since the snapshot was taken
+            unchanged = true;
+        } else if(tracked_generation_ != snapshot.generation ||
+                  tracked_pid_ != source.pid) {
+            return false;
+        }
+    }
+
+    const size_t pixel_bytes = element_size(source.type) * source.channels;
+    const size_t row_bytes = static_cast<size_t>(source.width) * pixel_bytes;
+    const size_t source_row_bytes = static_cast<size_t>(source.step) * pixel_bytes;
+
+    shared_ptr<vector<bool>> changed_rows =
+            make_shared<vector<bool>>(source.height, false);
+    vector<InferiorSegment> segments;
+
+    if(!unchanged) {
+        const size_t size = (source.height - 1) * source_row_bytes + row_bytes;
+        vector<bool> dirty_pages;
+        if(!read_soft_dirty_pages(source.pid, source.address, size, dirty_pages)) {
+            return false;
+        }
+
+        const uint64_t first_page = source.address / page_size();
+        for(int y = 0; y < source.height; ++y) {
+            const uint64_t row_begin = source.address + y * source_row_bytes;
+            const uint64_t row_end = row_begin + row_bytes;
+            for(uint64_t page = row_begin / page_size();
+                page <= (row_end - 1) / page_size(); ++page) {
+                if(dirty_pages[page - first_page]) {
+                    (*changed_rows)[y] = true;
+                    segments.push_back({row_begin, row_bytes});
+                    break;
+                }
+            }
+        }
+    }
+
+    shared_ptr<uint8_t> pixels = snapshot.pixels;
+    if(!segments.empty()) {
+        vector<uint8_t> staging(segments.size() * row_bytes);
+        if(!read_inferior_segments(source.pid, segments, staging.data())) {
+            return false;
+        }
+
+        // The snapshot is on display, so the changes go to a copy, which
+        // is packed even if the snapshot was a view into another buffer
+        const size_t size = row_bytes * source.height;
+        pixels = allocate_pixels(size);
+        if(snapshot.pixels_step == source.width) {
+            memcpy(pixels.get(), snapshot.pixels.get(), size);
+        } else {
+            const size_t snapshot_row_bytes =
+                    static_cast<size_t>(snapshot.pixels_step) * pixel_bytes;
+            for(int y = 0; y < source.height; ++y) {
+                memcpy(pixels.get() + y * row_bytes,
+                       snapshot.pixels.get() + y * snapshot_row_bytes,
+                       row_bytes);
+            }
+        }
+
+        const uint8_t* src = staging.data();
+        for(int y = 0; y < source.height; ++y) {
+            if((*changed_rows)[y]) {
+                memcpy(pixels.get() + y * row_bytes, src, row_bytes);
+                src += row_bytes;
+            }
+        }
+    }
+
+    BufferRequestMessage request;
+    request.var_name_str = source.var_name;
+    request.buffer_owner = pixels;
+    request.buffer = pixels.get();
+    request.width_i = source.width;
+    request.height_i = source.height;
+    request.channels = source.channels;
+    request.type = source.type;
+    request.step = segments.empty() ? snapshot.pixels_step : source.width;
+    request.pixel_layout = source.pixel_layout;
+    request.version.base_id = snapshot.content_id;
+    request.version.changed_rows = changed_rows;
+
+    {
+        unique_lock<mutex> lock(mtx_);
+        Snapshot& kept = snapshots_[source.var_name];
+        kept.source = source;
+        kept.generation = generation_;
+        kept.content_id = segments.empty() ? snapshot.content_id
+                                           : next_content_id_++;
+        kept.base_id = snapshot.content_id;
+        kept.changed_rows = changed_rows;
+        kept.pixels = pixels;
+        kept.pixels_step = request.step;
+        // A view that didn't change stays one, since its pixels still
+        // match the contents of the parent it was taken from
+        kept.parent_content_id = segments.empty() ?
+                                 snapshot.parent_content_id : 0;
+        request.version.id = kept.content_id;
+    }
+
+    deliver_(request);
+    return true;
+}
+
+uint64_t RegionFetcher::keep_snapshot(const InferiorBuffer& source,
+                                      const shared_ptr<uint8_t>& pixels) {
+    Snapshot& snapshot = snapshots_[source.var_name];
+    snapshot.source = source;
+    snapshot.generation = generation_;
+    snapshot.content_id = next_content_id_++;
+    snapshot.base_id = 0;
+    snapshot.changed_rows.reset();
+    snapshot.pixels = pixels;
+    snapshot.pixels_step = source.width;
+    snapshot.parent_content_id = 0;
+    return snapshot.content_id;
+}
+
+bool RegionFetcher::read_pixels(const InferiorBuffer& source,
+                                uint8_t* pixels,
+                                int overview_subsampling,
+                                int x0, int y0, int x1, int y1,
+                                int subsampling) {
+    const size_t pixel_bytes = element_size(source.type) * source.channels;
+    const size_t source_row_bytes = static_cast<size_t>(source.step) * pixel_bytes;
+    const size_t row_bytes = static_cast<size_t>(source.width) * pixel_bytes;
+
+    // Each sampled row is read whole within its columns, which are
+    // subsampled on our side: one iovec per pixel would hit the iovec limit
+    // right away. Samples cover the pixels that follow them, until row
+    // y_end.
+    struct Span {
+        int y;
+        int y_end;
+        int x0;
+        int x1;
+        int subsampling;
+    };
+    vector<Span> spans;
+    for(int y = 0; y < source.height; y += overview_subsampling) {
+        spans.push_back({y, std::min(source.height, y + overview_subsampling),
+                         0, source.width, overview_subsampling});
+    }
+    // The region on display is written over the overview
+    if(subsampling < overview_subsampling) {
+        for(int y = y0; y < y1; y += subsampling) {
+            spans.push_back({y, std::min(y1, y + subsampling),
+                             x0, x1, subsampling});
+        }
+    }
+
+    vector<InferiorSegment> segments;
+    size_t total_bytes = 0;
+    for(const Span& span: spans) {
+        size_t size = static_cast<size_t>(span.x1 - span.x0) * pixel_bytes;
+        segments.push_back({source.address + span.y * source_row_bytes +
+                            span.x0 * pixel_bytes, size});
+        total_bytes += size;
+    }
+    if(segments.empty()) {
+        return true;
+    }
+
+    vector<uint8_t> staging(total_bytes);
+    if(!read_inferior_segments(source.pid, segments, staging.data())) {
+        return false;
+    }
+
+    const uint8_t* src = staging.data();
+    for(const Span& span: spans) {
+        const size_t span_bytes = static_cast<size_t>(span.x1 - span.x0) * pixel_bytes;
+        uint8_t* dst_row = pixels + span.y * row_bytes + span.x0 * pixel_bytes;
+
+        if(span.subsampling == 1) {
+            memcpy(dst_row, src, span_bytes);
+        } else {
+            for(int x = span.x0; x < span.x1; x += span.subsampling) {
+                const uint8_t* sample = src + (x - span.x0) * pixel_bytes;
+                for(int xx = x; xx < std::min(x + span.subsampling, span.x1); ++xx) {
+                    memcpy(dst_row + (xx - span.x0) * pixel_bytes, sample, pixel_bytes);
+                }
+            }
+            for(int y = span.y + 1; y < span.y_end; ++y) {
+                memcpy(pixels + y * row_bytes + span.x0 * pixel_bytes,
+                       dst_row, span_bytes);
+            }
+        }
+        src += span_bytes;
+    }
+
+    return true;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "ingest_pipeline.hpp"
+
+// Where a buffer lives in the memory of a local inferior
+struct InferiorBuffer {
+    std::string var_name;
+    pid_t pid;
+    uint64_t address;
+    int width;
+    int height;
+    int channels;
+    Buffer::BufferType type;
+    // In pixels
+    int step;
+    std::string pixel_layout;
+};
+
+/*
+ * Reads buffers from the memory of a local inferior, so that the first
+ * pixels of huge buffers appear right away. Only the pixels within the
+ * buffer width are read, never the row padding, with one vectored read per
+ * buffer.
+ *
+ * The memory only holds the contents of a stop until the inferior resumes,
+ * which the debugger may do right after the stop is handled, so big buffers
+ * are only read as far as the display needs: the region seen by the camera
+ * is read subsampled as far as the zoom allows, and the rest of the buffer
+ * every Nth row and column. Such buffers are delivered as partial, and stay
+ * so until the next stop, even if the camera moves.
+ *
+ * The complete contents of each buffer are kept. Where the kernel tracks
+ * soft-dirty pages, their bits are cleared once the buffers of a stop are
+ * read, while the inferior is still stopped; the next stop then only reads
+ * the rows on the pages written in between, and tells which rows changed
+ * so that the other tiles are neither hashed nor uploaded again.
+ *
+ * Matrices copied by value, and ROIs of a bigger one, point into the same
+ * memory. A buffer that lies within the contents of another one, read
+ * during the same stop, is not read at all: it is delivered as a view into
+ * those contents, so that both share one copy of the pixels. A partial
+ * buffer lends the region it read at full resolution.
+ */
+class RegionFetcher {
+public:
+    typedef std::function<void(const BufferRequestMessage&)> Delivery;
+
+    // deliver is called from the debugger thread
+    explicit RegionFetcher(Delivery deliver);
+
+    // Called from the debugger thread while the inferior is stopped. Returns
+    // false if the memory couldn't be read.
+    bool fetch(const InferiorBuffer& source);
+
+    // Called from the debugger thread once it read the buffers of a stop,
+    // before it may let the inferior run. The tracking of the pages the
+    // inferior writes to starts over from there.
+    void finish_reads(pid_t pid);
+
+    // Called when the inferior resumes, which may happen several times
+    // before the next stop, e.g. while stepping
+    void invalidate();
+
+    // Drops the contents kept for a buffer that is not displayed anymore
+    void forget(const std::string& var_name);
+
+    // Called from the GUI thread with the region of a buffer seen by the
+    // camera, and the number of buffer pixels covered by a screen pixel. It
+    // is read first at the next stop.
+    void set_view(const std::string& var_name,
+                  int x0, int y0, int x1, int y1,
+                  int subsampling);
+
+private:
+    struct View {
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = 0;
+        int y1 = 0;
+        int subsampling = 1;
+    };
+
+    // Complete contents of a buffer, as read during a stop
+    struct Snapshot {
+        InferiorBuffer source;
+        int generation;
+        uint64_t content_id;
+        // Contents the snapshot was derived from, and the rows that changed
+        // since; null if unknown
+        uint64_t base_id = 0;
+        std::shared_ptr<const std::vector<bool>> changed_rows;
+        // Either packed, or a view into the snapshot of another buffer
+        std::shared_ptr<uint8_t> pixels;
+        // In pixels
+        int pixels_step;
+        // Contents of the snapshot the view was taken from, 0 if the pixels
+        // were read
+        uint64_t parent_content_id = 0;
+    };
+
+    // Contents of a buffer delivered as partial, of which only the region
+    // [x0, x1) x [y0, y1) was read at full resolution
+    struct PartialSnapshot {
+        InferiorBuffer source;
+        int generation;
+        std::shared_ptr<uint8_t> pixels;
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    Delivery deliver_;
+
+    std::mutex mtx_;
+    std::map<std::string, View> views_;
+    std::map<std::string, Snapshot> snapshots_;
+    // Only kept during the stop they were read in
+    std::map<std::string, PartialSnapshot> partial_snapshots_;
+    // Stop during which the soft-dirty bits were last cleared
+    int tracked_generation_ = -1;
+    pid_t tracked_pid_ = 0;
+    uint64_t next_content_id_ = 1;
+    // Counts the stops, not the resumes
+    int generation_ = 0;
+    bool resumed_ = false;
+
+    // Called with mtx_ held when the inferior is known to be stopped
+    void begin_stop();
+
+    // Delivers the buffer as a view into the contents of another buffer
+    // read during this stop, complete or partial with the buffer in its
+    // full resolution region. Returns false if none contains it.
+    bool fetch_shared(const InferiorBuffer& source);
+
+    // Delivers the buffer from its snapshot, reading only the rows that
+    // changed since. Returns false if it has to be read whole.
+    bool fetch_changes(const InferiorBuffer& source);
+
+    // Called with mtx_ held when the pixels of source were read whole
+    uint64_t keep_snapshot(const InferiorBuffer& source,
+                           const std::shared_ptr<uint8_t>& pixels);
+
+    // Reads the pixels of source into a packed copy, with a step of width.
+    // Pixels outside of the region [x0, x1) x [y0, y1) are only sampled
+    // every overview_subsampling rows and columns, and the ones within it
+    // every subsampling rows and columns. Returns false if the memory
+    // couldn't be read.
+    static bool read_pixels(const InferiorBuffer& source,
+                            uint8_t* pixels,
+                            int overview_subsampling,
+                            int x0, int y0, int x1, int y1,
+                            int subsampling);
+};
@@ -34,7 +34,8 @@ bool ShaderProgram::create(const char* v_source,
                            const char* f_source,
                            TexelChannels texel_format,
                            const char* pixel_layout,
-                           const std::vector<std::string>& uniforms) {
+                           const std::vector<std::string>& uniforms,
+                           const std::vector<std::string>& attributes) {
     if(program_ != 0) {
         // Check if the program needs to be recompiled
         if(!shaderIsOutdated(texel_format, uniforms, pixel_layout)) {
@@ -57,6 +58,9 @@ bool ShaderProgram::create(const char* v_source,
     program_ = glCreateProgram();
     glAttachShader(program_, vertex_shader);
     glAttachShader(program_, fragment_shader);
+    for(size_t i = 0; i < attributes.size(); ++i) {
+        glBindAttribLocation(program_, i, attributes[i].c_str());
+    }
     glLinkProgram(program_);
 
     // Delete shaders. We don't need them anymore.
@@ -76,6 +80,14 @@ void ShaderProgram::uniform1i(const std::string& name, int value) {
     glUniform1i(uniforms_[name], value);
 }
 
+void ShaderProgram::uniform1f(const std::string& name, float value) {
+    glUniform1f(uniforms_[name], value);
+}
+
+void ShaderProgram::uniform1fv(const std::string& name, int count, const float* data) {
+    glUniform1fv(uniforms_[name], count, data);
+}
+
 void ShaderProgram::uniform2f(const std::string& name, float x, float y) {
     glUniform2f(uniforms_[name], x, y);
 }
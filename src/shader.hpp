@@ -12,15 +12,21 @@ class ShaderProgram {
 public:
     enum TexelChannels {FormatR, FormatRG, FormatRGB, FormatRGBA};
 
+    // Vertex attribute i of the attributes list is bound to location i
     bool create(const char* v_source,
                 const char* f_source,
                 TexelChannels texel_format,
                 const char* pixel_layout,
-                const std::vector<std::string>& uniforms);
+                const std::vector<std::string>& uniforms,
+                const std::vector<std::string>& attributes = {"inputPosition"});
 
     // Uniform handlers
     void uniform1i(const std::string& name, int value);
 
+    void uniform1f(const std::string& name, float value);
+
+    void uniform1fv(const std::string& name, int count, const float *data);
+
     void uniform2f(const std::string& name, float x, float y);
 
     void uniform3fv(const std::string& name, int count, const float *data);
@@ -2,10 +2,14 @@ namespace shader {
 
 const char* buff_frag_shader = R"(
 
+#extension GL_ARB_shader_texture_lod : require
+
 uniform sampler2D sampler;
 uniform vec4 brightness_contrast[2];
 uniform vec2 buffer_dimension;
 uniform int enable_borders;
+uniform int placeholder;
+uniform float mip_level;
 
 // Ouput data
 varying vec2 uv;
@@ -20,20 +24,20 @@ void main()
     vec4 color;
 #if defined(FORMAT_R)
     // Output color = grayscale
-    color = texture2D(sampler, uv).rrra;
+    color = texture2DLod(sampler, uv, mip_level).rrra;
     color.rgb = color.rgb * brightness_contrast[0].xxx + brightness_contrast[1].xxx;
 #elif defined(FORMAT_RG)
     // Output color = two channels
-    color = texture2D(sampler, uv);
+    color = texture2DLod(sampler, uv, mip_level);
     color.rg = color.rg * brightness_contrast[0].xy + brightness_contrast[1].xy;
     color.b = 0.0;
 #elif defined(FORMAT_RGB)
     // Output color = rgb
-    color = texture2D(sampler, uv);
+    color = texture2DLod(sampler, uv, mip_level);
     color.rgb = color.rgb * brightness_contrast[0].xyz + brightness_contrast[1].xyz;
 #else
     // Output color = rgba
-    color = texture2D(sampler, uv);
+    color = texture2DLod(sampler, uv, mip_level);
     color = color * brightness_contrast[0] + brightness_contrast[1];
 #endif
 
@@ -49,7 +53,12 @@ void main()
         color.rgb += vec3(vertical_border+horizontal_border);
     }
 
-    gl_FragColor = color.PIXEL_LAYOUT;
+    if(placeholder==1) {
+        // Tile contents are still being uploaded
+        gl_FragColor = vec4(vec3(0.3), 1.0);
+    } else {
+        gl_FragColor = color.PIXEL_LAYOUT;
+    }
 }
 
 )";
@@ -6,6 +6,8 @@ extern const char* buff_frag_shader;
 extern const char* buff_vert_shader;
 extern const char* text_frag_shader;
 extern const char* text_vert_shader;
+extern const char* label_frag_shader;
+extern const char* label_vert_shader;
 extern const char* background_vert_shader;
 extern const char* background_frag_shader;
 
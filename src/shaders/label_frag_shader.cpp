@@ -0,0 +1,321 @@
+namespace shader {
+
+const char* label_frag_shader = R"(
+
+uniform sampler2D buff_sampler;
+uniform sampler2D text_sampler;
+uniform vec4 brightness_contrast[2];
+uniform vec2 tile_size;
+
+// cos and sin of the buffer rotation, which the text doesn't follow
+uniform vec2 text_rotation;
+// Size of a font pixel, relative to a buffer pixel
+uniform float text_scale;
+// Vertical offset of the label of each channel
+uniform vec4 channel_offsets;
+uniform int channels;
+
+// 0: "%d", 1: "%d", or "%.3e" beyond 7 characters, 2: "%.3f", or "%.3e"
+// beyond 7 characters
+uniform int label_format;
+// Converts sampled values back to the buffer range
+uniform float value_scale;
+
+// Glyphs of "0123456789.-+enaif". glyph_uv holds the glyph rectangle in
+// the atlas; glyph_box its left and top bearings, width and height.
+uniform vec4 glyph_uv[18];
+uniform vec4 glyph_box[18];
+uniform float glyph_advance[18];
+
+varying vec2 pix_pos;
+
+const float GLYPH_DOT = 10.0;
+const float GLYPH_MINUS = 11.0;
+const float GLYPH_PLUS = 12.0;
+const float GLYPH_E = 13.0;
+const float GLYPH_N = 14.0;
+const float GLYPH_A = 15.0;
+const float GLYPH_I = 16.0;
+const float GLYPH_F = 17.0;
+
+const float MODE_INTEGER = 0.0;
+const float MODE_FIXED = 1.0;
+const float MODE_EXPONENT = 2.0;
+const float MODE_NAN = 3.0;
+const float MODE_INF = 4.0;
+
+// Labels are printed from number, an integer exactly represented as a float
+struct Label {
+    float mode;
+    float negative;
+    float number;
+    float digits;
+    float exponent;
+    float length;
+};
+
+float roundFloat(float f) {
+    return float(int(f+0.5));
+}
+
+// Exact powers of ten, up to 10^10
+float exp10i(float k) {
+    float p = 1.0;
+    for(int i = 0; i < 10; ++i) {
+        if(float(i) >= k) {
+            break;
+        }
+        p *= 10.0;
+    }
+    return p;
+}
+
+// floor(n/d) for integers, corrected for the division rounding
+float floor_div(float n, float d) {
+    float q = floor(n / d);
+    if(q * d > n) {
+        q -= 1.0;
+    } else if((q + 1.0) * d <= n) {
+        q += 1.0;
+    }
+    return q;
+}
+
+// k-th decimal digit of n, starting from the least significant one
+float digit(float n, float k) {
+    float q = floor_div(n, exp10i(k));
+    return q - 10.0 * floor_div(q, 10.0);
+}
+
+float num_digits(float n) {
+    float count = 1.0;
+    for(int i = 1; i < 10; ++i) {
+        if(n >= exp10i(float(i))) {
+            count += 1.0;
+        }
+    }
+    return count;
+}
+
+bool is_odd(float n) {
+    return n - 2.0 * floor(n / 2.0) == 1.0;
+}
+
+// n * 10^-j, rounded half to even like printf. Exact for n < 2^24.
+float round_scaled(float n, float j) {
+    float ip = floor(n);
+
+    if(j >= 0.0) {
+        float p = j <= 10.0 ? exp10i(j) : pow(10.0, j);
+        float q = floor_div(ip, p);
+        float twice_rem = 2.0 * (ip - q * p + (n - ip));
+        if(twice_rem > p || (twice_rem == p && is_odd(q))) {
+            q += 1.0;
+        }
+        return q;
+    }
+
+    // The fractional part is split in 12 bit chunks, whose products with
+    // the scale are exact
+    float s = exp10i(-j);
+    float f = n - ip;
+    float f1 = floor(f * 4096.0) / 4096.0;
+    float f2 = floor((f - f1) * 16777216.0) / 16777216.0;
+    float f3 = f - f1 - f2;
+    float p1 = f1 * s;
+    float p2 = f2 * s;
+    float p3 = f3 * s;
+    float q = ip * s + floor(p1);
+    float r = p1 - floor(p1);
+
+    // The remainder r + p2 + p3 is compared with 1 and 0.5; the sign of
+    // each difference is exact
+    if((r - 1.0) + p2 + p3 >= 0.0) {
+        q += 1.0;
+        r -= 1.0;
+    }
+    float half_diff = (r - 0.5) + p2 + p3;
+    if(half_diff > 0.0 || (half_diff == 0.0 && is_odd(q))) {
+        q += 1.0;
+    }
+    return q;
+}
+
+Label exponent_label(float a, float negative) {
+    float e = 0.0;
+    float r = 0.0;
+    if(a > 0.0) {
+        // log2 is approximate; the mantissa must have four digits
+        e = floor(log2(a) * 0.30102999566);
+        r = round_scaled(a, e - 3.0);
+        if(r < 1000.0) {
+            e -= 1.0;
+            r = round_scaled(a, e - 3.0);
+        } else if(r >= 10000.0) {
+            e += 1.0;
+            r = round_scaled(a, e - 3.0);
+        }
+    }
+    return Label(MODE_EXPONENT, negative, r, 4.0, e, negative + 9.0);
+}
+
+Label make_label(float value) {
+    float negative = value < 0.0 ? 1.0 : 0.0;
+    float a = abs(value);
+
+    if(label_format == 2) {
+        // NaNs fail every comparison
+        if(!(value < 0.0 || value >= 0.0)) {
+            return Label(MODE_NAN, 0.0, 0.0, 0.0, 0.0, 3.0);
+        }
+        if(a > 3.402823e38) {
+            return Label(MODE_INF, negative, 0.0, 0.0, 0.0, negative + 3.0);
+        }
+        if(a < 10000.0) {
+            float r = round_scaled(a, -3.0);
+            float digits = max(4.0, num_digits(r));
+            if(negative + digits + 1.0 <= 7.0) {
+                return Label(MODE_FIXED, negative, r, digits, 0.0,
+                             negative + digits + 1.0);
+            }
+        }
+        return exponent_label(a, negative);
+    }
+
+    float digits = num_digits(a);
+    if(label_format == 1 && negative + digits > 7.0) {
+        return exponent_label(a, negative);
+    }
+    return Label(MODE_INTEGER, negative, a, digits, 0.0, negative + digits);
+}
+
+// Glyph of the i-th character of a label
+float label_glyph(Label label, float i) {
+    if(label.negative > 0.5) {
+        if(i < 0.5) {
+            return GLYPH_MINUS;
+        }
+        i -= 1.0;
+    }
+
+    if(label.mode == MODE_NAN) {
+        return i < 0.5 ? GLYPH_N : (i < 1.5 ? GLYPH_A : GLYPH_N);
+    }
+    if(label.mode == MODE_INF) {
+        return i < 0.5 ? GLYPH_I : (i < 1.5 ? GLYPH_N : GLYPH_F);
+    }
+    if(label.mode == MODE_INTEGER) {
+        return digit(label.number, label.digits - 1.0 - i);
+    }
+    if(label.mode == MODE_FIXED) {
+        float int_digits = label.digits - 3.0;
+        if(i < int_digits) {
+            return digit(label.number, label.digits - 1.0 - i);
+        }
+        if(i < int_digits + 0.5) {
+            return GLYPH_DOT;
+        }
+        return digit(label.number, label.digits - i);
+    }
+
+    // d.ddde+dd
+    if(i < 0.5) {
+        return digit(label.number, 3.0);
+    }
+    if(i < 1.5) {
+        return GLYPH_DOT;
+    }
+    if(i < 4.5) {
+        return digit(label.number, 4.0 - i);
+    }
+    if(i < 5.5) {
+        return GLYPH_E;
+    }
+    if(i < 6.5) {
+        return label.exponent < 0.0 ? GLYPH_MINUS : GLYPH_PLUS;
+    }
+    return digit(abs(label.exponent), 8.0 - i);
+}
+
+float channel_component(vec4 v, int c) {
+    if(c == 0) {
+        return v.r;
+    } else if(c == 1) {
+        return v.g;
+    } else if(c == 2) {
+        return v.b;
+    }
+    return v.a;
+}
+
+void main()
+{
+    vec2 pixel = floor(pix_pos);
+    vec4 texel = texture2D(buff_sampler, (pixel + 0.5) / tile_size);
+
+    // Position relative to the pixel center, in the displayed orientation
+    vec2 local = pix_pos - pixel - 0.5;
+    vec2 pos = vec2(text_rotation.x*local.x - text_rotation.y*local.y,
+                    text_rotation.y*local.x + text_rotation.x*local.y);
+
+    float glyph = -1.0;
+    vec2 glyph_coord = vec2(0.0);
+
+    for(int c = 0; c < 4; ++c) {
+        if(c >= channels) {
+            break;
+        }
+
+        float value = channel_component(texel, c) * value_scale;
+        if(label_format != 2) {
+            value = floor(value + 0.5);
+        }
+        Label label = make_label(value);
+
+        float box_w = 0.0;
+        float box_h = 0.0;
+        for(int i = 0; i < 10; ++i) {
+            if(float(i) >= label.length) {
+                break;
+            }
+            int g = int(label_glyph(label, float(i)));
+            box_w += glyph_advance[g];
+            box_h = max(box_h, glyph_box[g].w);
+        }
+
+        float pen = -box_w/2.0 * text_scale;
+        float baseline = box_h/2.0 * text_scale -
+                         channel_component(channel_offsets, c);
+
+        for(int i = 0; i < 10; ++i) {
+            if(float(i) >= label.length) {
+                break;
+            }
+            int g = int(label_glyph(label, float(i)));
+            vec2 origin = vec2(pen + glyph_box[g].x * text_scale,
+                               baseline - glyph_box[g].y * text_scale);
+            vec2 t = (pos - origin) / (glyph_box[g].zw * text_scale);
+            if(t.x >= 0.0 && t.y >= 0.0 && t.x < 1.0 && t.y < 1.0) {
+                glyph = float(g);
+                glyph_coord = mix(glyph_uv[g].xy, glyph_uv[g].zw, t);
+            }
+            pen += glyph_advance[g] * text_scale;
+        }
+    }
+
+    // The atlas is sampled outside of the branches above, where its
+    // derivatives are defined
+    float text_color = texture2D(text_sampler, glyph_coord).r;
+    if(glyph < 0.0) {
+        text_color = 0.0;
+    }
+
+    float buff_color = texel.r*brightness_contrast[0].x + brightness_contrast[1].x;
+    float pix_intensity = roundFloat(1.0-buff_color);
+
+    gl_FragColor = vec4(vec3(pix_intensity), text_color);
+}
+
+)";
+
+} // namespace shader
@@ -0,0 +1,18 @@
+namespace shader {
+
+const char* label_vert_shader = R"(
+
+// xy: position, zw: coordinate within the tile, in pixels
+attribute vec4 inputPosition;
+varying vec2 pix_pos;
+
+uniform mat4 mvp;
+
+void main(void) {
+    gl_Position = mvp*vec4(inputPosition.xy, 0.0, 1.0);
+    pix_pos = inputPosition.zw;
+}
+
+)";
+
+} // namespace shader
@@ -4,11 +4,12 @@ const char* text_frag_shader = R"(
 
 uniform sampler2D buff_sampler;
 uniform sampler2D text_sampler;
-uniform vec2 pix_coord;
 uniform vec4 brightness_contrast[2];
 
 // Ouput data
 varying vec2 uv;
+// Coordinate of the labelled pixel, the same on all vertices of a label
+varying vec2 pix_coord;
 
 float roundFloat(float f) {
     return float(int(f+0.5));
@@ -3,13 +3,16 @@ namespace shader {
 const char* text_vert_shader = R"(
 
 attribute vec4 inputPosition;
+attribute vec2 pixCoord;
 varying vec2 uv;
+varying vec2 pix_coord;
 
 uniform mat4 mvp;
 
 void main(void) {
     gl_Position = mvp*vec4(inputPosition.xy, 0.0, 1.0);
     uv = inputPosition.zw;
+    pix_coord = pixCoord;
 }
 
 )";
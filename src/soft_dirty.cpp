@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "soft_dirty.hpp"
+
+using namespace std;
+
+namespace {
+
+const uint64_t soft_dirty_bit = 1ull << 55;
+
+bool read_page_map(const string& path,
+                   uint64_t first_page,
+                   size_t num_pages,
+                   vector<uint64_t>& entries) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+
+    entries.resize(num_pages);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(entries.data());
+    const size_t size = num_pages * sizeof(uint64_t);
+    const off_t offset = static_cast<off_t>(first_page * sizeof(uint64_t));
+
+    size_t done = 0;
+    while(done < size) {
+        ssize_t result = pread(fd, dst + done, size - done, offset + done);
+        if(result <= 0) {
+            if(result < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += static_cast<size_t>(result);
+    }
+
+    close(fd);
+    return done == size;
+}
+
+} // namespace
+
+size_t page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+bool soft_dirty_supported() {
+    // A page we just wrote to must be reported as soft-dirty
+    static const bool supported = []() {
+        void* page = mmap(nullptr, page_size(), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(page == MAP_FAILED) {
+            return false;
+        }
+        *static_cast<volatile uint8_t*>(page) = 1;
+
+        vector<uint64_t> entries;
+        bool dirty = read_page_map("/proc/self/pagemap",
+                                   reinterpret_cast<uintptr_t>(page) / page_size(),
+                                   1, entries) &&
+                     (entries[0] & soft_dirty_bit) != 0;
+
+        munmap(page, page_size());
+        return dirty;
+    }();
+    return supported;
+}
+
+bool clear_soft_dirty(pid_t pid) {
+    string path = "/proc/" + to_string(pid) + "/clear_refs";
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+
+    // Value 4 clears the soft-dirty bits of all the pages
+    bool ok = write(fd, "4", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+bool read_soft_dirty_pages(pid_t pid,
+                           uint64_t address,
+                           size_t size,
+                           vector<bool>& dirty) {
+    const uint64_t first_page = address / page_size();
+    const uint64_t last_page = (address + std::max<size_t>(size, 1) - 1) / page_size();
+
+    vector<uint64_t> entries;
+    if(!read_page_map("/proc/" + to_string(pid) + "/pagemap",
+                      first_page, last_page - first_page + 1, entries)) {
+        return false;
+    }
+
+    dirty.resize(entries.size());
+    for(size_t i = 0; i < entries.size(); ++i) {
+        dirty[i] = (entries[i] & soft_dirty_bit) != 0;
+    }
+    return true;
+}
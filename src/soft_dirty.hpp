@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+
+/*
+ * Tracks which pages a local process writes to, through the soft-dirty bits
+ * of Linux: the bits are cleared when the process resumes, and the pages
+ * written to until the next stop have theirs set again in
+ * /proc/<pid>/pagemap. Kernels built without soft-dirty support never set
+ * the bits, which soft_dirty_supported() finds out.
+ */
+
+size_t page_size();
+
+bool soft_dirty_supported();
+
+// Returns false if the bits couldn't be cleared
+bool clear_soft_dirty(pid_t pid);
+
+// Fills dirty with one flag per page of the range, starting with the page
+// address is in. Returns false if the page map couldn't be read.
+bool read_soft_dirty_pages(pid_t pid,
+                           uint64_t address,
+                           size_t size,
+                           std::vector<bool>& dirty);
@@ -20,7 +20,8 @@ bool Stage::initialize(GLCanvas *gl_canvas,
                        Buffer::BufferType type,
                        int step,
                        const string& pixel_layout,
-                       bool ac_enabled) {
+                       bool ac_enabled,
+                       std::shared_ptr<const TileAnalysis> tile_analysis) {
     contrast_enabled = ac_enabled;
 
     std::shared_ptr<GameObject> camera_obj = std::make_shared<GameObject>();
@@ -41,6 +42,7 @@ bool Stage::initialize(GLCanvas *gl_canvas,
     buffer_component->buffer_height_f = static_cast<float>(buffer_height_i);
     buffer_component->step = step;
     buffer_component->set_pixel_layout(pixel_layout);
+    buffer_component->set_prepared_tile_analysis(tile_analysis);
     buffer_obj->add_component("buffer_component", buffer_component);
 
     all_game_objects["buffer"] = buffer_obj;
@@ -66,7 +68,8 @@ bool Stage::buffer_update(uint8_t *buffer,
                           int channels,
                           Buffer::BufferType type,
                           int step,
-                          const string& pixel_layout) {
+                          const string& pixel_layout,
+                          std::shared_ptr<const TileAnalysis> tile_analysis) {
     GameObject* buffer_obj = all_game_objects["buffer"].get();
     Buffer* buffer_component = buffer_obj->getComponent<Buffer>("buffer_component");
 
@@ -77,6 +80,7 @@ bool Stage::buffer_update(uint8_t *buffer,
     buffer_component->buffer_height_f = static_cast<float>(buffer_height_i);
     buffer_component->step = step;
     buffer_component->set_pixel_layout(pixel_layout);
+    buffer_component->set_prepared_tile_analysis(tile_analysis);
 
     for(auto& game_obj_it: all_game_objects) {
         GameObject* game_obj = game_obj_it.second.get();
@@ -157,3 +161,21 @@ void Stage::mouse_drag_event(int mouse_x, int mouse_y) {
     }
 
 }
+
+bool Stage::has_pending_uploads() {
+    GameObject* buffer_obj = all_game_objects["buffer"].get();
+    Buffer* buffer_component = buffer_obj->getComponent<Buffer>("buffer_component");
+    return buffer_component->has_pending_uploads();
+}
+
+bool Stage::poll_buffer_stats() {
+    GameObject* buffer_obj = all_game_objects["buffer"].get();
+    Buffer* buffer_component = buffer_obj->getComponent<Buffer>("buffer_component");
+    return buffer_component->poll_stats();
+}
+
+bool Stage::buffer_stats_pending() {
+    GameObject* buffer_obj = all_game_objects["buffer"].get();
+    Buffer* buffer_component = buffer_obj->getComponent<Buffer>("buffer_component");
+    return buffer_component->stats_pending();
+}
@@ -20,7 +20,8 @@ public:
                     Buffer::BufferType type,
                     int step,
                     const string& pixel_layout,
-                    bool ac_enabled);
+                    bool ac_enabled,
+                    std::shared_ptr<const TileAnalysis> tile_analysis = nullptr);
 
     bool buffer_update(uint8_t* buffer,
                        int buffer_width_i,
@@ -28,7 +29,8 @@ public:
                        int channels,
                        Buffer::BufferType type,
                        int step,
-                       const string& pixel_layout);
+                       const string& pixel_layout,
+                       std::shared_ptr<const TileAnalysis> tile_analysis = nullptr);
 
     GameObject* getGameObject(std::string tag);
 
@@ -42,6 +44,12 @@ public:
 
     void mouse_drag_event(int mouse_x, int mouse_y);
 
+    bool has_pending_uploads();
+
+    bool poll_buffer_stats();
+
+    bool buffer_stats_pending();
+
     bool contrast_enabled;
 
     std::vector<uint8_t> buffer_icon_;
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "min_max.hpp"
+#include "stats_engine.hpp"
+
+using namespace std;
+
+namespace {
+
+template<typename T>
+bool is_nan(T value) {
+    return numeric_limits<T>::has_quiet_NaN && value != value;
+}
+
+template<typename T>
+bool is_inf(T value) {
+    return numeric_limits<T>::has_infinity &&
+           (value == numeric_limits<T>::infinity() ||
+            value == -numeric_limits<T>::infinity());
+}
+
+// Maps floats to unsigned integers with the same ordering
+uint32_t float_key(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+float key_float(uint32_t key) {
+    uint32_t bits = (key & 0x80000000u) ? (key & 0x7fffffffu) : ~key;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Float keys are binned on their upper 20 bits
+const int float_bin_shift = 12;
+
+// Histogram bins of the values of a type; see BufferStats
+template<typename T>
+struct HistogramBinning {
+    static const bool float_binning =
+            !is_integral<T>::value || sizeof(T) > 2;
+    static const size_t bins = sizeof(T) == 1 ? 256 :
+                               sizeof(T) == 2 ? 65536 :
+                               size_t(1) << (32 - float_bin_shift);
+
+    static float offset() {
+        return float_binning ? 0.f : numeric_limits<T>::lowest();
+    }
+
+    static uint32_t bin(T value) {
+        if(float_binning) {
+            return float_key(static_cast<float>(value)) >> float_bin_shift;
+        }
+        return static_cast<uint32_t>(static_cast<int>(value) -
+                                     static_cast<int>(numeric_limits<T>::lowest()));
+    }
+};
+
+} // namespace
+
+double BufferStats::histogram_position(double value) const {
+    if(float_binning) {
+        return static_cast<double>(float_key(static_cast<float>(value))) /
+               (1 << float_bin_shift);
+    }
+    return value - histogram_offset;
+}
+
+double BufferStats::histogram_value(double position) const {
+    if(float_binning) {
+        double key = std::min(std::max(std::floor(position * (1 << float_bin_shift)),
+                                       0.0),
+                              static_cast<double>(numeric_limits<uint32_t>::max()));
+        return key_float(static_cast<uint32_t>(key));
+    }
+    return position + histogram_offset;
+}
+
+float BufferStats::percentile(int channel, double fraction) const {
+    const BlockHistogram<uint64_t>& histogram = histograms[channel];
+    const float lowest = histogram_min[channel];
+    const float upper = histogram_max[channel];
+
+    uint64_t total = 0;
+    for(size_t index = 0; index < histogram.num_blocks(); ++index) {
+        if(const vector<uint64_t>* counts = histogram.block(index)) {
+            for(uint64_t count: *counts) {
+                total += count;
+            }
+        }
+    }
+    if(total == 0 || fraction <= 0.0) {
+        return lowest;
+    }
+    if(fraction >= 1.0) {
+        return upper;
+    }
+
+    const double target = fraction * total;
+
+    double cumulative = 0.0;
+    for(size_t index = 0; index < histogram.num_blocks(); ++index) {
+        const vector<uint64_t>* counts = histogram.block(index);
+        if(counts == nullptr) {
+            continue;
+        }
+        for(size_t i = 0; i < counts->size(); ++i) {
+            const uint64_t count = (*counts)[i];
+            if(count > 0 && cumulative + count >= target) {
+                double t = (target - cumulative) / count;
+                double bin = (index << BlockHistogram<uint64_t>::block_bits) + i;
+                float value = static_cast<float>(histogram_value(bin + t));
+                return std::min(std::max(value, lowest), upper);
+            }
+            cumulative += count;
+        }
+    }
+
+    return upper;
+}
+
+StatsJob::StatsJob() : remaining_bands_(0), done_(false) {}
+
+template<typename T>
+shared_ptr<StatsJob> StatsJob::start(ThreadPool& pool,
+                                     const T* src,
+                                     size_t src_row_stride,
+                                     int width,
+                                     int height,
+                                     int channels,
+                                     int tile_size,
+                                     const TileStatsList& previous,
+                                     const vector<bool>& reusable) {
+    typedef HistogramBinning<T> Binning;
+
+    shared_ptr<StatsJob> job(new StatsJob());
+    job->pool_ = &pool;
+    job->channels_ = channels;
+    job->float_binning_ = Binning::float_binning;
+    job->histogram_offset_ = Binning::offset();
+    job->histogram_bins_ = Binning::bins;
+
+    const int num_tiles_x = (width + tile_size - 1) / tile_size;
+    const int num_tiles_y = (height + tile_size - 1) / tile_size;
+    const int num_tiles = num_tiles_x * num_tiles_y;
+    const bool reuse_previous =
+            previous.size() == static_cast<size_t>(num_tiles) &&
+            reusable.size() == static_cast<size_t>(num_tiles);
+
+    // Tiles that didn't change keep their statistics, the others are split
+    // in enough bands to keep all workers busy until the end of the job
+    job->tile_stats_.resize(num_tiles);
+    vector<int> changed_tiles;
+    for(int tile_id = 0; tile_id < num_tiles; ++tile_id) {
+        if(reuse_previous && reusable[tile_id] && previous[tile_id] != nullptr) {
+            job->tile_stats_[tile_id] = previous[tile_id];
+        } else {
+            changed_tiles.push_back(tile_id);
+        }
+    }
+
+    const int target_bands = 4 * pool.size();
+    const int bands_per_tile = changed_tiles.empty() ? 1 :
+            max<int>(1, (target_bands + changed_tiles.size() - 1) /
+                        changed_tiles.size());
+    for(int tile_id: changed_tiles) {
+        const int tile_x = (tile_id % num_tiles_x) * tile_size;
+        const int tile_y = (tile_id / num_tiles_x) * tile_size;
+        const int tile_w = min(width - tile_x, tile_size);
+        const int tile_h = min(height - tile_y, tile_size);
+        const int tile_bands = min(bands_per_tile, tile_h);
+
+        shared_ptr<TileStats> tile = make_shared<TileStats>();
+        tile->bands.resize(tile_bands);
+        for(int c = 0; c < channels; ++c) {
+            tile->histograms[c].resize(Binning::bins);
+        }
+        job->tile_stats_[tile_id] = tile;
+
+        for(int band = 0; band < tile_bands; ++band) {
+            TileBand tile_band;
+            tile_band.tile = tile;
+            tile_band.band = band;
+            tile_band.x = tile_x;
+            tile_band.y0 = tile_y + tile_h * band / tile_bands;
+            tile_band.y1 = tile_y + tile_h * (band + 1) / tile_bands;
+            tile_band.width = tile_w;
+            job->tile_bands_.push_back(tile_band);
+        }
+    }
+
+    MinMaxKernel min_max_kernel = select_min_max_kernel<T>(channels);
+
+    job->scan_band_ = [=](const TileBand& tile_band,
+                          BandMoments& m,
+                          BlockHistogram<uint32_t>* histograms) {
+        const int y0 = tile_band.y0;
+        const int y1 = tile_band.y1;
+        const T* band_src = src + tile_band.x * channels;
+
+        // The extrema give the shift of the sums, and keep the infinite
+        // values the other loop skips
+        min_max_kernel(band_src + y0 * src_row_stride, src_row_stride,
+                       tile_band.width, y1 - y0, m.min, m.max);
+
+        for(int c = 0; c < channels; ++c) {
+            m.finite_min[c] = numeric_limits<float>::max();
+            m.finite_max[c] = numeric_limits<float>::lowest();
+            m.count[c] = 0;
+            m.shift[c] = std::isfinite(m.min[c]) ? m.min[c] : 0.0;
+            m.sum[c] = 0.0;
+            m.sum_sq[c] = 0.0;
+            m.nan_count[c] = 0;
+            m.inf_count[c] = 0;
+        }
+
+        for(int y = y0; y < y1; ++y) {
+            const T* row = band_src + y * src_row_stride;
+            for(int x = 0; x < tile_band.width; ++x) {
+                for(int c = 0; c < channels; ++c) {
+                    T value = row[x * channels + c];
+                    if(is_nan(value)) {
+                        ++m.nan_count[c];
+                        continue;
+                    }
+                    if(is_inf(value)) {
+                        ++m.inf_count[c];
+                        continue;
+                    }
+                    float fvalue = static_cast<float>(value);
+                    m.finite_min[c] = std::min(m.finite_min[c], fvalue);
+                    m.finite_max[c] = std::max(m.finite_max[c], fvalue);
+
+                    double shifted = static_cast<double>(value) - m.shift[c];
+                    m.sum[c] += shifted;
+                    m.sum_sq[c] += shifted * shifted;
+                    ++m.count[c];
+
+                    histograms[c].add(Binning::bin(value));
+                }
+            }
+        }
+    };
+
+    job->submit_bands();
+
+    return job;
+}
+
+bool StatsJob::is_done() const {
+    return done_.load(memory_order_acquire);
+}
+
+void StatsJob::cancel() {
+    unique_lock<mutex> lock(mtx_);
+    cancelled_ = true;
+    idle_cv_.wait(lock, [this]() { return running_tasks_ == 0; });
+}
+
+const BufferStats& StatsJob::stats() const {
+    return stats_;
+}
+
+const StatsJob::TileStatsList& StatsJob::tile_stats() const {
+    return tile_stats_;
+}
+
+bool StatsJob::begin_task() {
+    unique_lock<mutex> lock(mtx_);
+    if(cancelled_) {
+        return false;
+    }
+    ++running_tasks_;
+    return true;
+}
+
+void StatsJob::end_task() {
+    unique_lock<mutex> lock(mtx_);
+    --running_tasks_;
+    idle_cv_.notify_all();
+}
+
+void StatsJob::submit_bands() {
+    // Nothing to scan if no tile changed
+    if(tile_bands_.empty()) {
+        merge_tiles();
+        done_.store(true, memory_order_release);
+        return;
+    }
+
+    remaining_bands_ = static_cast<int>(tile_bands_.size());
+    shared_ptr<StatsJob> self = shared_from_this();
+
+    for(size_t i = 0; i < tile_bands_.size(); ++i) {
+        pool_->submit([self, i]() {
+            if(!self->begin_task()) {
+                return;
+            }
+
+            // Bands of the same tile count their values apart, and add
+            // them to the tile when they are done
+            const TileBand& tile_band = self->tile_bands_[i];
+            BlockHistogram<uint32_t> histograms[4];
+            for(int c = 0; c < self->channels_; ++c) {
+                histograms[c].resize(self->histogram_bins_);
+            }
+            self->scan_band_(tile_band,
+                             tile_band.tile->bands[tile_band.band],
+                             histograms);
+
+            {
+                unique_lock<mutex> lock(self->mtx_);
+                for(int c = 0; c < self->channels_; ++c) {
+                    tile_band.tile->histograms[c].add(histograms[c]);
+                }
+            }
+
+            // The last band to finish gathers the statistics of all tiles
+            if(--self->remaining_bands_ == 0) {
+                self->merge_tiles();
+                self->done_.store(true, memory_order_release);
+            }
+            self->end_task();
+        });
+    }
+}
+
+void StatsJob::merge_tiles() {
+    BufferStats& stats = stats_;
+    stats.channels = channels_;
+    stats.float_binning = float_binning_;
+    stats.histogram_offset = histogram_offset_;
+
+    for(int c = 0; c < 4; ++c) {
+        stats.min[c] = 0.0f;
+        stats.max[c] = 0.0f;
+        stats.mean[c] = 0.0;
+        stats.stddev[c] = 0.0;
+        stats.nan_count[c] = 0;
+        stats.inf_count[c] = 0;
+        stats.histogram_min[c] = 0.0f;
+        stats.histogram_max[c] = 0.0f;
+        stats.histograms[c].resize(0);
+    }
+
+    for(int c = 0; c < channels_; ++c) {
+        float lowest = numeric_limits<float>::max();
+        float upper = numeric_limits<float>::lowest();
+        float finite_lowest = numeric_limits<float>::max();
+        float finite_upper = numeric_limits<float>::lowest();
+        uint64_t count = 0;
+        double total = 0.0;
+
+        stats.histograms[c].resize(histogram_bins_);
+        for(const auto& tile: tile_stats_) {
+            for(const auto& m: tile->bands) {
+                lowest = std::min(lowest, m.min[c]);
+                upper = std::max(upper, m.max[c]);
+                finite_lowest = std::min(finite_lowest, m.finite_min[c]);
+                finite_upper = std::max(finite_upper, m.finite_max[c]);
+                stats.nan_count[c] += m.nan_count[c];
+                stats.inf_count[c] += m.inf_count[c];
+                count += m.count[c];
+                total += m.shift[c] * m.count[c] + m.sum[c];
+            }
+            stats.histograms[c].add(tile->histograms[c]);
+        }
+
+        stats.min[c] = lowest;
+        stats.max[c] = upper;
+
+        if(count == 0) {
+            continue;
+        }
+
+        double mean = total / count;
+
+        // Combine the squared deviations of the bands around their own mean
+        // with the deviations of the band means around the global one
+        double squared_deviations = 0.0;
+        for(const auto& tile: tile_stats_) {
+            for(const auto& m: tile->bands) {
+                if(m.count[c] == 0) {
+                    continue;
+                }
+                double band_mean = m.shift[c] + m.sum[c] / m.count[c];
+                double band_deviations = m.sum_sq[c] -
+                                         m.sum[c] * m.sum[c] / m.count[c];
+                double offset = band_mean - mean;
+                squared_deviations += std::max(0.0, band_deviations) +
+                                      offset * offset * m.count[c];
+            }
+        }
+
+        stats.mean[c] = mean;
+        stats.stddev[c] = std::sqrt(squared_deviations / count);
+        stats.histogram_min[c] = finite_lowest;
+        stats.histogram_max[c] = finite_upper;
+    }
+}
+
+template shared_ptr<StatsJob> StatsJob::start<uint8_t>(
+        ThreadPool&, const uint8_t*, size_t, int, int, int, int,
+        const StatsJob::TileStatsList&, const vector<bool>&);
+template shared_ptr<StatsJob> StatsJob::start<uint16_t>(
+        ThreadPool&, const uint16_t*, size_t, int, int, int, int,
+        const StatsJob::TileStatsList&, const vector<bool>&);
+template shared_ptr<StatsJob> StatsJob::start<int16_t>(
+        ThreadPool&, const int16_t*, size_t, int, int, int, int,
+        const StatsJob::TileStatsList&, const vector<bool>&);
+template shared_ptr<StatsJob> StatsJob::start<int32_t>(
+        ThreadPool&, const int32_t*, size_t, int, int, int, int,
+        const StatsJob::TileStatsList&, const vector<bool>&);
+template shared_ptr<StatsJob> StatsJob::start<float>(
+        ThreadPool&, const float*, size_t, int, int, int, int,
+        const StatsJob::TileStatsList&, const vector<bool>&);
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+/*
+ * Counts of values in consecutive bins. Bins are allocated in blocks, as
+ * values fall into them, so that a histogram spanning a wide range of bins
+ * only takes memory where there are values.
+ */
+template<typename Count>
+class BlockHistogram {
+public:
+    static const int block_bits = 12;
+    static const uint32_t block_size = 1u << block_bits;
+
+    void resize(size_t num_bins) {
+        blocks_.assign((num_bins + block_size - 1) >> block_bits,
+                       std::vector<Count>());
+    }
+
+    size_t num_blocks() const {
+        return blocks_.size();
+    }
+
+    // Counts of the bins of a block, or null if none has a value
+    const std::vector<Count>* block(size_t index) const {
+        return blocks_[index].empty() ? nullptr : &blocks_[index];
+    }
+
+    void add(uint32_t bin) {
+        std::vector<Count>& counts = blocks_[bin >> block_bits];
+        if(counts.empty()) {
+            counts.assign(block_size, 0);
+        }
+        ++counts[bin & (block_size - 1)];
+    }
+
+    // other must have the same number of bins
+    template<typename OtherCount>
+    void add(const BlockHistogram<OtherCount>& other) {
+        for(size_t index = 0; index < blocks_.size(); ++index) {
+            const std::vector<OtherCount>* other_counts = other.block(index);
+            if(other_counts == nullptr) {
+                continue;
+            }
+            std::vector<Count>& counts = blocks_[index];
+            if(counts.empty()) {
+                counts.assign(block_size, 0);
+            }
+            for(uint32_t i = 0; i < block_size; ++i) {
+                counts[i] += (*other_counts)[i];
+            }
+        }
+    }
+
+private:
+    std::vector<std::vector<Count>> blocks_;
+};
+
+/*
+ * Per channel statistics of a buffer. min and max ignore NaNs, but keep
+ * infinite values; NaN and infinite values are otherwise only counted, and
+ * are excluded from the mean, the standard deviation and the histograms.
+ */
+struct BufferStats {
+    int channels = 0;
+    float min[4];
+    float max[4];
+    double mean[4];
+    double stddev[4];
+    uint64_t nan_count[4];
+    uint64_t inf_count[4];
+
+    // Bins don't depend on the contents, so that histograms are filled in
+    // the same pass as the moments, and the histograms of tiles add up.
+    // Integer types of up to 16 bits get one bin per value, starting at
+    // histogram_offset. Other types are binned on the upper 20 bits of the
+    // order preserving integer representation of their values as floats:
+    // bins widen with the magnitude of the values, so a single huge outlier
+    // doesn't squeeze all the other values into the first bin.
+    bool float_binning = false;
+    float histogram_offset = 0.f;
+    // Range of the finite values of each channel
+    float histogram_min[4];
+    float histogram_max[4];
+    BlockHistogram<uint64_t> histograms[4];
+
+    // Coordinate of a value along the histogram axis, in bins, and its
+    // inverse
+    double histogram_position(double value) const;
+    double histogram_value(double position) const;
+
+    // Value below which the given fraction of the finite values of a channel
+    // lie, interpolated within its histogram bin
+    float percentile(int channel, double fraction) const;
+};
+
+/*
+ * Computes the BufferStats of a buffer on a ThreadPool, so that big buffers
+ * don't block the GUI thread. The buffer is split in tiles, and the tiles in
+ * row bands, which are scanned once for their extrema, moments and
+ * histograms. The statistics of each tile are kept, so that a job on the
+ * next contents of the buffer only scans the tiles that changed.
+ */
+class StatsJob : public std::enable_shared_from_this<StatsJob> {
+public:
+    struct BandMoments {
+        float min[4];
+        float max[4];
+        float finite_min[4];
+        float finite_max[4];
+        uint64_t count[4];
+        // Sums are taken relative to shift, to preserve the precision of the
+        // variance when the mean is large
+        double shift[4];
+        double sum[4];
+        double sum_sq[4];
+        uint64_t nan_count[4];
+        uint64_t inf_count[4];
+    };
+
+    // Moments of the row bands of a tile, and the histograms of its channels
+    struct TileStats {
+        std::vector<BandMoments> bands;
+        BlockHistogram<uint32_t> histograms[4];
+    };
+
+    // Tiles are in row major order
+    typedef std::vector<std::shared_ptr<const TileStats>> TileStatsList;
+
+    // src_row_stride is given in elements. The source memory must stay valid
+    // until the job is done or cancelled. Tiles flagged in reusable take
+    // their statistics from previous, which must come from a job on a
+    // buffer of the same type, size and tile_size.
+    template<typename T>
+    static std::shared_ptr<StatsJob> start(ThreadPool& pool,
+                                           const T* src,
+                                           size_t src_row_stride,
+                                           int width,
+                                           int height,
+                                           int channels,
+                                           int tile_size,
+                                           const TileStatsList& previous =
+                                                   TileStatsList(),
+                                           const std::vector<bool>& reusable =
+                                                   std::vector<bool>());
+
+    bool is_done() const;
+
+    // When this returns, no band is being processed anymore and the source
+    // memory can be released
+    void cancel();
+
+    // Only valid once is_done() returns true
+    const BufferStats& stats() const;
+
+    // Only valid once is_done() returns true
+    const TileStatsList& tile_stats() const;
+
+private:
+    // Band of a tile scanned by a task
+    struct TileBand {
+        std::shared_ptr<TileStats> tile;
+        int band;
+        int x;
+        int y0;
+        int y1;
+        int width;
+    };
+
+    ThreadPool* pool_ = nullptr;
+    int channels_ = 0;
+    bool float_binning_ = false;
+    float histogram_offset_ = 0.f;
+    size_t histogram_bins_ = 0;
+    std::vector<TileBand> tile_bands_;
+    TileStatsList tile_stats_;
+    std::function<void(const TileBand&, BandMoments&,
+                       BlockHistogram<uint32_t>*)> scan_band_;
+    std::atomic<int> remaining_bands_;
+    std::atomic<bool> done_;
+    BufferStats stats_;
+
+    std::mutex mtx_;
+    std::condition_variable idle_cv_;
+    int running_tasks_ = 0;
+    bool cancelled_ = false;
+
+    StatsJob();
+
+    bool begin_task();
+    void end_task();
+
+    void submit_bands();
+    void merge_tiles();
+};
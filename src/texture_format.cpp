@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <limits>
+#include <GL/glew.h>
+
+#include "texture_format.hpp"
+
+TextureFormat TextureFormat::select(Buffer::BufferType type, int channels) {
+    // Sized internal formats, indexed by [channels-1]
+    static const GLenum unsigned_byte_formats[] = {
+        GL_R8, GL_RG8, GL_RGB8, GL_RGBA8
+    };
+    static const GLenum unsigned_short_formats[] = {
+        GL_R16, GL_RG16, GL_RGB16, GL_RGBA16
+    };
+    static const GLenum short_formats[] = {
+        GL_R16_SNORM, GL_RG16_SNORM, GL_RGB16_SNORM, GL_RGBA16_SNORM
+    };
+    static const GLenum float_formats[] = {
+        GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F
+    };
+    static const GLenum pixel_formats[] = {
+        GL_RED, GL_RG, GL_RGB, GL_RGBA
+    };
+
+    int format_idx = std::min(std::max(channels, 1), 4) - 1;
+
+    TextureFormat result;
+    result.pixel_format = pixel_formats[format_idx];
+
+    switch(type) {
+    case Buffer::BufferType::UnsignedByte:
+        result.internal_format = unsigned_byte_formats[format_idx];
+        result.pixel_type = GL_UNSIGNED_BYTE;
+        result.bytes_per_texel = 1;
+        result.max_intensity = std::numeric_limits<uint8_t>::max();
+        break;
+    case Buffer::BufferType::UnsignedShort:
+        result.internal_format = unsigned_short_formats[format_idx];
+        result.pixel_type = GL_UNSIGNED_SHORT;
+        result.bytes_per_texel = 2;
+        result.max_intensity = std::numeric_limits<unsigned short>::max();
+        break;
+    case Buffer::BufferType::Short:
+        result.internal_format = short_formats[format_idx];
+        result.pixel_type = GL_SHORT;
+        result.bytes_per_texel = 2;
+        result.max_intensity = std::numeric_limits<short>::max();
+        break;
+    case Buffer::BufferType::Int32:
+        // There are no 32 bit normalized formats; the GL converts the
+        // integers to normalized floats during the upload
+        result.internal_format = float_formats[format_idx];
+        result.pixel_type = GL_INT;
+        result.bytes_per_texel = 4;
+        result.max_intensity = std::numeric_limits<int>::max();
+        break;
+    case Buffer::BufferType::Float32:
+    case Buffer::BufferType::Float64:
+    default:
+        // Float64 buffers are converted to float32 before being plotted
+        result.internal_format = float_formats[format_idx];
+        result.pixel_type = GL_FLOAT;
+        result.bytes_per_texel = 4;
+        result.max_intensity = 1.0f;
+        break;
+    }
+
+    result.bytes_per_texel *= format_idx + 1;
+
+    return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <GL/gl.h>
+
+#include "buffer.hpp"
+
+/*
+ * Describes how a buffer is stored on the GPU. Integer buffers are kept in
+ * normalized fixed point formats, so the shaders keep sampling values in the
+ * [0, 1] (or [-1, 1] for signed types) range; max_intensity is the factor that
+ * converts a sampled value back to the original buffer range.
+ */
+struct TextureFormat {
+    GLenum internal_format;
+    GLenum pixel_format;
+    GLenum pixel_type;
+    int bytes_per_texel;
+    float max_intensity;
+
+    static TextureFormat select(Buffer::BufferType type, int channels);
+};
@@ -0,0 +1,90 @@
+#include <GL/glew.h>
+
+#include "texture_pool.hpp"
+
+using namespace std;
+
+TexturePool::~TexturePool() {
+    for(const auto& idle: idle_textures_) {
+        glDeleteTextures(1, &idle.texture);
+    }
+}
+
+GLuint TexturePool::acquire(const TextureFormat& format,
+                            int width,
+                            int height,
+                            int levels) {
+    TextureKey key;
+    key.internal_format = format.internal_format;
+    key.width = width;
+    key.height = height;
+    key.levels = levels;
+    key.bytes = static_cast<size_t>(width) * height * format.bytes_per_texel;
+    if(levels > 1) {
+        // A full mip chain takes about a third of the base level
+        key.bytes += key.bytes / 3;
+    }
+
+    for(auto it = idle_textures_.begin(); it != idle_textures_.end(); ++it) {
+        if(it->key == key) {
+            GLuint texture = it->texture;
+            idle_bytes_ -= key.bytes;
+            idle_textures_.erase(it);
+            used_textures_[texture] = key;
+            ++avoided_allocations_;
+
+            return texture;
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, levels, format.internal_format,
+                   width, height);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    used_textures_[texture] = key;
+
+    return texture;
+}
+
+void TexturePool::release(GLuint texture) {
+    auto used = used_textures_.find(texture);
+    if(used == used_textures_.end()) {
+        return;
+    }
+
+    IdleTexture idle;
+    idle.texture = texture;
+    idle.key = used->second;
+    used_textures_.erase(used);
+
+    idle_textures_.push_front(idle);
+    idle_bytes_ += idle.key.bytes;
+
+    trim(max_idle_bytes_);
+}
+
+size_t TexturePool::idle_bytes() const {
+    return idle_bytes_;
+}
+
+void TexturePool::trim(size_t max_idle_bytes) {
+    while(idle_bytes_ > max_idle_bytes && !idle_textures_.empty()) {
+        const IdleTexture& oldest = idle_textures_.back();
+        glDeleteTextures(1, &oldest.texture);
+        idle_bytes_ -= oldest.key.bytes;
+        idle_textures_.pop_back();
+    }
+}
+
+size_t TexturePool::avoided_allocations() const {
+    return avoided_allocations_;
+}
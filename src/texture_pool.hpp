@@ -0,0 +1,66 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <GL/gl.h>
+
+#include "texture_format.hpp"
+
+/*
+ * Recycles tile textures. Textures released by a buffer are kept idle and
+ * handed back when a texture with the same size and format is requested, so
+ * a buffer update with unchanged geometry only needs to re-specify the
+ * texture contents instead of allocating new storage. The GL context must be
+ * current when it is destroyed.
+ */
+class TexturePool {
+public:
+    static constexpr size_t default_max_idle_bytes = 256 * 1024 * 1024;
+
+    ~TexturePool();
+
+    GLuint acquire(const TextureFormat& format,
+                   int width,
+                   int height,
+                   int levels = 1);
+
+    void release(GLuint texture);
+
+    // Memory held by the idle textures
+    size_t idle_bytes() const;
+
+    // Deletes the least recently released idle textures until they take at
+    // most max_idle_bytes
+    void trim(size_t max_idle_bytes);
+
+    // Number of texture allocations avoided by reusing idle textures
+    size_t avoided_allocations() const;
+
+private:
+    struct TextureKey {
+        GLenum internal_format;
+        int width;
+        int height;
+        int levels;
+        size_t bytes;
+
+        bool operator==(const TextureKey& other) const {
+            return internal_format == other.internal_format &&
+                   width == other.width &&
+                   height == other.height &&
+                   levels == other.levels;
+        }
+    };
+
+    struct IdleTexture {
+        GLuint texture;
+        TextureKey key;
+    };
+
+    // Most recently released textures are kept at the front
+    std::list<IdleTexture> idle_textures_;
+    std::map<GLuint, TextureKey> used_textures_;
+    size_t idle_bytes_ = 0;
+    size_t max_idle_bytes_ = default_max_idle_bytes;
+    size_t avoided_allocations_ = 0;
+};
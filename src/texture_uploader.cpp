@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cstring>
+#include <GL/glew.h>
+
+#include "texture_uploader.hpp"
+
+using namespace std;
+
+TextureUploader::~TextureUploader() {
+    if(pbos_[0] != 0) {
+        glDeleteBuffers(2, pbos_);
+    }
+}
+
+void TextureUploader::initialize() {
+    glGenBuffers(2, pbos_);
+}
+
+void TextureUploader::enqueue(const void* owner,
+                              GLuint texture,
+                              const TextureFormat& format,
+                              const uint8_t* src,
+                              int row_stride,
+                              int width,
+                              int height,
+                              int level,
+                              function<void()> on_complete) {
+    UploadJob job;
+    job.owner = owner;
+    job.texture = texture;
+    job.format = format;
+    job.src = src;
+    job.row_stride = row_stride;
+    job.width = width;
+    job.height = height;
+    job.level = level;
+    job.uploaded_rows = 0;
+    job.on_complete = on_complete;
+
+    jobs_.push_back(job);
+}
+
+void TextureUploader::cancel(const void* owner) {
+    jobs_.erase(remove_if(jobs_.begin(), jobs_.end(),
+                          [owner](const UploadJob& job) {
+                              return job.owner == owner;
+                          }),
+                jobs_.end());
+}
+
+bool TextureUploader::has_pending_uploads() const {
+    return !jobs_.empty();
+}
+
+void TextureUploader::upload(size_t byte_budget) {
+    if(jobs_.empty()) {
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+
+    while(!jobs_.empty() && byte_budget > 0) {
+        UploadJob& job = jobs_.front();
+
+        byte_budget -= min(byte_budget, upload_band(job, byte_budget));
+
+        if(job.uploaded_rows == job.height) {
+            function<void()> on_complete = job.on_complete;
+            jobs_.pop_front();
+
+            if(on_complete) {
+                on_complete();
+            }
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+size_t TextureUploader::upload_band(UploadJob& job, size_t byte_budget) {
+    const size_t row_bytes = static_cast<size_t>(job.width) *
+                             job.format.bytes_per_texel;
+
+    // Always make progress, even if a single row exceeds the budget
+    int band_rows = max<int>(1, static_cast<int>(byte_budget / row_bytes));
+    band_rows = min(band_rows, job.height - job.uploaded_rows);
+    const size_t band_bytes = row_bytes * band_rows;
+
+    // The storage of each PBO is kept, and only grows when a band doesn't
+    // fit. Mapping it waits for the transfer of the band before last, while
+    // the GPU may still be copying the previous band from the other PBO.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos_[current_pbo_]);
+    if(band_bytes > pbo_sizes_[current_pbo_]) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, band_bytes, nullptr,
+                     GL_STREAM_DRAW);
+        pbo_sizes_[current_pbo_] = band_bytes;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(
+                glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, band_bytes,
+                                 GL_MAP_WRITE_BIT));
+    if(dst == nullptr) {
+        // Could not map the PBO; drop the remaining rows of this job
+        job.uploaded_rows = job.height;
+        return band_bytes;
+    }
+
+    const uint8_t* src = job.src +
+                         static_cast<size_t>(job.uploaded_rows) * job.row_stride;
+    for(int row = 0; row < band_rows; ++row) {
+        memcpy(dst, src, row_bytes);
+        dst += row_bytes;
+        src += job.row_stride;
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, job.level, 0, job.uploaded_rows,
+                    job.width, band_rows,
+                    job.format.pixel_format, job.format.pixel_type,
+                    nullptr);
+
+    job.uploaded_rows += band_rows;
+    current_pbo_ = 1 - current_pbo_;
+
+    return band_bytes;
+}
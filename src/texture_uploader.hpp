@@ -0,0 +1,63 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <GL/gl.h>
+
+#include "texture_format.hpp"
+
+/*
+ * Streams texture contents to the GPU through a pair of pixel buffer objects.
+ * Tiles are enqueued by their owners and uploaded in row bands by upload(),
+ * which is called once per frame and never transfers more than the given
+ * number of bytes. While the GPU copies one PBO into its texture, the next
+ * band is written into the other one. The GL context must be current when
+ * it is destroyed.
+ */
+class TextureUploader {
+public:
+    static constexpr size_t default_frame_budget = 16 * 1024 * 1024;
+
+    ~TextureUploader();
+
+    void initialize();
+
+    void enqueue(const void* owner,
+                 GLuint texture,
+                 const TextureFormat& format,
+                 const uint8_t* src,
+                 int row_stride,
+                 int width,
+                 int height,
+                 int level,
+                 std::function<void()> on_complete);
+
+    // Drops all pending uploads of the given owner. Must be called before the
+    // source memory or the target textures of these uploads are released.
+    void cancel(const void* owner);
+
+    void upload(size_t byte_budget = default_frame_budget);
+
+    bool has_pending_uploads() const;
+
+private:
+    struct UploadJob {
+        const void* owner;
+        GLuint texture;
+        TextureFormat format;
+        const uint8_t* src;
+        int row_stride;
+        int width;
+        int height;
+        int level;
+        int uploaded_rows;
+        std::function<void()> on_complete;
+    };
+
+    std::deque<UploadJob> jobs_;
+    GLuint pbos_[2] = {0, 0};
+    size_t pbo_sizes_[2] = {0, 0};
+    int current_pbo_ = 0;
+
+    size_t upload_band(UploadJob& job, size_t byte_budget);
+};
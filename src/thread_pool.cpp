@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "thread_pool.hpp"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int num_threads) {
+    if(num_threads <= 0) {
+        num_threads = max(1u, thread::hardware_concurrency());
+    }
+
+    for(int i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        unique_lock<mutex> lock(mtx_);
+        stopping_ = true;
+        tasks_.clear();
+    }
+    cv_.notify_all();
+
+    for(auto& worker: workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        unique_lock<mutex> lock(mtx_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::parallel_for(int count,
+                              int num_tasks,
+                              const function<void(int)>& body) {
+    // Shared with the helper tasks, which may only get to run once all
+    // indices are taken and this call returned. They don't call body then.
+    struct Work {
+        atomic<int> next_index;
+        int count;
+        const function<void(int)>* body;
+        mutex mtx;
+        condition_variable idle_cv;
+        int running_helpers = 0;
+    };
+    shared_ptr<Work> work = make_shared<Work>();
+    work->next_index = 0;
+    work->count = count;
+    work->body = &body;
+
+    auto run = [](Work& work) {
+        for(int i = work.next_index++; i < work.count; i = work.next_index++) {
+            (*work.body)(i);
+        }
+    };
+
+    num_tasks = min(num_tasks, count);
+    for(int i = 1; i < num_tasks; ++i) {
+        submit([work, run]() {
+            {
+                unique_lock<mutex> lock(work->mtx);
+                ++work->running_helpers;
+            }
+            run(*work);
+            unique_lock<mutex> lock(work->mtx);
+            --work->running_helpers;
+            work->idle_cv.notify_all();
+        });
+    }
+
+    run(*work);
+
+    // Every index is taken, so only the helpers still working on one are
+    // waited for
+    unique_lock<mutex> lock(work->mtx);
+    work->idle_cv.wait(lock, [&work]() { return work->running_helpers == 0; });
+}
+
+int ThreadPool::size() const {
+    return static_cast<int>(workers_.size());
+}
+
+void ThreadPool::worker_loop() {
+    while(true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(mtx_);
+            cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            if(stopping_) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads consuming a FIFO of tasks. Tasks that are
+ * still queued when the pool is destroyed are dropped; owners of long
+ * running work are expected to cancel it before releasing its inputs.
+ */
+class ThreadPool {
+public:
+    // A num_threads of 0 creates one worker per hardware thread
+    explicit ThreadPool(int num_threads = 0);
+
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    // Calls body(i) for each i in [0, count), spread over up to num_tasks
+    // tasks, the calling thread being one of them, and returns once all
+    // calls are done. The calling thread goes through the indices itself
+    // instead of waiting for tasks that are still queued, so this may be
+    // called from a task of the pool.
+    void parallel_for(int count,
+                      int num_tasks,
+                      const std::function<void(int)>& body);
+
+    int size() const;
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+
+    void worker_loop();
+};
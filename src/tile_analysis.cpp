@@ -0,0 +1,203 @@
+#include <algorithm>
+
+#include "texture_format.hpp"
+#include "tile_analysis.hpp"
+#include "tile_hash.hpp"
+
+using namespace std;
+
+namespace {
+
+shared_ptr<const TilePyramid> build_pyramid(const uint8_t* tile_src,
+                                            size_t row_stride,
+                                            int tile_w,
+                                            int tile_h,
+                                            int channels,
+                                            Buffer::BufferType type,
+                                            PyramidReduction reduction) {
+    shared_ptr<TilePyramid> pyramid = make_shared<TilePyramid>();
+
+    switch(type) {
+    case Buffer::BufferType::UnsignedByte:
+        build_tile_pyramid(tile_src, row_stride,
+                           tile_w, tile_h, channels,
+                           reduction, *pyramid);
+        break;
+    case Buffer::BufferType::UnsignedShort:
+        build_tile_pyramid(reinterpret_cast<const uint16_t*>(tile_src),
+                           row_stride, tile_w, tile_h, channels,
+                           reduction, *pyramid);
+        break;
+    case Buffer::BufferType::Short:
+        build_tile_pyramid(reinterpret_cast<const int16_t*>(tile_src),
+                           row_stride, tile_w, tile_h, channels,
+                           reduction, *pyramid);
+        break;
+    case Buffer::BufferType::Int32:
+        build_tile_pyramid(reinterpret_cast<const int32_t*>(tile_src),
+                           row_stride, tile_w, tile_h, channels,
+                           reduction, *pyramid);
+        break;
+    case Buffer::BufferType::Float32:
+    case Buffer::BufferType::Float64:
+        build_tile_pyramid(reinterpret_cast<const float*>(tile_src),
+                           row_stride, tile_w, tile_h, channels,
+                           reduction, *pyramid);
+        break;
+    }
+
+    return pyramid;
+}
+
+} // namespace
+
+shared_ptr<const TileAnalysis> TileAnalysis::analyze(
+        const uint8_t* buffer,
+        int width,
+        int height,
+        int channels,
+        Buffer::BufferType type,
+        int step,
+        int tile_size,
+        PyramidReduction reduction,
+        const shared_ptr<const TileAnalysis>& previous,
+        ThreadPool* pool,
+        int num_tasks,
+        const ContentVersion& version,
+        TileStore* store) {
+    shared_ptr<TileAnalysis> analysis = make_shared<TileAnalysis>();
+    analysis->width = width;
+    analysis->height = height;
+    analysis->channels = channels;
+    analysis->type = type;
+    analysis->tile_size = tile_size;
+    analysis->reduction = reduction;
+    analysis->num_tiles_x = (width + tile_size - 1) / tile_size;
+    analysis->num_tiles_y = (height + tile_size - 1) / tile_size;
+    analysis->content_id = version.id;
+
+    const int num_tiles = analysis->num_tiles_x * analysis->num_tiles_y;
+    analysis->hashes.resize(num_tiles);
+    analysis->pyramids.resize(num_tiles);
+
+    const bool reuse_previous = previous != nullptr &&
+                                previous->same_tiles(*analysis);
+    const bool know_changes = reuse_previous &&
+                              version.changed_rows != nullptr &&
+                              version.changed_rows->size() ==
+                              static_cast<size_t>(height) &&
+                              version.base_id != 0 &&
+                              previous->content_id == version.base_id;
+
+    const int bytes_per_texel = TextureFormat::select(type, channels).bytes_per_texel;
+    const size_t row_stride = static_cast<size_t>(step) * bytes_per_texel;
+    const size_t element_row_stride = static_cast<size_t>(step) * channels;
+
+    // Each tile is hashed, unless it is known to be unchanged, and its
+    // pyramid is only built again if its contents changed
+    auto analyze_tile = [&](int tile_id) {
+        const int tile_x = (tile_id % analysis->num_tiles_x) * tile_size;
+        const int tile_y = (tile_id / analysis->num_tiles_x) * tile_size;
+        const int tile_w = std::min(width - tile_x, tile_size);
+        const int tile_h = std::min(height - tile_y, tile_size);
+
+        if(know_changes) {
+            const vector<bool>& changed_rows = *version.changed_rows;
+            if(std::find(changed_rows.begin() + tile_y,
+                         changed_rows.begin() + tile_y + tile_h,
+                         true) == changed_rows.begin() + tile_y + tile_h) {
+                analysis->hashes[tile_id] = previous->hashes[tile_id];
+                analysis->pyramids[tile_id] = previous->pyramids[tile_id];
+                return;
+            }
+        }
+
+        const uint8_t* tile_src = buffer +
+                static_cast<size_t>(tile_y) * row_stride +
+                static_cast<size_t>(tile_x) * bytes_per_texel;
+        TileHash hash = hash_tile(tile_src, row_stride,
+                                  static_cast<size_t>(tile_w) *
+                                  bytes_per_texel,
+                                  tile_h);
+        analysis->hashes[tile_id] = hash;
+
+        if(reuse_previous && hash == previous->hashes[tile_id]) {
+            analysis->pyramids[tile_id] = previous->pyramids[tile_id];
+            return;
+        }
+
+        shared_ptr<const TilePyramid> pyramid;
+        TileKey key;
+        if(store != nullptr) {
+            key = analysis->tile_key(tile_id);
+            pyramid = store->find_pyramid(key);
+        }
+        if(pyramid == nullptr) {
+            pyramid = build_pyramid(tile_src, element_row_stride,
+                                    tile_w, tile_h, channels, type,
+                                    reduction);
+            if(store != nullptr) {
+                pyramid = store->intern_pyramid(key, pyramid);
+            }
+        }
+        analysis->pyramids[tile_id] = pyramid;
+    };
+
+    if(pool != nullptr) {
+        pool->parallel_for(num_tiles, num_tasks, analyze_tile);
+    } else {
+        for(int tile_id = 0; tile_id < num_tiles; ++tile_id) {
+            analyze_tile(tile_id);
+        }
+    }
+
+    return analysis;
+}
+
+bool TileAnalysis::describes(int width,
+                             int height,
+                             int channels,
+                             Buffer::BufferType type,
+                             int tile_size,
+                             PyramidReduction reduction) const {
+    return this->width == width &&
+           this->height == height &&
+           this->channels == channels &&
+           this->type == type &&
+           this->tile_size == tile_size &&
+           this->reduction == reduction;
+}
+
+bool TileAnalysis::same_tiles(const TileAnalysis& other) const {
+    return describes(other.width, other.height, other.channels,
+                     other.type, other.tile_size, other.reduction);
+}
+
+bool TileAnalysis::same_layout(const TileAnalysis& other) const {
+    return describes(other.width, other.height, other.channels,
+                     other.type, other.tile_size, reduction);
+}
+
+TileKey TileAnalysis::tile_key(int tile_id) const {
+    const int tile_x = (tile_id % num_tiles_x) * tile_size;
+    const int tile_y = (tile_id / num_tiles_x) * tile_size;
+
+    TileKey key;
+    key.hash = hashes[tile_id];
+    key.width = std::min(width - tile_x, tile_size);
+    key.height = std::min(height - tile_y, tile_size);
+    key.channels = channels;
+    key.type = type;
+    key.reduction = reduction;
+    return key;
+}
+
+size_t TileAnalysis::pyramid_bytes() const {
+    size_t bytes = 0;
+    for(const auto& pyramid: pyramids) {
+        for(const auto& level: pyramid->levels) {
+            bytes += level.size();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "buffer.hpp"
+#include "pyramid.hpp"
+#include "thread_pool.hpp"
+#include "tile_hash.hpp"
+#include "tile_store.hpp"
+
+// Identifies the contents of a buffer, when they were derived from known
+// contents by changing some of their rows
+struct ContentVersion {
+    // 0 if the contents are not identified
+    uint64_t id = 0;
+    uint64_t base_id = 0;
+    // Rows that may differ from the base contents; null if unknown
+    std::shared_ptr<const std::vector<bool>> changed_rows;
+};
+
+/*
+ * Content hashes and reduced resolution levels of the tiles of a buffer.
+ * An analysis doesn't change once built, so it can be prepared by a worker
+ * thread while the previous one is still being displayed. Tiles whose
+ * contents didn't change share their pyramid with the previous analysis.
+ */
+struct TileAnalysis {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    Buffer::BufferType type = Buffer::BufferType::UnsignedByte;
+    int tile_size = 0;
+    PyramidReduction reduction = PyramidReduction::Average;
+
+    // Tiles are stored in row major order
+    int num_tiles_x = 0;
+    int num_tiles_y = 0;
+    std::vector<TileHash> hashes;
+    std::vector<std::shared_ptr<const TilePyramid>> pyramids;
+
+    // Version of the analyzed contents, 0 if unknown
+    uint64_t content_id = 0;
+
+    // step is given in pixels. The tiles of previous are reused if it
+    // describes the same tile layout; if it analyzed the base of version,
+    // tiles without changed rows are not even hashed. Other changed tiles
+    // take their pyramid from store, if given, when it holds one of the
+    // same contents. Doesn't touch any other shared state, so it may run on
+    // any thread; the tiles are distributed among up to num_tasks tasks of
+    // pool, the calling thread included, or all analyzed by the calling
+    // thread if pool is null.
+    static std::shared_ptr<const TileAnalysis> analyze(
+            const uint8_t* buffer,
+            int width,
+            int height,
+            int channels,
+            Buffer::BufferType type,
+            int step,
+            int tile_size,
+            PyramidReduction reduction,
+            const std::shared_ptr<const TileAnalysis>& previous,
+            ThreadPool* pool,
+            int num_tasks,
+            const ContentVersion& version = ContentVersion(),
+            TileStore* store = nullptr);
+
+    bool describes(int width,
+                   int height,
+                   int channels,
+                   Buffer::BufferType type,
+                   int tile_size,
+                   PyramidReduction reduction) const;
+
+    bool same_tiles(const TileAnalysis& other) const;
+
+    // Whether the tiles cover the same pixels of the same type, whatever
+    // their pyramid reduction
+    bool same_layout(const TileAnalysis& other) const;
+
+    // Contents of a tile, as identified in the TileStore
+    TileKey tile_key(int tile_id) const;
+
+    // Memory taken by the reduced levels of all tiles
+    size_t pyramid_bytes() const;
+};
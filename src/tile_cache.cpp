@@ -0,0 +1,102 @@
+#include "texture_pool.hpp"
+#include "tile_cache.hpp"
+
+using namespace std;
+
+TileCache::TileCache(TexturePool& pool) : pool_(pool) {}
+
+void TileCache::set_budget(size_t bytes) {
+    budget_ = bytes;
+    evict_over_budget();
+}
+
+size_t TileCache::budget() const {
+    return budget_;
+}
+
+size_t TileCache::resident_bytes() const {
+    return resident_bytes_;
+}
+
+void TileCache::begin_frame() {
+    ++current_frame_;
+
+    // Textures may have gone idle since the last eviction, as buffers were
+    // updated or removed
+    trim_idle_textures();
+}
+
+void TileCache::insert(const void* owner,
+                       int tile_id,
+                       size_t bytes,
+                       function<void()> evict) {
+    remove(owner, tile_id);
+
+    Entry entry;
+    entry.owner = owner;
+    entry.tile_id = tile_id;
+    entry.bytes = bytes;
+    entry.last_used_frame = current_frame_;
+    entry.evict = evict;
+
+    entries_.push_front(entry);
+    index_[EntryKey(owner, tile_id)] = entries_.begin();
+    resident_bytes_ += bytes;
+
+    evict_over_budget();
+}
+
+void TileCache::touch(const void* owner, int tile_id) {
+    auto it = index_.find(EntryKey(owner, tile_id));
+    if(it == index_.end()) {
+        return;
+    }
+
+    it->second->last_used_frame = current_frame_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+}
+
+void TileCache::remove(const void* owner, int tile_id) {
+    auto it = index_.find(EntryKey(owner, tile_id));
+    if(it == index_.end()) {
+        return;
+    }
+
+    resident_bytes_ -= it->second->bytes;
+    entries_.erase(it->second);
+    index_.erase(it);
+}
+
+void TileCache::remove_owner(const void* owner) {
+    for(auto it = entries_.begin(); it != entries_.end();) {
+        if(it->owner == owner) {
+            resident_bytes_ -= it->bytes;
+            index_.erase(EntryKey(it->owner, it->tile_id));
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TileCache::evict_over_budget() {
+    while(resident_bytes_ > budget_ && !entries_.empty()) {
+        Entry victim = entries_.back();
+        if(victim.last_used_frame == current_frame_) {
+            // Everything left is on screen right now
+            break;
+        }
+
+        remove(victim.owner, victim.tile_id);
+        if(victim.evict) {
+            victim.evict();
+        }
+    }
+
+    trim_idle_textures();
+}
+
+void TileCache::trim_idle_textures() {
+    // Resident tiles may exceed the budget while they are all on screen
+    pool_.trim(budget_ > resident_bytes_ ? budget_ - resident_bytes_ : 0);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+
+class TexturePool;
+
+/*
+ * Keeps track of the GPU memory used by the tiles of buffers in virtual
+ * texturing mode. Tiles are paged in by their owners when the camera sees
+ * them; when the resident tiles exceed the memory budget, the least recently
+ * viewed ones are evicted through the callback given by their owners. Tiles
+ * that were drawn in the current frame are never evicted.
+ *
+ * Evicted tiles hand their textures back to the TexturePool, which keeps
+ * them allocated, so its idle textures count against the budget as well:
+ * they are deleted as far as the resident tiles need their memory.
+ */
+class TileCache {
+public:
+    static constexpr size_t default_budget = 1024 * 1024 * 1024;
+
+    explicit TileCache(TexturePool& pool);
+
+    void set_budget(size_t bytes);
+
+    size_t budget() const;
+
+    size_t resident_bytes() const;
+
+    // Must be called once before each frame is drawn, with the GL context
+    // current
+    void begin_frame();
+
+    // Registers (or replaces) a resident tile and evicts other tiles if the
+    // budget is exceeded
+    void insert(const void* owner,
+                int tile_id,
+                size_t bytes,
+                std::function<void()> evict);
+
+    // Marks a tile as viewed in the current frame
+    void touch(const void* owner, int tile_id);
+
+    // Removes tiles without calling their eviction callbacks
+    void remove(const void* owner, int tile_id);
+    void remove_owner(const void* owner);
+
+private:
+    struct Entry {
+        const void* owner;
+        int tile_id;
+        size_t bytes;
+        uint64_t last_used_frame;
+        std::function<void()> evict;
+    };
+    typedef std::pair<const void*, int> EntryKey;
+
+    TexturePool& pool_;
+
+    // Most recently viewed tiles are kept at the front
+    std::list<Entry> entries_;
+    std::map<EntryKey, std::list<Entry>::iterator> index_;
+    size_t budget_ = default_budget;
+    size_t resident_bytes_ = 0;
+    uint64_t current_frame_ = 0;
+
+    void evict_over_budget();
+    void trim_idle_textures();
+};
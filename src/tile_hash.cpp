@@ -0,0 +1,93 @@
+#include <cstring>
+
+#include "tile_hash.hpp"
+
+namespace {
+
+const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t prime3 = 0x165667B19E3779F9ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read_u64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    acc = rotl(acc, 31);
+    return acc * prime1;
+}
+
+inline uint64_t avalanche(uint64_t h, uint64_t m1, uint64_t m2) {
+    h ^= h >> 33;
+    h *= m1;
+    h ^= h >> 29;
+    h *= m2;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace
+
+bool TileHash::operator<(const TileHash& other) const {
+    return high < other.high || (high == other.high && low < other.low);
+}
+
+bool TileHash::operator==(const TileHash& other) const {
+    return low == other.low && high == other.high;
+}
+
+bool TileHash::operator!=(const TileHash& other) const {
+    return !(*this == other);
+}
+
+TileHash hash_tile(const uint8_t* src,
+                   size_t row_stride,
+                   size_t row_bytes,
+                   int rows) {
+    // Four independent accumulators, so consecutive words don't depend on
+    // each other's multiplications
+    uint64_t acc[4] = {
+        prime1 + prime2, prime2, 0, prime3
+    };
+
+    for(int y = 0; y < rows; ++y) {
+        const uint8_t* row = src + static_cast<size_t>(y) * row_stride;
+        size_t i = 0;
+
+        for(; i + 32 <= row_bytes; i += 32) {
+            acc[0] = round(acc[0], read_u64(row + i));
+            acc[1] = round(acc[1], read_u64(row + i + 8));
+            acc[2] = round(acc[2], read_u64(row + i + 16));
+            acc[3] = round(acc[3], read_u64(row + i + 24));
+        }
+
+        for(; i + 8 <= row_bytes; i += 8) {
+            acc[0] = round(acc[0], read_u64(row + i));
+        }
+
+        if(i < row_bytes) {
+            uint64_t tail = 0;
+            memcpy(&tail, row + i, row_bytes - i);
+            acc[1] = round(acc[1], tail ^ (row_bytes - i));
+        }
+    }
+
+    const uint64_t size = row_bytes * static_cast<uint64_t>(rows);
+    uint64_t low = rotl(acc[0], 1) + rotl(acc[1], 7) +
+                   rotl(acc[2], 12) + rotl(acc[3], 18);
+    uint64_t high = rotl(acc[0], 41) ^ rotl(acc[1], 29) ^
+                    rotl(acc[2], 53) ^ rotl(acc[3], 5);
+
+    // Final avalanche, with different multipliers for each half
+    TileHash hash;
+    hash.low = avalanche(low ^ size, prime2, prime3);
+    hash.high = avalanche(high + size * prime1, prime3, prime1);
+    return hash;
+}
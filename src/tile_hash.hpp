@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 128 bit hash, compared as a whole
+struct TileHash {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator<(const TileHash& other) const;
+
+    bool operator==(const TileHash& other) const;
+
+    bool operator!=(const TileHash& other) const;
+};
+
+/*
+ * Fast, non cryptographic 128 bit hash of a rectangular region of a buffer.
+ * Each row has row_bytes bytes, and consecutive rows are row_stride bytes
+ * apart. Used to find out which tiles of a buffer changed between two
+ * updates, and which tiles of different buffers have the same contents. Both
+ * halves are mixed from the whole accumulator state, so they are as cheap as
+ * a 64 bit hash.
+ */
+TileHash hash_tile(const uint8_t* src,
+                   size_t row_stride,
+                   size_t row_bytes,
+                   int rows);
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <tuple>
+
+#include "texture_format.hpp"
+#include "texture_pool.hpp"
+#include "texture_uploader.hpp"
+#include "tile_store.hpp"
+
+using namespace std;
+
+bool TileKey::operator<(const TileKey& other) const {
+    return tie(hash, width, height, channels, type, reduction, collision) <
+           tie(other.hash, other.width, other.height, other.channels,
+               other.type, other.reduction, other.collision);
+}
+
+bool TileKey::operator==(const TileKey& other) const {
+    return hash == other.hash &&
+           width == other.width &&
+           height == other.height &&
+           channels == other.channels &&
+           type == other.type &&
+           reduction == other.reduction &&
+           collision == other.collision;
+}
+
+namespace {
+
+// Whether two keys were given to the store for the same contents
+bool same_hash(const TileKey& key, const TileKey& hashed) {
+    TileKey unresolved = key;
+    unresolved.collision = 0;
+    return unresolved == hashed;
+}
+
+bool same_pixels(const uint8_t* a,
+                 int a_stride,
+                 const uint8_t* b,
+                 int b_stride,
+                 size_t row_bytes,
+                 int rows) {
+    for(int y = 0; y < rows; ++y) {
+        if(memcmp(a + static_cast<size_t>(y) * a_stride,
+                  b + static_cast<size_t>(y) * b_stride,
+                  row_bytes) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TileStore::TileStore(TexturePool& pool, TextureUploader& uploader)
+    : pool_(pool), uploader_(uploader) {}
+
+TileStore::~TileStore() {
+    // Buffers unbind their tiles before the store goes away, so this only
+    // matters if one didn't
+    for(auto& entry: entries_) {
+        uploader_.cancel(&entry.second);
+        pool_.release(entry.second.texture);
+    }
+}
+
+shared_ptr<const TilePyramid> TileStore::find_pyramid(const TileKey& key) {
+    unique_lock<mutex> lock(pyramids_mtx_);
+    auto found = pyramids_.find(key);
+    if(found == pyramids_.end()) {
+        return nullptr;
+    }
+
+    shared_ptr<const TilePyramid> pyramid = found->second.lock();
+    if(pyramid != nullptr) {
+        ++shared_pyramids_;
+    }
+    return pyramid;
+}
+
+shared_ptr<const TilePyramid> TileStore::intern_pyramid(
+        const TileKey& key,
+        shared_ptr<const TilePyramid> pyramid) {
+    unique_lock<mutex> lock(pyramids_mtx_);
+    weak_ptr<const TilePyramid>& stored = pyramids_[key];
+    shared_ptr<const TilePyramid> existing = stored.lock();
+    if(existing != nullptr) {
+        ++shared_pyramids_;
+        return existing;
+    }
+    stored = pyramid;
+
+    // Pyramids are owned by the analyses that use them; the ones nobody
+    // uses anymore are forgotten once in a while
+    if(++inserts_since_sweep_ >= std::max<size_t>(pyramids_.size() / 2, 256)) {
+        for(auto it = pyramids_.begin(); it != pyramids_.end();) {
+            if(it->second.expired()) {
+                it = pyramids_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        inserts_since_sweep_ = 0;
+    }
+
+    return pyramid;
+}
+
+size_t TileStore::shared_pyramids() {
+    unique_lock<mutex> lock(pyramids_mtx_);
+    return shared_pyramids_;
+}
+
+GLuint TileStore::bind(const void* owner,
+                       int tile_id,
+                       const TileKey& hashed,
+                       const uint8_t* src,
+                       int row_stride,
+                       shared_ptr<const TilePyramid> pyramid,
+                       OnReady on_ready) {
+    const BindingKey binding_key(owner, tile_id);
+    Binding& binding = bindings_[binding_key];
+
+    // A tile bound again to contents of the same hash is trusted to still
+    // show them, as when a buffer finds which of its tiles changed
+    TileKey key;
+    if(binding.has_pending && same_hash(binding.pending, hashed)) {
+        key = binding.pending;
+    } else if(binding.has_current && same_hash(binding.current, hashed)) {
+        key = binding.current;
+    } else {
+        key = resolve(hashed, src, row_stride);
+    }
+
+    binding.src = src;
+    binding.row_stride = row_stride;
+    binding.on_ready = on_ready;
+
+    if(binding.has_pending) {
+        if(binding.pending == key) {
+            // Same contents, but maybe not at the same address anymore
+            Entry& entry = entries_.at(key);
+            if(entry.waiters.front() == binding_key) {
+                start_upload(key, entry);
+            }
+            return 0;
+        }
+        drop_pending(binding_key, binding);
+    }
+    if(binding.has_current && binding.current == key) {
+        return entries_.at(key).texture;
+    }
+
+    auto found = entries_.find(key);
+    if(found == entries_.end()) {
+        found = entries_.emplace(key, Entry()).first;
+        Entry& entry = found->second;
+
+        TextureFormat format = TextureFormat::select(key.type, key.channels);
+        const int levels = pyramid_levels(key.width, key.height);
+        entry.texture = pool_.acquire(format, key.width, key.height, levels);
+        entry.bytes = static_cast<size_t>(key.width) * key.height *
+                      format.bytes_per_texel;
+        if(levels > 1) {
+            entry.bytes += entry.bytes / 3;
+        }
+        entry.pyramid = pyramid;
+        stored_bytes_ += entry.bytes;
+    }
+    Entry& entry = found->second;
+    entry.tiles.insert(binding_key);
+    bound_bytes_ += entry.bytes;
+
+    if(entry.ready) {
+        if(binding.has_current) {
+            release(binding.current, binding_key);
+        }
+        binding.has_current = true;
+        binding.current = key;
+        return entry.texture;
+    }
+
+    binding.has_pending = true;
+    binding.pending = key;
+    entry.waiters.push_back(binding_key);
+    if(entry.waiters.size() == 1) {
+        start_upload(key, entry);
+    }
+    return 0;
+}
+
+void TileStore::unbind_owner(const void* owner) {
+    auto it = bindings_.lower_bound(BindingKey(owner, INT_MIN));
+    while(it != bindings_.end() && it->first.first == owner) {
+        if(it->second.has_pending) {
+            drop_pending(it->first, it->second);
+        }
+        if(it->second.has_current) {
+            release(it->second.current, it->first);
+        }
+        it = bindings_.erase(it);
+    }
+}
+
+size_t TileStore::bound_bytes() const {
+    return bound_bytes_;
+}
+
+size_t TileStore::stored_bytes() const {
+    return stored_bytes_;
+}
+
+double TileStore::dedup_ratio() const {
+    if(stored_bytes_ == 0) {
+        return 1.0;
+    }
+    return static_cast<double>(bound_bytes_) / stored_bytes_;
+}
+
+TileKey TileStore::resolve(const TileKey& hashed,
+                           const uint8_t* src,
+                           int row_stride) {
+    const size_t row_bytes = static_cast<size_t>(hashed.width) *
+            TextureFormat::select(hashed.type, hashed.channels).bytes_per_texel;
+
+    TileKey key = hashed;
+    for(;; ++key.collision) {
+        auto found = entries_.find(key);
+        if(found == entries_.end()) {
+            return key;
+        }
+
+        // The pixels are compared with those of a tile whose memory still
+        // holds the contents of the texture. If there is none, the texture
+        // is not shared.
+        const Binding* reference = nullptr;
+        for(const BindingKey& binding_key: found->second.tiles) {
+            const Binding& other = bindings_.at(binding_key);
+            if((other.has_pending ? other.pending : other.current) == key) {
+                reference = &other;
+                break;
+            }
+        }
+        if(reference != nullptr &&
+           same_pixels(src, row_stride, reference->src, reference->row_stride,
+                       row_bytes, key.height)) {
+            return key;
+        }
+    }
+}
+
+void TileStore::start_upload(const TileKey& key, Entry& entry) {
+    uploader_.cancel(&entry);
+
+    const Binding& source = bindings_.at(entry.waiters.front());
+    TextureFormat format = TextureFormat::select(key.type, key.channels);
+
+    // Coarse levels are enqueued first, so they are the first ones to
+    // arrive. The texture is complete once its base level arrives.
+    const TilePyramid& pyramid = *entry.pyramid;
+    for(int level = pyramid.levels.size() - 1; level >= 0; --level) {
+        uploader_.enqueue(&entry, entry.texture, format,
+                          pyramid.levels[level].data(),
+                          pyramid.widths[level] * format.bytes_per_texel,
+                          pyramid.widths[level], pyramid.heights[level],
+                          level + 1, nullptr);
+    }
+    uploader_.enqueue(&entry, entry.texture, format,
+                      source.src, source.row_stride,
+                      key.width, key.height, 0,
+                      [this, key]() {
+                          complete(key);
+                      });
+}
+
+void TileStore::complete(const TileKey& key) {
+    Entry& entry = entries_.at(key);
+    entry.ready = true;
+    entry.pyramid.reset();
+
+    vector<BindingKey> waiters;
+    waiters.swap(entry.waiters);
+    for(const BindingKey& binding_key: waiters) {
+        Binding& binding = bindings_.at(binding_key);
+        binding.has_pending = false;
+        if(binding.has_current) {
+            release(binding.current, binding_key);
+        }
+        binding.has_current = true;
+        binding.current = key;
+
+        if(binding.on_ready) {
+            binding.on_ready(entry.texture);
+        }
+    }
+}
+
+void TileStore::drop_pending(const BindingKey& binding_key, Binding& binding) {
+    binding.has_pending = false;
+    Entry& entry = entries_.at(binding.pending);
+
+    const bool was_source = entry.waiters.front() == binding_key;
+    entry.waiters.erase(std::remove(entry.waiters.begin(),
+                                    entry.waiters.end(),
+                                    binding_key),
+                        entry.waiters.end());
+
+    // The memory of the tile that was uploading the texture may go away, so
+    // another tile waiting for it takes over
+    if(was_source && !entry.waiters.empty()) {
+        start_upload(binding.pending, entry);
+    }
+    release(binding.pending, binding_key);
+}
+
+void TileStore::release(const TileKey& key, const BindingKey& binding_key) {
+    auto found = entries_.find(key);
+    Entry& entry = found->second;
+    bound_bytes_ -= entry.bytes;
+    entry.tiles.erase(binding_key);
+    if(!entry.tiles.empty()) {
+        return;
+    }
+
+    uploader_.cancel(&entry);
+    pool_.release(entry.texture);
+    stored_bytes_ -= entry.bytes;
+    entries_.erase(found);
+}
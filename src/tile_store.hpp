@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <GL/gl.h>
+
+#include "buffer.hpp"
+#include "pyramid.hpp"
+#include "tile_hash.hpp"
+
+class TexturePool;
+class TextureUploader;
+
+// Identifies the contents of a tile, regardless of the buffer it belongs to
+// or of its position in it
+struct TileKey {
+    TileHash hash;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    Buffer::BufferType type = Buffer::BufferType::UnsignedByte;
+    PyramidReduction reduction = PyramidReduction::Average;
+    // Tells apart textures of different contents with the same hash. Always
+    // 0 in the keys given to the store.
+    int collision = 0;
+
+    bool operator<(const TileKey& other) const;
+
+    bool operator==(const TileKey& other) const;
+};
+
+/*
+ * Content-addressed store of tiles, shared by all buffers. Watched buffers
+ * are often shallow copies of each other, and most of their tiles don't
+ * change from one stop to the next, so tiles are kept once per contents
+ * rather than once per buffer:
+ *
+ * - The reduced resolution levels of a tile are interned when it is
+ *   analyzed, so a tile seen before by any buffer, whose pyramid is still
+ *   in use, doesn't have it built again. The pixels they were built from
+ *   may be gone by then, so they are only told apart by their hash. This
+ *   part may be used from any thread.
+ * - Textures are bound to the tiles of the buffers that display them, and
+ *   only uploaded for the first one. A tile bound to new contents keeps its
+ *   previous texture until the new one is complete. Since the texture of a
+ *   buffer could otherwise show the pixels of another one, a tile only
+ *   shares a texture after its pixels were compared with those of a tile
+ *   already bound to it.
+ *
+ * Buffers in virtual texturing mode page their own textures in and out, so
+ * they only share pyramids.
+ */
+class TileStore {
+public:
+    typedef std::function<void(GLuint texture)> OnReady;
+
+    TileStore(TexturePool& pool, TextureUploader& uploader);
+
+    ~TileStore();
+
+    // Pyramid of the same contents still used by some analysis, or null
+    std::shared_ptr<const TilePyramid> find_pyramid(const TileKey& key);
+
+    // Stores a pyramid, unless one of the same contents was stored in the
+    // meantime, which is returned instead
+    std::shared_ptr<const TilePyramid> intern_pyramid(
+            const TileKey& key,
+            std::shared_ptr<const TilePyramid> pyramid);
+
+    // Number of pyramids taken from the store instead of being built
+    size_t shared_pyramids();
+
+    // The remaining functions must be called from the GUI thread
+
+    // Binds a tile of owner to the texture of the contents hashed as given,
+    // whose pixels are at src. Returns the texture if it is complete.
+    // Otherwise, it is uploaded from src, with row_stride given in bytes, and
+    // from pyramid, unless another tile is already uploading it; on_ready is
+    // called once it is complete. src must stay valid, and unchanged, until
+    // the tile is bound again or unbound.
+    GLuint bind(const void* owner,
+                int tile_id,
+                const TileKey& hashed,
+                const uint8_t* src,
+                int row_stride,
+                std::shared_ptr<const TilePyramid> pyramid,
+                OnReady on_ready);
+
+    void unbind_owner(const void* owner);
+
+    // Memory of the textures bound to all tiles, and memory they actually
+    // take, including mip levels
+    size_t bound_bytes() const;
+    size_t stored_bytes() const;
+
+    // Ratio between the two above, 1 if nothing is stored
+    double dedup_ratio() const;
+
+private:
+    typedef std::pair<const void*, int> BindingKey;
+
+    struct Binding {
+        // Contents shown by the tile
+        bool has_current = false;
+        TileKey current;
+        // Contents waiting for their texture
+        bool has_pending = false;
+        TileKey pending;
+        // Memory of the pending contents if any, else of the current ones
+        const uint8_t* src = nullptr;
+        int row_stride = 0;
+        OnReady on_ready;
+    };
+
+    struct Entry {
+        GLuint texture = 0;
+        size_t bytes = 0;
+        // Tiles bound to the texture, whether it is complete or not
+        std::set<BindingKey> tiles;
+        bool ready = false;
+        // Only kept until the texture is complete
+        std::shared_ptr<const TilePyramid> pyramid;
+        // Tiles waiting for the texture. The first one is the source of the
+        // upload in progress.
+        std::vector<BindingKey> waiters;
+    };
+
+    TexturePool& pool_;
+    TextureUploader& uploader_;
+
+    std::mutex pyramids_mtx_;
+    std::map<TileKey, std::weak_ptr<const TilePyramid>> pyramids_;
+    size_t inserts_since_sweep_ = 0;
+    size_t shared_pyramids_ = 0;
+
+    std::map<TileKey, Entry> entries_;
+    std::map<BindingKey, Binding> bindings_;
+    size_t bound_bytes_ = 0;
+    size_t stored_bytes_ = 0;
+
+    // Key of the texture for the given contents of a tile, which is not
+    // bound to them yet
+    TileKey resolve(const TileKey& hashed, const uint8_t* src, int row_stride);
+
+    // Uploads the texture from its first waiter, dropping what was uploaded
+    // from the previous one
+    void start_upload(const TileKey& key, Entry& entry);
+
+    void complete(const TileKey& key);
+
+    void drop_pending(const BindingKey& binding_key, Binding& binding);
+
+    void release(const TileKey& key, const BindingKey& binding_key);
+};
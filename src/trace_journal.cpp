@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cstring>
+
+#include "inferior_memory.hpp"
+#include "lz_codec.hpp"
+#include "trace_journal.hpp"
+
+using namespace std;
+
+namespace {
+
+// At most this many pixel buffers are kept around for reuse
+const size_t max_spare_pixels = 8;
+
+size_t element_size(Buffer::BufferType type) {
+    switch(type) {
+    case Buffer::BufferType::UnsignedShort:
+    case Buffer::BufferType::Short:
+        return 2;
+    case Buffer::BufferType::Int32:
+    case Buffer::BufferType::Float32:
+        return 4;
+    case Buffer::BufferType::Float64:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+// dst ^= src
+void xor_bytes(uint8_t* dst, const uint8_t* src, size_t size) {
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for(; i < size; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+bool same_layout(const JournalRecordHeader& a, const JournalRecordHeader& b) {
+    return a.width == b.width && a.height == b.height &&
+           a.channels == b.channels && a.type == b.type;
+}
+
+} // namespace
+
+TraceJournal::TraceJournal(const string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if(file_ == nullptr) {
+        return;
+    }
+
+    const uint32_t file_header[] = {journal_magic, journal_version};
+    if(!write_bytes(file_header, sizeof(file_header))) {
+        fclose(file_);
+        file_ = nullptr;
+        return;
+    }
+
+    worker_ = thread(&TraceJournal::write_loop, this);
+}
+
+TraceJournal::~TraceJournal() {
+    close();
+}
+
+bool TraceJournal::is_open() const {
+    return file_ != nullptr;
+}
+
+bool TraceJournal::close() {
+    if(file_ == nullptr) {
+        return false;
+    }
+
+    {
+        unique_lock<mutex> lock(mtx_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+
+    bool ok = !write_failed_;
+    if(ok) {
+        JournalTrailer trailer;
+        trailer.index_offset = offset_;
+        trailer.num_records = record_offsets_.size();
+        trailer.magic = journal_trailer_magic;
+        trailer.reserved = 0;
+        ok = write_bytes(record_offsets_.data(),
+                         record_offsets_.size() * sizeof(uint64_t)) &&
+             write_bytes(&trailer, sizeof(trailer));
+    }
+    ok = fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    return ok;
+}
+
+bool TraceJournal::capture(uint64_t hit, const InferiorBuffer& source) {
+    const size_t pixel_bytes = element_size(source.type) * source.channels;
+    const size_t row_bytes = static_cast<size_t>(source.width) * pixel_bytes;
+    const size_t step_bytes = static_cast<size_t>(source.step) * pixel_bytes;
+
+    // One segment per row skips the padding between them
+    vector<InferiorSegment> rows;
+    if(step_bytes == row_bytes) {
+        rows.push_back({source.address, row_bytes * source.height});
+    } else {
+        rows.reserve(source.height);
+        for(int y = 0; y < source.height; ++y) {
+            rows.push_back({source.address + y * step_bytes, row_bytes});
+        }
+    }
+
+    Frame frame;
+    frame.header = make_header(hit, source.var_name,
+                               source.width, source.height,
+                               source.channels, source.type,
+                               source.pixel_layout);
+    frame.var_name = source.var_name;
+    frame.pixels = take_pixels(row_bytes * source.height);
+    if(!read_inferior_segments(source.pid, rows, frame.pixels.data())) {
+        return false;
+    }
+
+    enqueue(std::move(frame));
+    return true;
+}
+
+void TraceJournal::capture(uint64_t hit,
+                           const string& var_name,
+                           int width,
+                           int height,
+                           int channels,
+                           Buffer::BufferType type,
+                           int step,
+                           const string& pixel_layout,
+                           const uint8_t* pixels) {
+    const size_t pixel_bytes = element_size(type) * channels;
+    const size_t row_bytes = static_cast<size_t>(width) * pixel_bytes;
+    const size_t step_bytes = static_cast<size_t>(step) * pixel_bytes;
+
+    Frame frame;
+    frame.header = make_header(hit, var_name, width, height,
+                               channels, type, pixel_layout);
+    frame.var_name = var_name;
+    frame.pixels = take_pixels(row_bytes * height);
+    for(int y = 0; y < height; ++y) {
+        memcpy(frame.pixels.data() + y * row_bytes,
+               pixels + y * step_bytes, row_bytes);
+    }
+
+    enqueue(std::move(frame));
+}
+
+uint64_t TraceJournal::frames_written() {
+    unique_lock<mutex> lock(mtx_);
+    return frames_written_;
+}
+
+bool TraceJournal::write_failed() {
+    unique_lock<mutex> lock(mtx_);
+    return write_failed_;
+}
+
+vector<uint8_t> TraceJournal::take_pixels(size_t size) {
+    vector<uint8_t> pixels;
+    {
+        unique_lock<mutex> lock(mtx_);
+        if(!spare_pixels_.empty()) {
+            pixels = std::move(spare_pixels_.back());
+            spare_pixels_.pop_back();
+        }
+    }
+    pixels.resize(size);
+    return pixels;
+}
+
+void TraceJournal::enqueue(Frame&& frame) {
+    {
+        unique_lock<mutex> lock(mtx_);
+        // The inferior is held at the breakpoint until the writer catches
+        // up, which keeps the memory used by the journal bounded
+        cv_.wait(lock, [this]() {
+            return write_failed_ || queued_bytes_ <= queue_budget;
+        });
+        if(write_failed_) {
+            return;
+        }
+        queued_bytes_ += frame.pixels.size();
+        queue_.push_back(std::move(frame));
+    }
+    cv_.notify_all();
+}
+
+void TraceJournal::write_loop() {
+    unique_lock<mutex> lock(mtx_);
+
+    while(true) {
+        cv_.wait(lock, [this]() {
+            return stopping_ || !queue_.empty();
+        });
+        if(queue_.empty()) {
+            // Stopping, and everything was written
+            return;
+        }
+
+        Frame frame = std::move(queue_.front());
+        queue_.pop_front();
+        const size_t frame_bytes = frame.pixels.size();
+
+        lock.unlock();
+        bool ok = write_frame(frame);
+        lock.lock();
+
+        queued_bytes_ -= frame_bytes;
+        if(ok) {
+            ++frames_written_;
+        } else {
+            write_failed_ = true;
+            queue_.clear();
+            queued_bytes_ = 0;
+        }
+        if(spare_pixels_.size() < max_spare_pixels &&
+           frame.pixels.capacity() > 0) {
+            spare_pixels_.push_back(std::move(frame.pixels));
+        }
+        cv_.notify_all();
+    }
+}
+
+bool TraceJournal::write_frame(Frame& frame) {
+    Track& track = tracks_[frame.var_name];
+
+    const bool keyframe = track.pixels.empty() ||
+                          !same_layout(track.header, frame.header) ||
+                          track.since_keyframe + 1 >= keyframe_interval;
+
+    // The previous pixels of the variable become the delta, and the new
+    // ones are kept in their place for the next frame
+    if(keyframe) {
+        lz_compress(frame.pixels.data(), frame.pixels.size(), compressed_);
+        track.since_keyframe = 0;
+    } else {
+        xor_bytes(track.pixels.data(), frame.pixels.data(), frame.pixels.size());
+        lz_compress(track.pixels.data(), track.pixels.size(), compressed_);
+        ++track.since_keyframe;
+    }
+    swap(track.pixels, frame.pixels);
+    track.header = frame.header;
+
+    frame.header.keyframe = keyframe ? 1 : 0;
+    frame.header.data_size = compressed_.size();
+
+    record_offsets_.push_back(offset_);
+    return write_bytes(&frame.header, sizeof(frame.header)) &&
+           write_bytes(frame.var_name.data(), frame.var_name.size()) &&
+           write_bytes(compressed_.data(), compressed_.size());
+}
+
+bool TraceJournal::write_bytes(const void* data, size_t size) {
+    if(size > 0 && fwrite(data, 1, size, file_) != size) {
+        return false;
+    }
+    offset_ += size;
+    return true;
+}
+
+JournalRecordHeader TraceJournal::make_header(uint64_t hit,
+                                              const string& var_name,
+                                              int width,
+                                              int height,
+                                              int channels,
+                                              Buffer::BufferType type,
+                                              const string& pixel_layout) {
+    JournalRecordHeader header;
+    header.magic = journal_record_magic;
+    header.name_size = static_cast<uint32_t>(var_name.size());
+    header.hit = hit;
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.type = static_cast<int32_t>(type);
+    memset(header.pixel_layout, 0, sizeof(header.pixel_layout));
+    memcpy(header.pixel_layout, pixel_layout.data(),
+           min(pixel_layout.size(), sizeof(header.pixel_layout)));
+    header.keyframe = 0;
+    header.data_size = 0;
+    return header;
+}
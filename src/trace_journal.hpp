@@ -0,0 +1,159 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "region_fetcher.hpp"
+
+/*
+ * File of the buffers captured by trace breakpoints, which let the inferior
+ * run on after each hit instead of stopping it, so that thousands of
+ * iterations can be looked at afterwards.
+ *
+ * The file starts with journal_magic and journal_version, followed by one
+ * record per captured buffer: a JournalRecordHeader, the variable name and
+ * the pixels, packed with a step of width and compressed with lz_compress.
+ * As in BufferHistory, the pixels are the XOR with the previous record of
+ * the same variable, except for every keyframe_interval-th record and those
+ * whose layout changed, which are stored whole. Closing the journal appends
+ * the offset of each record as a 64 bit integer, followed by a
+ * JournalTrailer; a journal that wasn't closed can still be read by walking
+ * over its records. All integers are in the byte order of the host.
+ */
+
+const uint32_t journal_magic = 0x4a574947; // "GIWJ"
+const uint32_t journal_record_magic = 0x4d415246; // "FRAM"
+const uint32_t journal_trailer_magic = 0x58444e49; // "INDX"
+const uint32_t journal_version = 1;
+
+struct JournalRecordHeader {
+    uint32_t magic;
+    uint32_t name_size;
+    // Number of times any of the traced breakpoints was hit; the records of
+    // the buffers captured on the same hit share it
+    uint64_t hit;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t type;
+    char pixel_layout[4];
+    uint32_t keyframe;
+    // Size of the compressed pixels
+    uint64_t data_size;
+};
+
+struct JournalTrailer {
+    uint64_t index_offset;
+    uint64_t num_records;
+    uint32_t magic;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(JournalRecordHeader) == 48,
+              "Journal records must not have padding");
+static_assert(sizeof(JournalTrailer) == 24,
+              "The journal trailer must not have padding");
+
+/*
+ * Writes a journal. Captures are called from the debugger thread while the
+ * inferior is stopped, and only copy the pixels; they are compressed and
+ * written by a thread of the journal. Captures wait for the writer when the
+ * frames not yet written exceed queue_budget, rather than dropping any.
+ */
+class TraceJournal {
+public:
+    static const int keyframe_interval = 32;
+    static constexpr size_t queue_budget = 256 * 1024 * 1024;
+
+    // Check is_open() afterwards
+    explicit TraceJournal(const std::string& path);
+
+    ~TraceJournal();
+
+    bool is_open() const;
+
+    // Writes the frames still queued and the index. Returns false if the
+    // journal couldn't be written whole.
+    bool close();
+
+    // Reads the pixels within the buffer width from the memory of a local
+    // inferior. Returns false if they couldn't be read.
+    bool capture(uint64_t hit, const InferiorBuffer& source);
+
+    // Copies pixels that were read by other means
+    void capture(uint64_t hit,
+                 const std::string& var_name,
+                 int width,
+                 int height,
+                 int channels,
+                 Buffer::BufferType type,
+                 int step,
+                 const std::string& pixel_layout,
+                 const uint8_t* pixels);
+
+    uint64_t frames_written();
+
+    // True once a write failed; the frames captured afterwards are dropped
+    bool write_failed();
+
+private:
+    struct Frame {
+        JournalRecordHeader header;
+        std::string var_name;
+        std::vector<uint8_t> pixels;
+    };
+
+    // Last frame written for a variable, to compute the next delta from
+    struct Track {
+        JournalRecordHeader header;
+        std::vector<uint8_t> pixels;
+        int since_keyframe = 0;
+    };
+
+    FILE* file_ = nullptr;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<Frame> queue_;
+    size_t queued_bytes_ = 0;
+    // Pixel storage of frames already written, reused by the next captures
+    // so that they don't have to fault in fresh pages
+    std::vector<std::vector<uint8_t>> spare_pixels_;
+    uint64_t frames_written_ = 0;
+    bool write_failed_ = false;
+    bool stopping_ = false;
+
+    // Only touched by the writer thread
+    std::map<std::string, Track> tracks_;
+    std::vector<uint64_t> record_offsets_;
+    uint64_t offset_ = 0;
+    std::vector<uint8_t> compressed_;
+
+    std::thread worker_;
+
+    void write_loop();
+
+    // Returns false if the file couldn't be written
+    bool write_frame(Frame& frame);
+
+    bool write_bytes(const void* data, size_t size);
+
+    // Storage for the pixels of a new frame
+    std::vector<uint8_t> take_pixels(size_t size);
+
+    void enqueue(Frame&& frame);
+
+    static JournalRecordHeader make_header(uint64_t hit,
+                                           const std::string& var_name,
+                                           int width,
+                                           int height,
+                                           int channels,
+                                           Buffer::BufferType type,
+                                           const std::string& pixel_layout);
+};
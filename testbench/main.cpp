@@ -305,9 +305,35 @@ void bodyCaller() {
     t.join();
 }
 
+// Two trace locations hit in turn, each with a buffer of its own, e.g.:
+//   plot-trace traceStepA a
+//   plot-trace traceStepB b
+// Replaying the journal should show one frame per hit, a and b changing in
+// turn.
+void traceStepA(Mat& a, int frame) {
+    Mat::Iterator<uint8_t> i(a);
+    i(frame % a.rows, 0, 0) = 255;
+}
+
+void traceStepB(Mat& b, int frame) {
+    Mat::Iterator<uint8_t> i(b);
+    i(0, frame % b.cols, 1) = 255;
+}
+
+void interleavedTrace() {
+    Mat a, b;
+    ones<uint8_t>(64, 64, 1, a);
+    ones<uint8_t>(32, 16, 3, b);
+    for(int frame = 0; frame < 16; ++frame) {
+        traceStepA(a, frame);
+        traceStepB(b, frame);
+    }
+}
+
 int main(int, char *[])
 {
     bodyCaller();
+    interleavedTrace();
 
     return 0;
 }